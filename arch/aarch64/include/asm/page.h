@@ -45,10 +45,12 @@
 #define PAGE_BITS		12
 #define PAGE_2M_BITS		21
 #define HUGE_PAGE_BITS		12
+#define PAGE_1G_BITS		30
 /// The size of a single page in bytes
 #define PAGE_SIZE		( 1L << PAGE_BITS)
 #define PAGE_2M_SIZE		( 1L << PAGE_2M_BITS)
 #define HUGE_PAGE_SIZE		( 1L << HUGE_PAGE_BITS)
+#define PAGE_1G_SIZE		( 1L << PAGE_1G_BITS)
 #define PAGE_MASK		((~0L) << PAGE_BITS)
 #define PAGE_2M_MASK		((~0L) << PAGE_2M_BITS)
 #define HUGE_PAGE_MASK		((~0L) << HUGE_PAGE_BITS)
@@ -171,6 +173,60 @@ static inline int page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t
  */
 int page_unmap(size_t viraddr, size_t npages);
 
+struct cpumask;
+
+/** @brief Unmap a continuous region of pages
+ *
+ * TLB invalidations are broadcast to all cores => the mask is ignored.
+ *
+ * @param viraddr The virtual start address
+ * @param npages The range's size in pages
+ * @param mask Cores, which may cache translations of the range
+ * @return
+ */
+static inline int __page_unmap(size_t viraddr, size_t npages, const struct cpumask* mask)
+{
+	return page_unmap(viraddr, npages);
+}
+
+/** @brief Release the heap pages, which are completely covered by a range
+ *
+ * @param start Range's virtual start address
+ * @param end Range's virtual end address
+ *
+ * @return
+ * - number of released pages
+ * - -ENOSYS (-38), not yet supported on aarch64
+ */
+ssize_t page_release(size_t start, size_t end);
+
+/** @brief Map all heap pages of a range ahead of time
+ *
+ * @param start Range's virtual start address
+ * @param end Range's virtual end address
+ *
+ * @return
+ * - number of mapped pages
+ * - -ENOSYS (-38), not yet supported on aarch64
+ */
+ssize_t page_populate(size_t start, size_t end);
+
+/** @brief Back the heap and large page_alloc() requests by 1 GiB pages
+ *
+ * Ranges, which can't be covered by a whole 1 GiB page, still use
+ * 2 MiB pages.
+ *
+ * @param enable 1 to enable, 0 to disable 1 GiB pages
+ *
+ * @return
+ * - 0 on success
+ * - -EOPNOTSUPP (-95) if the processor doesn't support 1 GiB pages
+ */
+int page_enable_1g(uint8_t enable);
+
+/** @brief Are 1 GiB pages enabled for the heap? */
+int page_1g_enabled(void);
+
 /** @brief Change the page permission in the page tables of the current task
  *
  * Applies given flags noted in the 'flags' parameter to
@@ -40,7 +40,7 @@
 extern "C" {
 #endif
 
-int timer_deadline(uint32_t t);
+int timer_deadline(uint64_t t);
 
 void timer_disable(void);
 
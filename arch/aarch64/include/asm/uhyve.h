@@ -35,6 +35,7 @@
 #define __ARCH_UHYVE_H__
 
 #include <hermit/stddef.h>
+#include <hermit/errno.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -45,6 +46,17 @@ inline static void uhyve_send(unsigned short _port, unsigned int _data)
 	*((unsigned int*)(size_t)_port) = _data;
 }
 
+inline static void uhyve_send_direct(unsigned short _port, unsigned int _data)
+{
+	uhyve_send(_port, _data);
+}
+
+/// the shared syscall ring is only supported on x86_64
+inline static int uhyve_ring_init(void) { return 0; }
+inline static int uhyve_ring_write_async(int fd, const char* buf, size_t len) { return -EINVAL; }
+inline static int uhyve_has_iov(void) { return 0; }
+inline static int uhyve_has_pio(void) { return 0; }
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,8 @@
 #include <hermit/stdio.h>
 #include <hermit/logging.h>
 #include <hermit/spinlock.h>
+#include <hermit/numa.h>
+#include <hermit/errno.h>
 #include <asm/processor.h>
 
 /*
@@ -56,6 +58,39 @@ uint32_t get_cpu_frequency(void)
 	return cpu_freq;
 }
 
+// TODO: parse the NUMA topology => currently, everything belongs to node 0
+uint32_t numa_nodes(void)
+{
+	return 1;
+}
+
+uint32_t numa_cpu_node(uint32_t core_id)
+{
+	return 0;
+}
+
+uint32_t numa_mem_node(size_t phyaddr)
+{
+	return 0;
+}
+
+uint32_t numa_distance(uint32_t from, uint32_t to)
+{
+	return (from == to) ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+}
+
+int numa_node_cpus(uint32_t node, cpumask_t* mask)
+{
+	if (BUILTIN_EXPECT(!mask || node, 0))
+		return -EINVAL;
+
+	cpumask_clear(mask);
+	for(uint32_t i=0; i<MAX_CORES; i++)
+		cpumask_set(mask, i);
+
+	return 0;
+}
+
 static void init_percore_data(uint32_t core_id)
 {
 	asm volatile("msr tpidr_el1, %0" :: "r"(core_id * ((size_t) &percore_end0 - (size_t) &percore_start)));
@@ -203,6 +203,9 @@ int is_proxy(void)
 
 void wait_for_task(void)
 {
+	if (steal_task())
+		return;
+
 	HALT;
 }
 
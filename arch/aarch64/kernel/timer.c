@@ -97,7 +97,7 @@ static void restart_periodic_timer(void)
 }
 #endif
 
-int timer_deadline(uint32_t ticks)
+int timer_deadline(uint64_t ticks)
 {
 	set_cntp_tval(ticks * freq_hz / TIMER_FREQ);
 	set_cntp_ctl(1);
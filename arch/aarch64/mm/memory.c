@@ -108,6 +108,12 @@ out:
 	return ret;
 }
 
+// a single node => all pages are local
+size_t get_pages_node(size_t npages, uint32_t node)
+{
+	return get_pages(npages);
+}
+
 DEFINE_PER_CORE(size_t, ztmp_addr, 0);
 
 size_t get_zeroed_page(void)
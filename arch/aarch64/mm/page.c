@@ -199,6 +199,28 @@ int page_unmap(size_t viraddr, size_t npages)
 	return 0;
 }
 
+//TODO: code is missing
+ssize_t page_release(size_t start, size_t end)
+{
+	return -ENOSYS;
+}
+
+//TODO: code is missing
+ssize_t page_populate(size_t start, size_t end)
+{
+	return -ENOSYS;
+}
+
+int page_enable_1g(uint8_t enable)
+{
+	return enable ? -EOPNOTSUPP : 0;
+}
+
+int page_1g_enabled(void)
+{
+	return 0;
+}
+
 int page_fault_handler(size_t viraddr, size_t pc)
 {
 	task_t* task = per_core(current_task);
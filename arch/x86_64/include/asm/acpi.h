@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file arch/x86_64/include/asm/acpi.h
+ * @brief ACPI tables, which describe the NUMA topology
+ */
+
+#ifndef __ARCH_ACPI_H__
+#define __ARCH_ACPI_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Root System Description Pointer */
+typedef struct acpi_rsdp {
+	char signature[8];
+	uint8_t checksum;
+	char oem_id[6];
+	uint8_t revision;
+	uint32_t rsdt;
+	/// the following fields are only valid for revision >= 2
+	uint32_t length;
+	uint64_t xsdt;
+	uint8_t ext_checksum;
+	uint8_t reserved[3];
+} __attribute__ ((packed)) acpi_rsdp_t;
+
+/** @brief Common header of all system description tables */
+typedef struct acpi_header {
+	char signature[4];
+	uint32_t length;
+	uint8_t revision;
+	uint8_t checksum;
+	char oem_id[6];
+	char oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} __attribute__ ((packed)) acpi_header_t;
+
+/** @brief System Resource Affinity Table */
+typedef struct acpi_srat {
+	acpi_header_t header;
+	uint32_t reserved1;
+	uint64_t reserved2;
+} __attribute__ ((packed)) acpi_srat_t;
+
+/// SRAT entry types
+#define SRAT_CPU_AFFINITY	0
+#define SRAT_MEM_AFFINITY	1
+#define SRAT_X2APIC_AFFINITY	2
+
+/// SRAT entry is enabled
+#define SRAT_ENABLED		(1 << 0)
+
+/** @brief Processor Local APIC Affinity Structure */
+typedef struct srat_cpu_affinity {
+	uint8_t type;
+	uint8_t length;
+	uint8_t proximity_lo;
+	uint8_t apic_id;
+	uint32_t flags;
+	uint8_t sapic_eid;
+	uint8_t proximity_hi[3];
+	uint32_t clock_domain;
+} __attribute__ ((packed)) srat_cpu_affinity_t;
+
+/** @brief Memory Affinity Structure */
+typedef struct srat_mem_affinity {
+	uint8_t type;
+	uint8_t length;
+	uint32_t proximity;
+	uint16_t reserved1;
+	uint64_t base;
+	uint64_t size;
+	uint32_t reserved2;
+	uint32_t flags;
+	uint64_t reserved3;
+} __attribute__ ((packed)) srat_mem_affinity_t;
+
+/** @brief Processor Local x2APIC Affinity Structure */
+typedef struct srat_x2apic_affinity {
+	uint8_t type;
+	uint8_t length;
+	uint16_t reserved1;
+	uint32_t proximity;
+	uint32_t x2apic_id;
+	uint32_t flags;
+	uint32_t clock_domain;
+	uint32_t reserved2;
+} __attribute__ ((packed)) srat_x2apic_affinity_t;
+
+/** @brief System Locality Distance Information Table */
+typedef struct acpi_slit {
+	acpi_header_t header;
+	uint64_t localities;
+	uint8_t entry[];
+} __attribute__ ((packed)) acpi_slit_t;
+
+/** @brief Parse the SRAT and the SLIT
+ *
+ * Must be called before the page allocator switches to the
+ * chunks, which are assigned to the nodes.
+ *
+ * @return
+ * - 0 on success
+ * - -ENOENT (-2) if the firmware doesn't describe a NUMA topology
+ */
+int acpi_numa_init(void);
+
+/** @brief Assign a core to the node of its APIC id */
+void numa_add_cpu(uint32_t core_id, uint32_t apic_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
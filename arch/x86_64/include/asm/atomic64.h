@@ -67,6 +67,22 @@ inline static int64_t atomic_int64_test_and_set(atomic_int64_t* d, int64_t ret)
 	return ret;
 }
 
+/** @brief Atomic compare and exchange
+ *
+ * Stores v into the atomic_int64_t var, if it still contains old.
+ *
+ * @param d Pointer to the atomic_int64_t var you want to exchange
+ * @param old The value, which the var is expected to contain
+ * @param v The new value
+ *
+ * @return The value of the var before the operation (old on success)
+ */
+inline static int64_t atomic_int64_cmpxchg(atomic_int64_t* d, int64_t old, int64_t v)
+{
+	asm volatile(LOCK "cmpxchgq %2, %1" : "+a"(old), "+m"(d->counter) : "r"(v) : "memory", "cc");
+	return old;
+}
+
 /** @brief Atomic addition of values to atomic_int64_t vars
  *
  * This function lets you add values in an atomic operation
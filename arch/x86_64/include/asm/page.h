@@ -45,15 +45,18 @@
 #define PAGE_BITS		12
 #define PAGE_2M_BITS		21
 #define HUGE_PAGE_BITS		21
+#define PAGE_1G_BITS		30
 
 /// The size of a single page in bytes
 #define PAGE_SIZE		(1UL << PAGE_BITS)
 #define PAGE_2M_SIZE		(1UL << PAGE_2M_BITS)
 #define HUGE_PAGE_SIZE		(1UL << HUGE_PAGE_BITS)
+#define PAGE_1G_SIZE		(1UL << PAGE_1G_BITS)
 /// Mask the page address without page map flags and XD flag
 #define PAGE_MASK		(((~0UL) << PAGE_BITS) & ~PG_XD)
 #define PAGE_2M_MASK		(((~0UL) << PAGE_2M_BITS) & ~PG_XD)
 #define HUGE_PAGE_MASK		(((~0UL) << HUGE_PAGE_BITS) & ~PG_XD)
+#define PAGE_1G_MASK		(((~0UL) << PAGE_1G_BITS) & ~PG_XD)
 
 /// Total operand width in bits
 #define BITS			64
@@ -97,6 +100,10 @@ static inline size_t sign_extend(ssize_t addr, int bits)
 #define PAGE_2M_FLOOR(addr)	( (addr)                   & ((~0UL) << PAGE_2M_BITS))
 /// Align to nex huge page boundary
 #define HUGE_PAGE_FLOOR(addr)	( (addr)                  & ((~0UL) << HUGE_PAGE_BITS))
+/// Align to next 1G boundary
+#define PAGE_1G_CEIL(addr)	(((addr) + PAGE_1G_SIZE - 1) & ((~0UL) << PAGE_1G_BITS))
+/// Align to 1G boundary
+#define PAGE_1G_FLOOR(addr)	( (addr)                  & ((~0UL) << PAGE_1G_BITS))
 /// Align end of the kernel
 #define KERNEL_END_CEIL(addr)   (PAGE_2M_CEIL((addr)))
 
@@ -178,13 +185,87 @@ static inline int page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t
 	return __page_map(viraddr, phyaddr, npages, bits, 1);
 }
 
+/** @brief Flush a virtual address range in the TLB of the current core
+ *
+ * Ranges with few page table entries are flushed entry by entry. Larger
+ * heap ranges only drop the non-global entries, everything else flushes
+ * the whole TLB.
+ *
+ * @param start First address of the range
+ * @param end First address behind the range
+ * @param page_size Smallest page size, which maps the range. One INVLPG
+ * drops the whole entry, so larger pages need fewer invalidations.
+ */
+void tlb_flush_range(size_t start, size_t end, size_t page_size);
+
 /** @brief Unmap a continuous region of pages
  *
  * @param viraddr The virtual start address
  * @param npages The range's size in pages
+ * @param mask Cores, which may cache translations of the range. NULL
+ * shoots down the cores, which ran a task, for heap ranges and all other
+ * cores for the remaining ranges.
  * @return
  */
-int page_unmap(size_t viraddr, size_t npages);
+int __page_unmap(size_t viraddr, size_t npages, const struct cpumask* mask);
+
+/** @brief Unmap a continuous region of pages
+ *
+ * @param viraddr The virtual start address
+ * @param npages The range's size in pages
+ * @return
+ */
+static inline int page_unmap(size_t viraddr, size_t npages)
+{
+	return __page_unmap(viraddr, npages, NULL);
+}
+
+/** @brief Release the heap pages, which are completely covered by a range
+ *
+ * The huge pages are unmapped and a single shootdown is sent for all of
+ * them. The physical pages are returned by put_pages(), after all cores
+ * flushed their TLBs. If too many pages wait for a shootdown, the call
+ * waits for the other cores, so the whole range is always released.
+ *
+ * @param start Range's virtual start address
+ * @param end Range's virtual end address
+ *
+ * @return
+ * - number of released pages
+ * - -EINVAL (-22) if the range is outside of the heap
+ */
+ssize_t page_release(size_t start, size_t end);
+
+/** @brief Map all heap pages of a range ahead of time
+ *
+ * Physically continuous blocks of huge pages are mapped by a single
+ * __page_map() call, which creates the page tables as well.
+ *
+ * @param start Range's virtual start address
+ * @param end Range's virtual end address
+ *
+ * @return
+ * - number of mapped huge pages
+ * - -EINVAL (-22) if the range is outside of the heap
+ * - -ENOMEM (-12) if no page could be mapped
+ */
+ssize_t page_populate(size_t start, size_t end);
+
+/** @brief Back the heap and large page_alloc() requests by 1 GiB pages
+ *
+ * Ranges, which can't be covered by a whole 1 GiB page, still use
+ * 2 MiB pages.
+ *
+ * @param enable 1 to enable, 0 to disable 1 GiB pages
+ *
+ * @return
+ * - 0 on success
+ * - -EOPNOTSUPP (-95) if the processor doesn't support 1 GiB pages
+ */
+int page_enable_1g(uint8_t enable);
+
+/** @brief Are 1 GiB pages enabled for the heap? */
+int page_1g_enabled(void);
 
 /** @brief Change the page permission in the page tables of the current task
  *
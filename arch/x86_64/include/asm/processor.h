@@ -70,11 +70,13 @@ extern "C" {
 #define CPU_FEATURE_EST				(1 << 7)
 #define CPU_FEATURE_SSE3			(1 << 9)
 #define CPU_FEATURE_FMA				(1 << 12)
+#define CPU_FEATURE_PCID			(1 << 17)
 #define CPU_FEATURE_DCA				(1 << 18)
 #define CPU_FEATURE_SSE4_1			(1 << 19)
 #define CPU_FEATURE_SSE4_2			(1 << 20)
 #define CPU_FEATURE_X2APIC			(1 << 21)
 #define CPU_FEATURE_MOVBE			(1 << 22)
+#define CPU_FEATURE_TSC_DEADLINE		(1 << 24)
 #define CPU_FEATURE_XSAVE			(1 << 26)
 #define CPU_FEATURE_OSXSAVE			(1 << 27)
 #define CPU_FEATURE_AVX				(1 << 28)
@@ -212,6 +214,8 @@ extern "C" {
 
 /// APIC register
 #define MSR_APIC_BASE				0x0000001B
+/// TSC deadline of the local APIC timer
+#define MSR_IA32_TSC_DEADLINE			0x000006E0
 /// extended feature register
 #define MSR_EFER				0xc0000080
 /// legacy mode SYSCALL target
@@ -319,7 +323,7 @@ inline static size_t get_hbmem_base(void) {
 }
 
 inline static size_t get_hbmem_size(void) {
-	return hbmem_base;
+	return hbmem_size;
 }
 
 inline static uint32_t has_fpu(void) {
@@ -408,6 +412,14 @@ inline static uint32_t has_x2apic(void) {
 	return (cpu_info.feature2 & CPU_FEATURE_X2APIC);
 }
 
+inline static uint32_t has_pcid(void) {
+	return (cpu_info.feature2 & CPU_FEATURE_PCID);
+}
+
+inline static uint32_t has_tsc_deadline(void) {
+	return (cpu_info.feature2 & CPU_FEATURE_TSC_DEADLINE);
+}
+
 inline static uint32_t has_xsave(void) {
 	return (cpu_info.feature2 & CPU_FEATURE_XSAVE);
 }
@@ -433,6 +445,11 @@ inline static uint32_t has_nx(void)
 	return (cpu_info.feature3 & CPU_FEATURE_NX);
 }
 
+inline static uint32_t has_1gbhp(void)
+{
+	return (cpu_info.feature3 & CPU_FEATURE_1GBHP);
+}
+
 inline static uint32_t has_fsgsbase(void) {
 	return (cpu_info.feature4 & CPU_FEATURE_FSGSBASE);
 }
@@ -445,6 +462,10 @@ inline static uint32_t has_avx2(void) {
 	return (cpu_info.feature4 & CPU_FEATURE_AVX2);
 }
 
+inline static uint32_t has_invpcid(void) {
+	return (cpu_info.feature4 & CPU_FEATURE_INVPCID);
+}
+
 inline static uint32_t has_bmi1(void) {
 	return (cpu_info.feature4 & CPU_FEATURE_BMI1);
 }
@@ -715,9 +736,63 @@ inline static void invalidate_cache(void) {
 	asm volatile ("invd" ::: "memory");
 }
 
+/// Ranges with more page table entries are flushed by a full TLB flush
+#define TLB_FLUSH_MAX_PAGES	32
+
+/// PCID of the (single) address space
+#define KERNEL_PCID		0
+
+/// INVPCID types
+#define INVPCID_ADDR		0
+#define INVPCID_SINGLE		1
+#define INVPCID_ALL_GLOBAL	2
+#define INVPCID_ALL		3
+
+/** @brief Invalidate TLB entries tagged with a PCID
+ *
+ * @param type INVPCID_ADDR, INVPCID_SINGLE, INVPCID_ALL_GLOBAL or INVPCID_ALL
+ * @param pcid Process-context identifier
+ * @param addr Linear address (only used by INVPCID_ADDR)
+ */
+static inline void invpcid(size_t type, size_t pcid, size_t addr)
+{
+	struct {
+		uint64_t pcid;
+		uint64_t addr;
+	} desc = { pcid, addr };
+
+	asm volatile("invpcid %0, %1" :: "m"(desc), "r"(type) : "memory");
+}
+
 /// Send IPIs to the other core, which flush the TLB on the other cores.
 int ipi_tlb_flush(void);
 
+struct cpumask;
+
+/** @brief Flush a virtual address range on other cores
+ *
+ * The range is queued at every target core and a single IPI per core
+ * (or one broadcast) triggers the flush. The receiver uses one INVLPG
+ * per page table entry for small ranges and flushes the whole TLB
+ * otherwise.
+ *
+ * @param start First address of the range
+ * @param end First address behind the range
+ * @param page_size Smallest page size, which maps the range
+ * @param mask Cores, which may have cached the mapping (NULL = all online cores)
+ */
+int ipi_tlb_flush_range(size_t start, size_t end, size_t page_size, const struct cpumask* mask);
+
+/** @brief Check for shootdowns, which other cores have not finished yet
+ *
+ * A core is busy as long as it has not flushed all ranges, which were
+ * queued by ipi_tlb_flush_range(). Memory, which was unmapped before the
+ * shootdown, may be reused after this function returned 0.
+ *
+ * @return 1 if a shootdown is still in flight, 0 otherwise
+ */
+int ipi_tlb_pending(void);
+
 /** @brief Flush Translation Lookaside Buffer
  *
  * Just reads cr3 and writes the same value back into it.
@@ -735,6 +810,42 @@ static inline void tlb_flush(uint8_t with_ipi)
 #endif
 }
 
+/** @brief Flush the whole TLB including global pages
+ *
+ * INVPCID (all contexts) or toggling CR4.PGE invalidates also the global
+ * entries, which survive a reload of CR3.
+ */
+static inline void tlb_flush_all(void)
+{
+	size_t cr4;
+
+	if (has_invpcid()) {
+		invpcid(INVPCID_ALL_GLOBAL, 0, 0);
+		return;
+	}
+
+	cr4 = read_cr4();
+	if (cr4 & CR4_PGE) {
+		write_cr4(cr4 & ~CR4_PGE);
+		write_cr4(cr4);
+	} else write_cr3(read_cr3());
+}
+
+/** @brief Flush all non-global TLB entries of the address space
+ *
+ * In contrast to tlb_flush_all(), global mappings (kernel, stacks)
+ * survive. Uses INVPCID single-context invalidation, if available.
+ * With the single KERNEL_PCID, this costs as much as a reload of CR3.
+ * Therefore, tlb_flush_range() only uses it for large ranges.
+ */
+static inline void tlb_flush_context(void)
+{
+	if (has_invpcid())
+		invpcid(INVPCID_SINGLE, KERNEL_PCID, 0);
+	else
+		write_cr3(read_cr3());
+}
+
 /** @brief Flush a specific page entry in TLB
  * @param addr The (virtual) address of the page to flush
  */
@@ -40,7 +40,23 @@
 extern "C" {
 #endif
 
-static inline int timer_deadline(uint32_t t) { return apic_timer_deadline(t); }
+#ifdef DYNAMIC_TICKS
+/*
+ * Task timeouts are absolute TSC values, which enables the
+ * TSC deadline mode of the APIC timer.
+ */
+#define TIMER_CLOCK_TSC	1
+
+/** @brief Wait the given number of microseconds (TSC based)
+ *
+ * @return
+ * - 0 on success
+ */
+int timer_wait_usecs(uint64_t usecs);
+#endif
+
+/** @brief Start a oneshot timer, which expires in t TSC cycles */
+static inline int timer_deadline(uint64_t t) { return apic_timer_deadline(t); }
 
 static inline void timer_disable(void) { apic_disable_timer(); }
 
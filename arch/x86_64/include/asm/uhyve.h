@@ -41,7 +41,138 @@
 extern "C" {
 #endif
 
+/*
+ * Shared syscall ring
+ *
+ * The guest places the requests for the ports UHYVE_PORT_READ, _WRITE,
+ * _OPEN, _CLOSE, _LSEEK and their vectored and positional variants in
+ * a submission queue (SQ) instead of exiting for every request. An
+ * entry contains the port and the guest physical address of the same
+ * argument structure, which is used for port I/O. The consumer processes the entries in order and appends one
+ * entry per request to the completion queue (CQ).
+ *
+ * The consumer polls the SQ or sleeps. If it sleeps, it sets
+ * UHYVE_RING_NEED_WAKEUP and the guest rings the doorbell by writing
+ * to UHYVE_PORT_RINGNOTIFY. A monitor with ring support sets
+ * UHYVE_FEATURE_RING in the boot info. The guest registers the ring
+ * at boot time by UHYVE_PORT_RINGSETUP.
+ */
+
+/// uhyve consumes the syscall ring
+#define UHYVE_FEATURE_RING	(1 << 0)
+/// uhyve supports UHYVE_PORT_READV and UHYVE_PORT_WRITEV
+#define UHYVE_FEATURE_IOV	(1 << 1)
+/// uhyve supports UHYVE_PORT_PREAD and UHYVE_PORT_PWRITE
+#define UHYVE_FEATURE_PIO	(1 << 2)
+
+/// Number of entries of the SQ and the CQ (power of two)
+#define UHYVE_RING_ENTRIES	256
+/// The consumer sleeps => the guest has to ring the doorbell
+#define UHYVE_RING_NEED_WAKEUP	(1 << 0)
+
+typedef struct uhyve_sqe {
+	/// port of the request (UHYVE_PORT_*)
+	uint32_t port;
+	uint32_t reserved;
+	/// guest physical address of the arguments
+	uint64_t args;
+	/// passed unchanged to the completion
+	uint64_t user_data;
+} __attribute__((packed)) uhyve_sqe_t;
+
+typedef struct uhyve_cqe {
+	uint64_t user_data;
+	/// 0 or -EINVAL, if the consumer doesn't support the port
+	int64_t res;
+} __attribute__((packed)) uhyve_cqe_t;
+
+typedef struct uhyve_ring {
+	/// next SQ entry to be consumed, written by the consumer
+	volatile uint32_t sq_head __attribute__ ((aligned (CACHE_LINE)));
+	/// next free SQ entry, written by the guest
+	volatile uint32_t sq_tail __attribute__ ((aligned (CACHE_LINE)));
+	/// next CQ entry to be reaped, written by the guest
+	volatile uint32_t cq_head __attribute__ ((aligned (CACHE_LINE)));
+	/// next free CQ entry, written by the consumer
+	volatile uint32_t cq_tail __attribute__ ((aligned (CACHE_LINE)));
+	/// UHYVE_RING_NEED_WAKEUP, written by the consumer
+	volatile uint32_t flags __attribute__ ((aligned (CACHE_LINE)));
+	uhyve_sqe_t sq[UHYVE_RING_ENTRIES] __attribute__ ((aligned (CACHE_LINE)));
+	uhyve_cqe_t cq[UHYVE_RING_ENTRIES] __attribute__ ((aligned (CACHE_LINE)));
+} uhyve_ring_t;
+
+// UHYVE_PORT_RINGSETUP
+typedef struct {
+	/* IN */
+	uint64_t ring;
+	uint32_t entries;
+	/* OUT */
+	int32_t ret;
+} __attribute__((packed)) uhyve_ringsetup_t;
+
+/// features of the monitor, set in the boot info (UHYVE_FEATURE_*)
+extern uint32_t uhyve_features;
+
+/// is the syscall ring in use?
+extern volatile uint32_t uhyve_ring_enabled;
+
+/** @brief Initialize the syscall ring
+ *
+ * Uses the ring of the monitor, if it announces UHYVE_FEATURE_RING.
+ * Otherwise, the command line option "-uhyve-ring" starts a stand-in
+ * consumer on the last core, which forwards the requests by port I/O.
+ *
+ * @return
+ * - 0 on success or if the ring isn't used
+ * - -ENOMEM (-12) if out of memory
+ */
+int uhyve_ring_init(void);
+
+/** @brief Send a request via the ring and wait for its completion
+ *
+ * Requests for other ports are sent by port I/O after all pending
+ * requests are completed.
+ */
+void uhyve_ring_send(unsigned short port, size_t args);
+
+/** @brief Queue a short write to stdout or stderr without waiting
+ *
+ * The data is copied into the ring.
+ *
+ * @return
+ * - 0 if the write is queued
+ * - -EINVAL (-22) if the write isn't suitable (fd, size or no ring)
+ */
+int uhyve_ring_write_async(int fd, const char* buf, size_t len);
+
+/** @brief Ring the doorbell, if requests are pending and the consumer sleeps */
+void uhyve_ring_flush(void);
+
+/** @brief Does uhyve support vectored I/O requests? */
+inline static int uhyve_has_iov(void)
+{
+	return (uhyve_features & UHYVE_FEATURE_IOV) ? 1 : 0;
+}
+
+/** @brief Does uhyve support positional I/O requests? */
+inline static int uhyve_has_pio(void)
+{
+	return (uhyve_features & UHYVE_FEATURE_PIO) ? 1 : 0;
+}
+
 inline static void uhyve_send(unsigned short _port, unsigned int _data)
+{
+	if (uhyve_ring_enabled)
+		uhyve_ring_send(_port, _data);
+	else
+		outportl(_port, _data);
+}
+
+/** @brief Send a request by port I/O, bypassing the ring
+ *
+ * Doesn't reschedule and is usable by the page fault handler.
+ */
+inline static void uhyve_send_direct(unsigned short _port, unsigned int _data)
 {
 	outportl(_port, _data);
 }
@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Parser of the ACPI tables SRAT and SLIT, which describe the NUMA
+ * topology. Only the tables are mapped, which are required to
+ * determine the nodes of the cores and of the physical memory.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/errno.h>
+#include <hermit/vma.h>
+#include <hermit/logging.h>
+#include <hermit/numa.h>
+#include <asm/page.h>
+#include <asm/processor.h>
+#include <asm/acpi.h>
+
+/// Maximum number of memory ranges with a known node
+#define MAX_MEM_AFFINITY	32
+
+typedef struct mem_affinity {
+	size_t start, end;
+	uint32_t node;
+} mem_affinity_t;
+
+typedef struct cpu_affinity {
+	uint32_t apic_id;
+	uint32_t node;
+} cpu_affinity_t;
+
+/// proximity domains of the nodes => node ids are dense
+static uint32_t node_domain[MAX_NUMA_NODES];
+static uint32_t nr_nodes = 0;
+/// APIC ids of the SRAT and their nodes
+static cpu_affinity_t cpu_affinity[MAX_CORES];
+static uint32_t nr_cpu_affinity = 0;
+/// memory ranges of the SRAT and their nodes
+static mem_affinity_t mem_affinity[MAX_MEM_AFFINITY];
+static uint32_t nr_mem_affinity = 0;
+/// distances between the nodes
+static uint8_t node_distance[MAX_NUMA_NODES][MAX_NUMA_NODES];
+/// node of each core
+static uint32_t cpu_node[MAX_CORES] = {[0 ... MAX_CORES-1] = 0};
+/// cores, which are assigned by numa_add_cpu()
+static cpumask_t cpu_present;
+
+static uint8_t acpi_checksum(const void* ptr, size_t len)
+{
+	const uint8_t* p = (const uint8_t*) ptr;
+	uint8_t sum = 0;
+
+	for(size_t i=0; i<len; i++)
+		sum += p[i];
+
+	return sum;
+}
+
+/** @brief Map a physical range, which contains ACPI tables */
+static void* acpi_map(size_t phyaddr, size_t size)
+{
+	size_t start = PAGE_FLOOR(phyaddr);
+	size_t npages = (PAGE_CEIL(phyaddr + size) - start) >> PAGE_BITS;
+	size_t flags = PG_GLOBAL;
+	size_t viraddr;
+
+	if (has_nx())
+		flags |= PG_XD;
+
+	viraddr = vma_alloc(npages << PAGE_BITS, VMA_READ);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return NULL;
+
+	if (BUILTIN_EXPECT(page_map(viraddr, start, npages, flags), 0)) {
+		vma_free(viraddr, viraddr + (npages << PAGE_BITS));
+		return NULL;
+	}
+
+	return (void*) (viraddr + (phyaddr & ~PAGE_MASK));
+}
+
+static void acpi_unmap(void* ptr, size_t size)
+{
+	size_t viraddr = PAGE_FLOOR((size_t) ptr);
+	size_t npages = (PAGE_CEIL((size_t) ptr + size) - viraddr) >> PAGE_BITS;
+
+	page_unmap(viraddr, npages);
+	vma_free(viraddr, viraddr + (npages << PAGE_BITS));
+}
+
+/** @brief Search the RSDP within a physical range
+ *
+ * @return Physical address of the RSDP or 0
+ */
+static size_t acpi_search_rsdp(size_t start, size_t size)
+{
+	uint8_t* ptr = acpi_map(start, size);
+	size_t ret = 0;
+
+	if (BUILTIN_EXPECT(!ptr, 0))
+		return 0;
+
+	// the RSDP is located at a 16 byte boundary
+	for(size_t i=0; i+sizeof(acpi_rsdp_t)<=size; i+=16) {
+		if (strncmp((char*) ptr+i, "RSD PTR ", 8))
+			continue;
+		if (acpi_checksum(ptr+i, 20))
+			continue;
+
+		ret = start + i;
+		break;
+	}
+
+	acpi_unmap(ptr, size);
+
+	return ret;
+}
+
+/** @brief Map a system description table with the given signature
+ *
+ * @return Mapped table or NULL, if the signature or checksum don't match
+ */
+static acpi_header_t* acpi_map_table(size_t phyaddr, const char* signature)
+{
+	acpi_header_t* header = acpi_map(phyaddr, sizeof(acpi_header_t));
+	uint32_t length;
+
+	if (BUILTIN_EXPECT(!header, 0))
+		return NULL;
+
+	length = header->length;
+	if (strncmp(header->signature, signature, 4) || (length < sizeof(acpi_header_t))) {
+		acpi_unmap(header, sizeof(acpi_header_t));
+		return NULL;
+	}
+	acpi_unmap(header, sizeof(acpi_header_t));
+
+	header = acpi_map(phyaddr, length);
+	if (BUILTIN_EXPECT(!header, 0))
+		return NULL;
+
+	if (acpi_checksum(header, length)) {
+		LOG_WARNING("ACPI table %.4s has an invalid checksum\n", signature);
+		acpi_unmap(header, length);
+		return NULL;
+	}
+
+	return header;
+}
+
+/** @brief Convert a proximity domain to a node id
+ *
+ * @param add Register unknown domains as new node
+ *
+ * @return Node id or -1
+ */
+static int domain_to_node(uint32_t domain, uint8_t add)
+{
+	for(uint32_t i=0; i<nr_nodes; i++) {
+		if (node_domain[i] == domain)
+			return i;
+	}
+
+	if (!add)
+		return -1;
+
+	if (BUILTIN_EXPECT(nr_nodes >= MAX_NUMA_NODES, 0)) {
+		LOG_WARNING("Ignore proximity domain %u, increase MAX_ISLE!\n", domain);
+		return -1;
+	}
+
+	node_domain[nr_nodes] = domain;
+
+	return nr_nodes++;
+}
+
+static void add_cpu_affinity(uint32_t apic_id, uint32_t domain)
+{
+	int node = domain_to_node(domain, 1);
+
+	if ((node < 0) || (nr_cpu_affinity >= MAX_CORES))
+		return;
+
+	cpu_affinity[nr_cpu_affinity].apic_id = apic_id;
+	cpu_affinity[nr_cpu_affinity].node = node;
+	nr_cpu_affinity++;
+}
+
+static void parse_srat(acpi_srat_t* srat)
+{
+	uint8_t* ptr = (uint8_t*) srat + sizeof(acpi_srat_t);
+	uint8_t* end = (uint8_t*) srat + srat->header.length;
+
+	while((ptr + 2 <= end) && (ptr[1] >= 2) && (ptr + ptr[1] <= end)) {
+		switch(ptr[0]) {
+		case SRAT_CPU_AFFINITY: {
+			srat_cpu_affinity_t* cpu = (srat_cpu_affinity_t*) ptr;
+			uint32_t domain = cpu->proximity_lo;
+
+			if (!(cpu->flags & SRAT_ENABLED))
+				break;
+
+			// the high bytes are only valid for SRAT revision >= 2
+			if (srat->header.revision >= 2)
+				domain |= (cpu->proximity_hi[0] << 8) | (cpu->proximity_hi[1] << 16) | (cpu->proximity_hi[2] << 24);
+
+			add_cpu_affinity(cpu->apic_id, domain);
+			break;
+		}
+		case SRAT_MEM_AFFINITY: {
+			srat_mem_affinity_t* mem = (srat_mem_affinity_t*) ptr;
+			int node;
+
+			if (!(mem->flags & SRAT_ENABLED) || !mem->size)
+				break;
+
+			node = domain_to_node(mem->proximity, 1);
+			if ((node < 0) || (nr_mem_affinity >= MAX_MEM_AFFINITY))
+				break;
+
+			mem_affinity[nr_mem_affinity].start = mem->base;
+			mem_affinity[nr_mem_affinity].end = mem->base + mem->size;
+			mem_affinity[nr_mem_affinity].node = node;
+			nr_mem_affinity++;
+			break;
+		}
+		case SRAT_X2APIC_AFFINITY: {
+			srat_x2apic_affinity_t* cpu = (srat_x2apic_affinity_t*) ptr;
+
+			if (cpu->flags & SRAT_ENABLED)
+				add_cpu_affinity(cpu->x2apic_id, cpu->proximity);
+			break;
+		}
+		default:
+			break;
+		}
+
+		ptr += ptr[1];
+	}
+}
+
+static void parse_slit(acpi_slit_t* slit)
+{
+	uint64_t n = slit->localities;
+
+	if (BUILTIN_EXPECT(sizeof(acpi_slit_t) + n * n > slit->header.length, 0))
+		return;
+
+	for(uint64_t i=0; i<n; i++) {
+		int from = domain_to_node(i, 0);
+
+		if (from < 0)
+			continue;
+
+		for(uint64_t j=0; j<n; j++) {
+			int to = domain_to_node(j, 0);
+
+			if (to >= 0)
+				node_distance[from][to] = slit->entry[i*n+j];
+		}
+	}
+}
+
+int acpi_numa_init(void)
+{
+	acpi_rsdp_t* rsdp;
+	acpi_header_t* root;
+	size_t phyaddr = 0, entries, entry_size;
+	uint16_t* ebda;
+
+	for(uint32_t i=0; i<MAX_NUMA_NODES; i++) {
+		for(uint32_t j=0; j<MAX_NUMA_NODES; j++)
+			node_distance[i][j] = (i == j) ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+	}
+
+	// uhyve doesn't provide ACPI tables
+	if (is_uhyve())
+		return -ENOENT;
+
+	// first, search within the first KiB of the EBDA
+	ebda = acpi_map(0x40E, sizeof(uint16_t));
+	if (ebda) {
+		size_t addr = (size_t) *ebda << 4;
+
+		acpi_unmap(ebda, sizeof(uint16_t));
+		if ((addr >= 0x80000) && (addr < 0xA0000))
+			phyaddr = acpi_search_rsdp(addr, 0x400);
+	}
+
+	// second, search within the BIOS read-only memory
+	if (!phyaddr)
+		phyaddr = acpi_search_rsdp(0xE0000, 0x20000);
+
+	if (!phyaddr) {
+		LOG_INFO("Didn't find ACPI tables\n");
+		return -ENOENT;
+	}
+
+	rsdp = acpi_map(phyaddr, sizeof(acpi_rsdp_t));
+	if (BUILTIN_EXPECT(!rsdp, 0))
+		return -ENOMEM;
+
+	LOG_INFO("Found ACPI RSDP at 0x%zx (revision %u)\n", phyaddr, rsdp->revision);
+
+	if ((rsdp->revision >= 2) && rsdp->xsdt) {
+		phyaddr = rsdp->xsdt;
+		entry_size = sizeof(uint64_t);
+		acpi_unmap(rsdp, sizeof(acpi_rsdp_t));
+		root = acpi_map_table(phyaddr, "XSDT");
+	} else {
+		phyaddr = rsdp->rsdt;
+		entry_size = sizeof(uint32_t);
+		acpi_unmap(rsdp, sizeof(acpi_rsdp_t));
+		root = acpi_map_table(phyaddr, "RSDT");
+	}
+
+	if (BUILTIN_EXPECT(!root, 0)) {
+		LOG_WARNING("Invalid ACPI root table at 0x%zx\n", phyaddr);
+		return -ENOENT;
+	}
+
+	entries = (root->length - sizeof(acpi_header_t)) / entry_size;
+
+	// the SLIT refers to the nodes of the SRAT => two passes
+	for(uint32_t pass=0; pass<2; pass++) {
+		for(size_t i=0; i<entries; i++) {
+			uint8_t* entry = (uint8_t*) root + sizeof(acpi_header_t) + i * entry_size;
+			size_t addr = (entry_size == sizeof(uint64_t)) ? *((uint64_t*) entry) : *((uint32_t*) entry);
+			acpi_header_t* table = acpi_map_table(addr, pass ? "SLIT" : "SRAT");
+
+			if (!table)
+				continue;
+
+			if (pass)
+				parse_slit((acpi_slit_t*) table);
+			else
+				parse_srat((acpi_srat_t*) table);
+
+			acpi_unmap(table, table->length);
+		}
+	}
+
+	acpi_unmap(root, root->length);
+
+	if (!nr_nodes) {
+		LOG_INFO("ACPI doesn't describe a NUMA topology\n");
+		return -ENOENT;
+	}
+
+	LOG_INFO("Found %u NUMA nodes\n", nr_nodes);
+	for(uint32_t i=0; i<nr_mem_affinity; i++)
+		LOG_INFO("NUMA node %u: memory 0x%zx - 0x%zx\n", mem_affinity[i].node, mem_affinity[i].start, mem_affinity[i].end);
+
+	return 0;
+}
+
+void numa_add_cpu(uint32_t core_id, uint32_t apic_id)
+{
+	if (BUILTIN_EXPECT(core_id >= MAX_CORES, 0))
+		return;
+
+	cpumask_set(&cpu_present, core_id);
+	cpu_node[core_id] = 0;
+
+	for(uint32_t i=0; i<nr_cpu_affinity; i++) {
+		if (cpu_affinity[i].apic_id == apic_id) {
+			cpu_node[core_id] = cpu_affinity[i].node;
+			break;
+		}
+	}
+
+	if (nr_nodes > 1)
+		LOG_INFO("Core %u (APIC id %u) belongs to NUMA node %u\n", core_id, apic_id, cpu_node[core_id]);
+}
+
+uint32_t numa_nodes(void)
+{
+	return nr_nodes ? nr_nodes : 1;
+}
+
+uint32_t numa_cpu_node(uint32_t core_id)
+{
+	if (BUILTIN_EXPECT(core_id >= MAX_CORES, 0))
+		return 0;
+
+	return cpu_node[core_id];
+}
+
+uint32_t numa_mem_node(size_t phyaddr)
+{
+	for(uint32_t i=0; i<nr_mem_affinity; i++) {
+		if ((phyaddr >= mem_affinity[i].start) && (phyaddr < mem_affinity[i].end))
+			return mem_affinity[i].node;
+	}
+
+	return 0;
+}
+
+uint32_t numa_distance(uint32_t from, uint32_t to)
+{
+	if (BUILTIN_EXPECT((from >= MAX_NUMA_NODES) || (to >= MAX_NUMA_NODES), 0))
+		return NUMA_REMOTE_DISTANCE;
+
+	return node_distance[from][to];
+}
+
+int numa_node_cpus(uint32_t node, cpumask_t* mask)
+{
+	if (BUILTIN_EXPECT(!mask || (node >= numa_nodes()), 0))
+		return -EINVAL;
+
+	cpumask_clear(mask);
+
+	for(uint32_t i=0; i<MAX_CORES; i++) {
+		// without a topology, all cores belong to node 0
+		if ((numa_nodes() == 1) || (cpumask_test(&cpu_present, i) && (cpu_node[i] == node)))
+			cpumask_set(mask, i);
+	}
+
+	return 0;
+}
@@ -34,14 +34,17 @@
 #include <hermit/time.h>
 #include <hermit/spinlock.h>
 #include <hermit/vma.h>
+#include <hermit/memory.h>
 #include <hermit/tasks.h>
 #include <hermit/logging.h>
+#include <hermit/cpumask.h>
 #include <asm/irq.h>
 #include <asm/idt.h>
 #include <asm/irqflags.h>
 #include <asm/io.h>
 #include <asm/page.h>
 #include <asm/apic.h>
+#include <asm/acpi.h>
 #include <hermit/boot.h>
 
 /*
@@ -185,6 +188,11 @@ static inline void lapic_timer_periodic(void)
 	lapic_write(APIC_LVT_T, 0x2007B);
 }
 
+static inline void lapic_timer_tsc_deadline(void)
+{
+	lapic_write(APIC_LVT_T, 0x4007B);
+}
+
 extern uint32_t disable_x2apic;
 
 static inline void x2apic_disable(void)
@@ -315,18 +323,45 @@ static inline void set_ipi_dest(uint32_t cpu_id) {
 int apic_timer_is_running(void)
 {
 	if (BUILTIN_EXPECT(apic_is_enabled(), 1)) {
+#ifdef DYNAMIC_TICKS
+		if (has_tsc_deadline())
+			return rdmsr(MSR_IA32_TSC_DEADLINE) != 0;
+#endif
 		return lapic_read(APIC_CCR) != 0;
 	}
 
 	return 0;
 }
 
-int apic_timer_deadline(uint32_t ticks)
+int apic_timer_deadline(uint64_t cycles)
 {
-	if (BUILTIN_EXPECT(apic_is_enabled() && icr, 1)) {
-		LOG_DEBUG("timer oneshot %ld at core %d\n", ticks, CORE_ID);
+	if (BUILTIN_EXPECT(!apic_is_enabled(), 0))
+		return -EINVAL;
+
+	if (has_tsc_deadline()) {
+		LOG_DEBUG("timer deadline in %lld cycles at core %d\n", cycles, CORE_ID);
+		lapic_timer_tsc_deadline();
+		// the switch to TSC deadline mode has to be visible before the MSR write
+		mb();
+		wrmsr(MSR_IA32_TSC_DEADLINE, rdtsc() + cycles);
+
+		return 0;
+	}
+
+	if (BUILTIN_EXPECT(icr, 1)) {
+		// convert TSC cycles into counts of the APIC timer
+		const uint64_t cycles_per_tick = (1000000ULL * (uint64_t) get_cpu_frequency()) / TIMER_FREQ;
+		uint64_t counter = (cycles / cycles_per_tick) * icr + ((cycles % cycles_per_tick) * icr) / cycles_per_tick;
+
+		if (!counter)
+			counter = 1;
+		// the timer fires too early, check_timers() reprograms it
+		if (counter > 0xFFFFFFFFULL)
+			counter = 0xFFFFFFFFULL;
+
+		LOG_DEBUG("timer oneshot %lld at core %d\n", counter, CORE_ID);
 		lapic_timer_oneshot();
-		lapic_timer_set_counter(ticks * icr);
+		lapic_timer_set_counter((uint32_t) counter);
 
 		return 0;
 	}
@@ -664,6 +699,10 @@ int apic_calibration(void)
 	lapic_reset();
 
 	LOG_INFO("APIC calibration determined an ICR of 0x%x\n", icr);
+#ifdef DYNAMIC_TICKS
+	if (has_tsc_deadline())
+		LOG_INFO("Use TSC deadline mode for the APIC timer\n");
+#endif
 
 	apic_initialized = 1;
 	atomic_int32_inc(&cpu_online);
@@ -729,10 +768,9 @@ found_mp:
 		goto no_mp;
 	}
 
-	if (isle < 0) {
-		//TODO: add detection of NUMA node
+	// isles partition the multi-kernel, the NUMA nodes are parsed by acpi_numa_init()
+	if (isle < 0)
 		isle = 0;
-	}
 
 	LOG_INFO("Found MP config at 0x%x\n", apic_mp->mp_config);
 	LOG_INFO("System uses Multiprocessing Specification 1.%u\n", apic_mp->version);
@@ -806,6 +844,7 @@ found_mp:
 					boot_processor = j;
 				if (cpu->cpu_flags & 0x01) { // is the processor usable?
 					apic_processors[j] = cpu;
+					numa_add_cpu(j, cpu->id);
 					j++;
 				}
 			}
@@ -961,43 +1000,112 @@ int smp_start(void)
 	return smp_main();
 }
 
-int ipi_tlb_flush(void)
+/// Pending TLB shootdown of a core
+typedef struct tlb_request {
+	/// lock to protect the range
+	spinlock_irqsave_t lock;
+	/// first address of the range
+	size_t start;
+	/// first address behind the range (start == end => nothing to do)
+	size_t end;
+	/// smallest page size of the merged ranges
+	size_t page_size;
+	/// number of posted requests
+	volatile uint64_t posted;
+	/// value of posted, when the core finished its last flush
+	volatile uint64_t flushed;
+} tlb_request_t;
+
+static tlb_request_t tlb_requests[MAX_APIC_CORES] = {[0 ... MAX_APIC_CORES-1] = {SPINLOCK_IRQSAVE_INIT, 0, 0, 0, 0, 0}};
+
+/** @brief Queue a range at the target core, which is merged with a pending request */
+static inline void tlb_request_post(uint32_t core_id, size_t start, size_t end, size_t page_size)
+{
+	tlb_request_t* req = tlb_requests + core_id;
+
+	spinlock_irqsave_lock(&req->lock);
+	if (req->start < req->end) {
+		if (start < req->start)
+			req->start = start;
+		if (end > req->end)
+			req->end = end;
+		if (page_size < req->page_size)
+			req->page_size = page_size;
+	} else {
+		req->start = start;
+		req->end = end;
+		req->page_size = page_size;
+	}
+	req->posted++;
+	spinlock_irqsave_unlock(&req->lock);
+}
+
+int ipi_tlb_flush_range(size_t start, size_t end, size_t page_size, const cpumask_t* mask)
 {
 	uint32_t id = CORE_ID;
+	uint32_t others = 0, targets = 0;
+	cpumask_t dest;
 
 	if (atomic_int32_read(&cpu_online) <= 1)
 		return 0;
+	if (BUILTIN_EXPECT(start >= end, 0))
+		return 0;
 
-	if (has_x2apic()) {
-		uint8_t flags = irq_nested_disable();
+	if (!has_x2apic() && (lapic_read(APIC_ICR1) & APIC_ICR_BUSY)) {
+		LOG_ERROR("Previous send not complete");
+		return -EIO;
+	}
+
+	cpumask_clear(&dest);
+
+	// the cleared entries have to be visible, before the mask is read
+	if (mask)
+		mb();
+
+	uint8_t flags = irq_nested_disable();
+
+	for(uint32_t i=0; i<MAX_APIC_CORES; i++)
+	{
+		if (i == id)
+			continue;
+		if (!online[i])
+			continue;
+
+		others++;
+		if (mask && !cpumask_test(mask, i))
+			continue;
+
+		tlb_request_post(i, start, end, page_size);
+		cpumask_set(&dest, i);
+		targets++;
+	}
+
+	if (!targets)
+		goto out;
+
+	/*
+	 * Make previous memory operations globally visible before
+	 * sending the IPI => serializing
+	 */
+	mb();
+
+	if (has_x2apic() && (targets == others) && (is_single_kernel() || is_uhyve())) {
+		// all other cores are affected => one broadcast is sufficient
+		LOG_DEBUG("Broadcast TLB shootdown 0x%zx - 0x%zx\n", start, end);
+		wrmsr(0x830, APIC_DEST_ALLBUT|APIC_INT_ASSERT|APIC_DM_FIXED|112);
+	} else if (has_x2apic()) {
 		for(uint64_t i=0; i<MAX_APIC_CORES; i++)
 		{
-			if (i == id)
-				continue;
-			if (!online[i])
+			if (!cpumask_test(&dest, i))
 				continue;
 
 			LOG_DEBUG("Send IPI to %zd\n", i);
-			/*
-			 * Make previous memory operations globally visible before
-			 * sending the IPI through x2apic wrmsr. => serializing
-			 */
-			mb();
 			wrmsr(0x830, (i << 32)|APIC_INT_ASSERT|APIC_DM_FIXED|112);
 		}
-		irq_nested_enable(flags);
 	} else {
-		if (lapic_read(APIC_ICR1) & APIC_ICR_BUSY) {
-			LOG_ERROR("Previous send not complete");
-			return -EIO;
-		}
-
-		uint8_t flags = irq_nested_disable();
 		for(uint64_t i=0; i<MAX_APIC_CORES; i++)
 		{
-			if (i == id)
-				continue;
-			if (!online[i])
+			if (!cpumask_test(&dest, i))
 				continue;
 
 			LOG_DEBUG("Send IPI to %zd\n", i);
@@ -1008,7 +1116,30 @@ int ipi_tlb_flush(void)
 			while((lapic_read(APIC_ICR1) & APIC_ICR_BUSY) && (j < 1000))
 				j++; // wait for it to finish, give up eventualy tho
 		}
-		irq_nested_enable(flags);
+	}
+
+out:
+	irq_nested_enable(flags);
+
+	return 0;
+}
+
+int ipi_tlb_flush(void)
+{
+	return ipi_tlb_flush_range(0, ~0ULL, PAGE_SIZE, NULL);
+}
+
+int ipi_tlb_pending(void)
+{
+	uint32_t id = CORE_ID;
+
+	for(uint32_t i=0; i<MAX_APIC_CORES; i++)
+	{
+		if ((i == id) || !online[i])
+			continue;
+
+		if (tlb_requests[i].flushed != tlb_requests[i].posted)
+			return 1;
 	}
 
 	return 0;
@@ -1016,8 +1147,24 @@ int ipi_tlb_flush(void)
 
 static void apic_tlb_handler(struct state *s)
 {
-	LOG_DEBUG("Receive IPI at core %d to flush the TLB\n", CORE_ID);
-	write_cr3(read_cr3());
+	tlb_request_t* req = tlb_requests + CORE_ID;
+	size_t start, end, page_size;
+	uint64_t posted;
+
+	spinlock_irqsave_lock(&req->lock);
+	start = req->start;
+	end = req->end;
+	page_size = req->page_size;
+	posted = req->posted;
+	req->start = req->end = 0;
+	spinlock_irqsave_unlock(&req->lock);
+
+	LOG_DEBUG("Receive IPI at core %d to flush the TLB (0x%zx - 0x%zx)\n", CORE_ID, start, end);
+
+	tlb_flush_range(start, end, page_size);
+
+	// announce that all requests until posted are done
+	req->flushed = posted;
 }
 #endif
 
@@ -1097,6 +1244,8 @@ void shutdown_system(void)
 
 	if (if_bootprocessor) {
 		print_irq_stats();
+		print_sched_stats();
+		zero_pool_dump();
 		LOG_INFO("System goes down...\n");
 	}
 
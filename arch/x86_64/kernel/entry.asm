@@ -76,6 +76,7 @@ align 4
     global hcgateway
     global hcmask
     global host_logical_addr
+    global uhyve_features
     base dq 0
     limit dq 0
     cpu_freq dd 0
@@ -107,6 +108,7 @@ align 4
     hcgateway db 10,0,5,1
     hcmask db 255,255,255,0
     host_logical_addr dq 0
+    uhyve_features dd 0
 
 ; Bootstrap page tables are used during the initialization.
 align 4096
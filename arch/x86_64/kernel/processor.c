@@ -513,6 +513,7 @@ int cpu_detection(void) {
 		kprintf("Linear adress-width: %u bits\n", (cpu_info.addr_width >> 8) & 0xff);
 		kprintf("Sysenter instruction: %s\n", (cpu_info.feature1 & CPU_FEATURE_SEP) ? "available" : "unavailable");
 		kprintf("Syscall instruction: %s\n", (cpu_info.feature3 & CPU_FEATURE_SYSCALL) ? "available" : "unavailable");
+		kprintf("PCID: %s, INVPCID: %s\n", has_pcid() ? "available" : "unavailable", has_invpcid() ? "available" : "unavailable");
 	}
 
 	//TODO: add check for SMEP, PCE and SMAP
@@ -545,6 +546,13 @@ int cpu_detection(void) {
 								// to use rdtsc
 	write_cr4(cr4);
 
+	if (has_pcid() && !(cr4 & CR4_PCIDE)) {
+		// CR4.PCIDE can only be set, if CR3[11:0] is zero
+		// => the address space uses KERNEL_PCID (zero)
+		write_cr3(read_cr3() & PAGE_MASK);
+		write_cr4(read_cr4() | CR4_PCIDE);
+	}
+
 
 	if (first_time && has_fsgsbase())
 	{
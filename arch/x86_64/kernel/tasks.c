@@ -39,6 +39,7 @@
 #include <asm/page.h>
 #include <asm/multiboot.h>
 #include <asm/irqflags.h>
+#include <asm/uhyve.h>
 
 #define TLS_OFFSET		8
 #define TLS_ALIGNBITS		5
@@ -210,8 +211,15 @@ int create_default_frame(task_t* task, entry_point_t ep, void* arg, uint32_t cor
 
 void wait_for_task(void)
 {
+	// don't keep queued requests back, if nothing else happens
+	uhyve_ring_flush();
+
+	// use the idle time to prepare zeroed pages for the heap
+	if (!is_task_available() && zero_pool_refill())
+		return;
+
 	irq_disable();
-	if (is_task_available()) {
+	if (is_task_available() || steal_task()) {
 		irq_enable();
 		return;
 	}
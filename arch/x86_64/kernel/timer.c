@@ -116,13 +116,8 @@ static void timer_handler(struct state *s)
 #endif
 }
 
-int timer_wait(unsigned int ticks)
+static int timer_wait_until(uint64_t deadline)
 {
-#ifdef DYNAMIC_TICKS
-	check_ticks();
-#endif
-
-	uint64_t eticks = per_core(timer_ticks) + ticks;
 	task_t* curr_task = per_core(current_task);
 
 	if (curr_task->status == TASK_IDLE)
@@ -131,23 +126,39 @@ int timer_wait(unsigned int ticks)
 		 * This will continuously loop until the given time has
 		 * been reached
 		 */
-		while (per_core(timer_ticks) < eticks) {
+		while (get_timer_clock() < deadline) {
 			check_workqueues();
 
 			// recheck break condition
-			if (per_core(timer_ticks) >= eticks)
+			if (get_timer_clock() >= deadline)
 				break;
 
 			PAUSE;
 		}
-	} else if (per_core(timer_ticks) < eticks) {
-		set_timer(eticks);
+	} else if (get_timer_clock() < deadline) {
+		set_timer(deadline);
 		reschedule();
 	}
 
 	return 0;
 }
 
+int timer_wait(unsigned int ticks)
+{
+#ifdef DYNAMIC_TICKS
+	check_ticks();
+#endif
+
+	return timer_wait_until(get_timer_clock() + ticks_to_timer_clock(ticks));
+}
+
+#ifdef TIMER_CLOCK_TSC
+int timer_wait_usecs(uint64_t usecs)
+{
+	return timer_wait_until(get_timer_clock() + usecs_to_timer_clock(usecs));
+}
+#endif
+
 #define LATCH(f)	((CLOCK_TICK_RATE + f/2) / f)
 #define WAIT_SOME_TIME() do { uint64_t start = rdtsc(); mb(); \
 			      while(rdtsc() - start < 1000000) ; \
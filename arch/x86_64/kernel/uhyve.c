@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Guest side of the shared syscall ring (see asm/uhyve.h). Short writes
+ * to stdout and stderr are queued without waiting for their completion.
+ * The doorbell is rung, if UHYVE_RING_BATCH requests are pending, if a
+ * synchronous request is submitted or if a core becomes idle.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/errno.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/semaphore.h>
+#include <hermit/vma.h>
+#include <hermit/logging.h>
+#include <asm/atomic.h>
+#include <asm/io.h>
+#include <asm/processor.h>
+#include <asm/uhyve.h>
+
+/// Pending asynchronous requests, which ring the doorbell
+#define UHYVE_RING_BATCH	16
+/// Maximum size of a queued write
+#define UHYVE_RING_INLINE	(256 - 32)
+
+/// Layout of uhyve_write_t
+typedef struct {
+	int fd;
+	const char* buf;
+	size_t len;
+} __attribute__((packed)) uhyve_ring_write_t;
+
+/// Arguments and data of a queued write, one per SQ entry
+typedef struct uhyve_slot {
+	uhyve_ring_write_t args;
+	char data[UHYVE_RING_INLINE];
+} __attribute__ ((aligned (CACHE_LINE))) uhyve_slot_t;
+
+extern atomic_int32_t cpu_online;
+
+volatile uint32_t uhyve_ring_enabled = 0;
+
+static uhyve_ring_t* ring = NULL;
+static uhyve_slot_t* slots = NULL;
+static spinlock_irqsave_t ring_lock = SPINLOCK_IRQSAVE_INIT;
+/// the stand-in consumer runs in the guest
+static uint8_t standin = 0;
+static sem_t standin_sem = SEM_INIT(0);
+
+static inline int ring_port(unsigned short port)
+{
+	switch(port) {
+	case UHYVE_PORT_READ:
+	case UHYVE_PORT_WRITE:
+	case UHYVE_PORT_OPEN:
+	case UHYVE_PORT_CLOSE:
+	case UHYVE_PORT_LSEEK:
+	case UHYVE_PORT_READV:
+	case UHYVE_PORT_WRITEV:
+	case UHYVE_PORT_PREAD:
+	case UHYVE_PORT_PWRITE:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static inline void ring_doorbell(void)
+{
+	if (!(ring->flags & UHYVE_RING_NEED_WAKEUP))
+		return;
+
+	if (standin)
+		sem_post(&standin_sem);
+	else
+		outportl(UHYVE_PORT_RINGNOTIFY, 0);
+}
+
+/** @brief Reap the completions (ring_lock must be held) */
+static void ring_reap(void)
+{
+	uint32_t tail = ring->cq_tail;
+
+	rmb();
+
+	while(ring->cq_head != tail) {
+		uhyve_cqe_t* cqe = ring->cq + (ring->cq_head & (UHYVE_RING_ENTRIES-1));
+
+		if (BUILTIN_EXPECT(cqe->res, 0))
+			LOG_ERROR("uhyve ring: request 0x%llx failed with %lld\n", cqe->user_data, cqe->res);
+
+		ring->cq_head++;
+	}
+}
+
+/** @brief Wait until the consumer has completed the request with the sequence number seq */
+static void ring_wait(uint32_t seq)
+{
+	uint32_t i = 0;
+
+	while((int32_t) (ring->cq_tail - seq) <= 0) {
+		ring_doorbell();
+
+		// the consumer may run on the same core
+		if ((++i % 64) == 0)
+			reschedule();
+		else
+			PAUSE;
+	}
+}
+
+/** @brief Take a free SQ entry (ring_lock must be held)
+ *
+ * @return Sequence number of the entry
+ */
+static uint32_t ring_get_sqe(void)
+{
+	ring_reap();
+
+	// the CQ has to take the completions of all requests in flight
+	while(ring->sq_tail - ring->cq_head >= UHYVE_RING_ENTRIES) {
+		spinlock_irqsave_unlock(&ring_lock);
+		ring_wait(ring->cq_head);
+		spinlock_irqsave_lock(&ring_lock);
+		ring_reap();
+	}
+
+	return ring->sq_tail;
+}
+
+static inline void ring_submit(uint32_t seq, unsigned short port, size_t args)
+{
+	uhyve_sqe_t* sqe = ring->sq + (seq & (UHYVE_RING_ENTRIES-1));
+
+	sqe->port = port;
+	sqe->reserved = 0;
+	sqe->args = args;
+	sqe->user_data = seq;
+
+	// the entry has to be visible before the new tail
+	wmb();
+	ring->sq_tail = seq + 1;
+}
+
+void uhyve_ring_send(unsigned short port, size_t args)
+{
+	uint32_t seq;
+
+	spinlock_irqsave_lock(&ring_lock);
+
+	if (!ring_port(port)) {
+		// preserve the order of the requests
+		seq = ring->sq_tail;
+		spinlock_irqsave_unlock(&ring_lock);
+
+		ring_wait(seq - 1);
+		outportl(port, (unsigned) args);
+
+		return;
+	}
+
+	seq = ring_get_sqe();
+	ring_submit(seq, port, args);
+
+	spinlock_irqsave_unlock(&ring_lock);
+
+	mb();
+	ring_wait(seq);
+}
+
+int uhyve_ring_write_async(int fd, const char* buf, size_t len)
+{
+	uhyve_slot_t* slot;
+	uint32_t seq;
+
+	if (!uhyve_ring_enabled || ((fd != 1) && (fd != 2)) || (len > UHYVE_RING_INLINE))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&ring_lock);
+
+	seq = ring_get_sqe();
+	slot = slots + (seq & (UHYVE_RING_ENTRIES-1));
+
+	memcpy(slot->data, buf, len);
+	slot->args.fd = fd;
+	slot->args.buf = slot->data;
+	slot->args.len = len;
+
+	ring_submit(seq, UHYVE_PORT_WRITE, virt_to_phys((size_t) &slot->args));
+
+	spinlock_irqsave_unlock(&ring_lock);
+
+	mb();
+	if (ring->sq_tail - ring->sq_head >= UHYVE_RING_BATCH)
+		ring_doorbell();
+
+	return 0;
+}
+
+void uhyve_ring_flush(void)
+{
+	if (!uhyve_ring_enabled)
+		return;
+
+	mb();
+	if (ring->sq_tail != ring->sq_head)
+		ring_doorbell();
+}
+
+/** @brief Stand-in consumer, forwards the requests by port I/O */
+static int uhyve_ring_consumer(void* arg)
+{
+	uint32_t idle = 0;
+
+	LOG_INFO("uhyve ring: stand-in consumer is running on core %d\n", CORE_ID);
+
+	while(1) {
+		if (ring->sq_head == ring->sq_tail) {
+			if (++idle < 1000) {
+				PAUSE;
+				continue;
+			}
+
+			// announce the sleep and check again to avoid a lost wakeup
+			ring->flags |= UHYVE_RING_NEED_WAKEUP;
+			mb();
+			if (ring->sq_head == ring->sq_tail)
+				sem_wait(&standin_sem, 0);
+			ring->flags &= ~UHYVE_RING_NEED_WAKEUP;
+			idle = 0;
+			continue;
+		}
+
+		rmb();
+
+		uhyve_sqe_t* sqe = ring->sq + (ring->sq_head & (UHYVE_RING_ENTRIES-1));
+		uhyve_cqe_t* cqe = ring->cq + (ring->cq_tail & (UHYVE_RING_ENTRIES-1));
+
+		if (ring_port(sqe->port)) {
+			outportl(sqe->port, (unsigned) sqe->args);
+			cqe->res = 0;
+		} else cqe->res = -EINVAL;
+		cqe->user_data = sqe->user_data;
+
+		ring->sq_head++;
+		// the completion has to be visible before the new tail
+		wmb();
+		ring->cq_tail++;
+		idle = 0;
+	}
+
+	return 0;
+}
+
+int uhyve_ring_init(void)
+{
+	uint32_t ncores = atomic_int32_read(&cpu_online);
+	size_t size = PAGE_CEIL(sizeof(uhyve_ring_t)) + UHYVE_RING_ENTRIES * sizeof(uhyve_slot_t);
+
+	if (!is_uhyve())
+		return 0;
+
+	if (!(uhyve_features & UHYVE_FEATURE_RING)) {
+		if (!get_cmdline() || !strstr(get_cmdline(), "-uhyve-ring"))
+			return 0;
+
+		if (ncores < 2) {
+			LOG_WARNING("uhyve ring: the stand-in consumer requires at least two cores\n");
+			return 0;
+		}
+
+		standin = 1;
+	}
+
+	ring = (uhyve_ring_t*) page_alloc(size, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!ring, 0))
+		return -ENOMEM;
+
+	memset(ring, 0x00, size);
+	slots = (uhyve_slot_t*) ((size_t) ring + PAGE_CEIL(sizeof(uhyve_ring_t)));
+
+	if (standin) {
+		int ret = create_kernel_task_on_core(NULL, uhyve_ring_consumer, NULL, HIGH_PRIO, ncores-1);
+
+		if (BUILTIN_EXPECT(ret, 0)) {
+			page_free(ring, size);
+			ring = NULL;
+			return ret;
+		}
+	} else {
+		uhyve_ringsetup_t setup = {virt_to_phys((size_t) ring), UHYVE_RING_ENTRIES, -1};
+
+		outportl(UHYVE_PORT_RINGSETUP, (unsigned) virt_to_phys((size_t) &setup));
+		if (setup.ret) {
+			LOG_WARNING("uhyve ring: monitor rejected the ring: %d\n", setup.ret);
+			page_free(ring, size);
+			ring = NULL;
+			return 0;
+		}
+	}
+
+	uhyve_ring_enabled = 1;
+
+	LOG_INFO("uhyve ring: %d entries at 0x%zx (%s consumer)\n", UHYVE_RING_ENTRIES,
+		virt_to_phys((size_t) ring), standin ? "stand-in" : "uhyve");
+
+	return 0;
+}
@@ -29,12 +29,29 @@
 #include <hermit/stdlib.h>
 #include <hermit/stdio.h>
 #include <hermit/string.h>
+#include <hermit/errno.h>
 #include <hermit/spinlock.h>
 #include <hermit/memory.h>
+#include <hermit/vma.h>
+#include <hermit/syscall.h>
 #include <hermit/logging.h>
 
 #include <asm/atomic.h>
 #include <asm/page.h>
+#include <asm/processor.h>
+
+/*
+ * Besides the free list of the high bandwidth memory (HBM), this file
+ * provides the hbw heap for applications. The hbw heap is a window of
+ * the virtual address space, which is mapped on demand by huge pages.
+ * The page fault handler takes the pages from the HBM or from the
+ * regular memory, according to the hbw policy.
+ */
+
+/// Size of the virtual window of the hbw heap
+#define HBW_HEAP_SIZE	(1ULL << 36)
+/// Alignment of hbw blocks, the header is placed in front of a block
+#define HBW_ALIGN	64
 
 typedef struct free_list {
 	size_t start, end;
@@ -42,6 +59,14 @@ typedef struct free_list {
 	struct free_list* prev;
 } free_list_t;
 
+/** @brief Header in front of each hbw block */
+typedef struct hbw_header {
+	/// start of the block, includes padding of aligned blocks
+	size_t base;
+	/// size of the block
+	size_t size;
+} __attribute__ ((aligned (HBW_ALIGN))) hbw_header_t;
+
 extern size_t hbmem_base;
 extern size_t hbmem_size;
 
@@ -50,46 +75,131 @@ static spinlock_t list_lock = SPINLOCK_INIT;
 static free_list_t init_list = {0, 0, NULL, NULL};
 static free_list_t* free_start = &init_list;
 
+/// free ranges of the hbw heap
+static spinlock_t hbw_lock = SPINLOCK_INIT;
+static free_list_t* hbw_free_start = NULL;
+static size_t hbw_start = 0;
+static size_t hbw_end = 0;
+static int hbw_policy = HBW_POLICY_PREFERRED;
+/// the policy can only be changed before the first allocation
+static uint8_t hbw_used = 0;
+
 extern atomic_int64_t total_pages;
 extern atomic_int64_t total_allocated_pages;
 extern atomic_int64_t total_available_pages;
 
-size_t hbmem_get_pages(size_t npages)
+/** @brief Remove an element from a free list */
+static void free_list_remove(free_list_t** head, free_list_t* curr)
 {
-	size_t i, ret = 0;
-	free_list_t* curr = free_start;
+	if (curr->prev)
+		curr->prev->next = curr->next;
+	else
+		*head = curr->next;
+	if (curr->next)
+		curr->next->prev = curr->prev;
+
+	if (curr != &init_list)
+		kfree(curr);
+}
 
-	if (BUILTIN_EXPECT(!npages, 0))
-		return 0;
-	if (BUILTIN_EXPECT(npages > atomic_int64_read(&total_available_pages), 0))
-		return 0;
+/** @brief Take an aligned range out of a free list (lock must be held)
+ *
+ * @return Start of the range or 0
+ */
+static size_t free_list_get(free_list_t** head, size_t size, size_t align)
+{
+	free_list_t* curr;
+
+	for(curr=*head; curr; curr=curr->next) {
+		size_t start = (curr->start + align - 1) & ~(align - 1);
+
+		if ((start < curr->start) || (start + size > curr->end))
+			continue;
+
+		if (start == curr->start) {
+			curr->start += size;
+			if (curr->start == curr->end)
+				free_list_remove(head, curr);
+		} else if (start + size == curr->end) {
+			curr->end = start;
+		} else {
+			// the tail behind the range becomes a new element
+			free_list_t* n = kmalloc(sizeof(free_list_t));
 
-	spinlock_lock(&list_lock);
+			if (BUILTIN_EXPECT(!n, 0))
+				return 0;
 
-	while(curr) {
-		i = (curr->end - curr->start) / PAGE_SIZE;
-		if (i > npages) {
-			ret = curr->start;
-			curr->start += npages * PAGE_SIZE;
-			goto out;
-		} else if (i == npages) {
-			ret = curr->start;
-			if (curr->prev)
-				curr->prev = curr->next;
-			else
-				free_start = curr->next;
-			if (curr != &init_list)
-				kfree(curr);
-			goto out;
+			n->start = start + size;
+			n->end = curr->end;
+			n->prev = curr;
+			n->next = curr->next;
+			if (curr->next)
+				curr->next->prev = n;
+			curr->next = n;
+			curr->end = start;
 		}
 
+		return start;
+	}
+
+	return 0;
+}
+
+/** @brief Insert a range into a sorted free list and merge it with its neighbours (lock must be held) */
+static int free_list_put(free_list_t** head, size_t start, size_t end)
+{
+	free_list_t* prev = NULL;
+	free_list_t* curr = *head;
+
+	while (curr && (curr->start < start)) {
+		prev = curr;
 		curr = curr->next;
 	}
-out:
-	LOG_DEBUG("get_pages: ret 0%llx, curr->start 0x%llx, curr->end 0x%llx\n", ret, curr->start, curr->end);
 
+	if (prev && (prev->end == start)) {
+		prev->end = end;
+		if (curr && (curr->start == end)) {
+			prev->end = curr->end;
+			free_list_remove(head, curr);
+		}
+	} else if (curr && (curr->start == end)) {
+		curr->start = start;
+	} else {
+		free_list_t* n = kmalloc(sizeof(free_list_t));
+
+		if (BUILTIN_EXPECT(!n, 0))
+			return -ENOMEM;
+
+		n->start = start;
+		n->end = end;
+		n->prev = prev;
+		n->next = curr;
+		if (prev)
+			prev->next = n;
+		else
+			*head = n;
+		if (curr)
+			curr->prev = n;
+	}
+
+	return 0;
+}
+
+static size_t __hbmem_get_pages(size_t npages, size_t align)
+{
+	size_t ret;
+
+	if (BUILTIN_EXPECT(!npages, 0))
+		return 0;
+	if (BUILTIN_EXPECT(npages > atomic_int64_read(&total_available_pages), 0))
+		return 0;
+
+	spinlock_lock(&list_lock);
+	ret = free_list_get(&free_start, npages * PAGE_SIZE, align);
 	spinlock_unlock(&list_lock);
 
+	LOG_DEBUG("hbmem_get_pages: ret 0x%zx, npages %zd\n", ret, npages);
+
 	if (ret) {
 		atomic_int64_add(&total_allocated_pages, npages);
 		atomic_int64_sub(&total_available_pages, npages);
@@ -98,10 +208,19 @@ out:
 	return ret;
 }
 
-/* TODO: reunion of elements is still missing */
+size_t hbmem_get_pages(size_t npages)
+{
+	return __hbmem_get_pages(npages, PAGE_SIZE);
+}
+
+size_t hbmem_get_huge_page(void)
+{
+	return __hbmem_get_pages(HUGE_PAGE_SIZE/PAGE_SIZE, HUGE_PAGE_SIZE);
+}
+
 int hbmem_put_pages(size_t phyaddr, size_t npages)
 {
-	free_list_t* curr = free_start;
+	int ret;
 
 	if (BUILTIN_EXPECT(!phyaddr, 0))
 		return -EINVAL;
@@ -109,47 +228,250 @@ int hbmem_put_pages(size_t phyaddr, size_t npages)
 		return -EINVAL;
 
 	spinlock_lock(&list_lock);
+	ret = free_list_put(&free_start, phyaddr, phyaddr + npages * PAGE_SIZE);
+	spinlock_unlock(&list_lock);
 
-	while(curr) {
-		if (phyaddr+npages*PAGE_SIZE == curr->start) {
-			curr->start = phyaddr;
-			goto out;
-		} else if (phyaddr == curr->end) {
-			curr->end += npages*PAGE_SIZE;
-			goto out;
-		} if (phyaddr > curr->end) {
-			free_list_t* n = kmalloc(sizeof(free_list_t));
+	if (BUILTIN_EXPECT(ret, 0))
+		return ret;
 
-			if (BUILTIN_EXPECT(!n, 0))
-				goto out_err;
+	atomic_int64_sub(&total_allocated_pages, npages);
+	atomic_int64_add(&total_available_pages, npages);
 
-			/* add new element */
-			n->start = phyaddr;
-			n->end = phyaddr + npages * PAGE_SIZE;
-			n->prev = curr;
-			n->next = curr->next;
-			curr->next = n;
+	return 0;
+}
+
+int is_hbmem_available(void)
+{
+	return (hbmem_base != 0);
+}
+
+int hbw_contains(size_t viraddr)
+{
+	return (viraddr >= hbw_start) && (viraddr < hbw_end);
+}
+
+size_t hbw_get_huge_page(size_t viraddr)
+{
+	size_t phyaddr = 0;
+
+	switch(hbw_policy) {
+	case HBW_POLICY_BIND:
+		phyaddr = hbmem_get_huge_page();
+		break;
+	case HBW_POLICY_INTERLEAVE:
+		// odd huge pages use the regular memory first => both bandwidths add up
+		if ((viraddr >> HUGE_PAGE_BITS) & 1) {
+			phyaddr = get_huge_page();
+			if (!phyaddr)
+				phyaddr = hbmem_get_huge_page();
+			break;
 		}
+		// fall through
+	default:
+		phyaddr = hbmem_get_huge_page();
+		if (!phyaddr)
+			phyaddr = get_huge_page();
+		break;
+	}
 
-		curr = curr->next;
+	return phyaddr;
+}
+
+/** @brief Reserve the virtual window of the hbw heap */
+static int hbw_init(void)
+{
+	size_t viraddr;
+
+	if (hbw_start)
+		return 0;
+
+	viraddr = vma_alloc(HBW_HEAP_SIZE + HUGE_PAGE_SIZE, VMA_USER|VMA_HEAP);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return -ENOMEM;
+
+	if (BUILTIN_EXPECT(free_list_put(&hbw_free_start, HUGE_PAGE_CEIL(viraddr), HUGE_PAGE_CEIL(viraddr) + HBW_HEAP_SIZE), 0)) {
+		vma_free(viraddr, viraddr + HBW_HEAP_SIZE + HUGE_PAGE_SIZE);
+		return -ENOMEM;
 	}
-out:
-	spinlock_unlock(&list_lock);
 
-	atomic_int64_sub(&total_allocated_pages, npages);
-	atomic_int64_add(&total_available_pages, npages);
+	hbw_end = HUGE_PAGE_CEIL(viraddr) + HBW_HEAP_SIZE;
+	hbw_start = HUGE_PAGE_CEIL(viraddr);
+
+	LOG_INFO("hbw heap 0x%zx - 0x%zx, HBM %s\n", hbw_start, hbw_end, hbmem_base ? "available" : "not available");
 
 	return 0;
+}
 
-out_err:
-	spinlock_unlock(&list_lock);
+static void* hbw_alloc(size_t size, size_t align)
+{
+	hbw_header_t* header;
+	size_t base, addr, end;
+
+	if (BUILTIN_EXPECT(!size || (size > HBW_HEAP_SIZE), 0))
+		return NULL;
+	if ((hbw_policy == HBW_POLICY_BIND) && !hbmem_base)
+		return NULL;
+	if (align < HBW_ALIGN)
+		align = HBW_ALIGN;
+
+	spinlock_lock(&hbw_lock);
+
+	hbw_used = 1;
+	if (BUILTIN_EXPECT(hbw_init(), 0)) {
+		spinlock_unlock(&hbw_lock);
+		return NULL;
+	}
+
+	// the padding in front of an aligned block remains part of the block
+	base = free_list_get(&hbw_free_start, align + ((size + HBW_ALIGN - 1) & ~(HBW_ALIGN - 1)), HBW_ALIGN);
+
+	spinlock_unlock(&hbw_lock);
+
+	if (BUILTIN_EXPECT(!base, 0))
+		return NULL;
 
-	return -ENOMEM;
+	addr = (base + sizeof(hbw_header_t) + align - 1) & ~(align - 1);
+	end = base + align + ((size + HBW_ALIGN - 1) & ~(HBW_ALIGN - 1));
+
+	header = (hbw_header_t*) (addr - sizeof(hbw_header_t));
+	header->base = base;
+	header->size = end - base;
+
+	return (void*) addr;
 }
 
-int is_hbmem_available(void)
+static inline hbw_header_t* hbw_header(void* ptr)
 {
-	return (hbmem_base != 0);
+	if (BUILTIN_EXPECT(!hbw_contains((size_t) ptr), 0))
+		return NULL;
+
+	return (hbw_header_t*) ((size_t) ptr - sizeof(hbw_header_t));
+}
+
+void* sys_hbw_malloc(size_t size)
+{
+	return hbw_alloc(size, HBW_ALIGN);
+}
+
+void* sys_hbw_calloc(size_t nmemb, size_t size)
+{
+	void* ptr;
+
+	if (BUILTIN_EXPECT(size && (nmemb > (size_t) -1 / size), 0))
+		return NULL;
+
+	ptr = hbw_alloc(nmemb * size, HBW_ALIGN);
+	if (ptr)
+		memset(ptr, 0x00, nmemb * size);
+
+	return ptr;
+}
+
+size_t sys_hbw_usable_size(void* ptr)
+{
+	hbw_header_t* header = hbw_header(ptr);
+
+	if (!header)
+		return 0;
+
+	return header->base + header->size - (size_t) ptr;
+}
+
+void sys_hbw_free(void* ptr)
+{
+	hbw_header_t* header = hbw_header(ptr);
+	size_t base, size;
+
+	if (!ptr)
+		return;
+	if (BUILTIN_EXPECT(!header, 0)) {
+		LOG_ERROR("hbw_free: %p isn't part of the hbw heap\n", ptr);
+		return;
+	}
+
+	base = header->base;
+	size = header->size;
+
+	/*
+	 * The mapped pages stay in the hbw heap and are reused
+	 * by the following allocations.
+	 */
+	spinlock_lock(&hbw_lock);
+	if (BUILTIN_EXPECT(free_list_put(&hbw_free_start, base, base + size), 0))
+		LOG_WARNING("hbw_free: lost 0x%zx bytes of the hbw heap\n", size);
+	spinlock_unlock(&hbw_lock);
+}
+
+void* sys_hbw_realloc(void* ptr, size_t size)
+{
+	size_t old;
+	void* new;
+
+	if (!ptr)
+		return sys_hbw_malloc(size);
+
+	if (!size) {
+		sys_hbw_free(ptr);
+		return NULL;
+	}
+
+	old = sys_hbw_usable_size(ptr);
+	if (size <= old)
+		return ptr;
+
+	new = sys_hbw_malloc(size);
+	if (BUILTIN_EXPECT(!new, 0))
+		return NULL;
+
+	memcpy(new, ptr, old);
+	sys_hbw_free(ptr);
+
+	return new;
+}
+
+int sys_hbw_posix_memalign(void** memptr, size_t align, size_t size)
+{
+	void* ptr;
+
+	if (BUILTIN_EXPECT(!memptr, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(!align || (align & (align - 1)) || (align % sizeof(void*)), 0))
+		return -EINVAL;
+
+	ptr = hbw_alloc(size, align);
+	if (BUILTIN_EXPECT(!ptr, 0))
+		return -ENOMEM;
+
+	*memptr = ptr;
+
+	return 0;
+}
+
+int sys_hbw_check_available(void)
+{
+	return hbmem_base ? 0 : -ENODEV;
+}
+
+int sys_hbw_set_policy(int policy)
+{
+	int ret = 0;
+
+	if (BUILTIN_EXPECT((policy < HBW_POLICY_BIND) || (policy > HBW_POLICY_INTERLEAVE), 0))
+		return -EINVAL;
+
+	spinlock_lock(&hbw_lock);
+	if (hbw_used && (policy != hbw_policy))
+		ret = -EPERM;
+	else
+		hbw_policy = policy;
+	spinlock_unlock(&hbw_lock);
+
+	return ret;
+}
+
+int sys_hbw_get_policy(void)
+{
+	return hbw_policy;
 }
 
 int hbmemory_init(void)
@@ -32,10 +32,13 @@
 #include <hermit/spinlock.h>
 #include <hermit/memory.h>
 #include <hermit/logging.h>
+#include <hermit/numa.h>
 
 #include <asm/atomic.h>
 #include <asm/page.h>
+#include <asm/irqflags.h>
 #include <asm/multiboot.h>
+#include <asm/acpi.h>
 
 #define GAP_BELOW	0x100000ULL
 #define IB_POOL_SIZE 0x400000ULL
@@ -46,11 +49,72 @@
 extern uint64_t base;
 extern uint64_t limit;
 
-typedef struct free_list {
+/*
+ * The physical memory is managed in chunks of HUGE_PAGE_SIZE. Completely
+ * free chunks are kept by a binary buddy system, which merges neighbours
+ * on release. Smaller requests are served from partially used chunks,
+ * which track their pages by a bitmap. All meta data lives in one array,
+ * which is allocated at boot time => no kmalloc within the page allocator.
+ *
+ * Each NUMA node has its own buddy and partial lists. Buddies of different
+ * nodes are never merged. Requests are served by the node of the current
+ * core and fall back to the other nodes by increasing distance.
+ */
+
+/// Number of pages per chunk
+#define CHUNK_PAGES		(HUGE_PAGE_SIZE / PAGE_SIZE)
+/// Number of bitmap words per chunk
+#define CHUNK_WORDS		(CHUNK_PAGES / 64)
+/// Number of buddy orders => largest block is 2^(CHUNK_ORDERS-1) chunks
+#define CHUNK_ORDERS		20
+/// Marks the end of a chunk list
+#define CHUNK_NONE		0xFFFFFFFFU
+/// Number of partially used chunks, which are checked before a free chunk is split
+#define CHUNK_SCAN		8
+/// Number of single pages, which are cached per core
+#define PAGE_CACHE_SIZE		16
+/// Maximum number of usable memory regions
+#define MAX_MEM_REGIONS		32
+
+/// Chunk belongs to the bitmap allocator (bit set => page is in use)
+#define CHUNK_USED		0
+/// Chunk is the head of a free buddy
+#define CHUNK_FREE		1
+/// Chunk is part of a free buddy, but not its head
+#define CHUNK_TAIL		2
+
+typedef struct page_chunk {
+	/// allocation bitmap of a used chunk
+	uint64_t bitmap[CHUNK_WORDS];
+	/// index of the next chunk in the buddy or partial list
+	uint32_t next;
+	/// index of the previous chunk in the buddy or partial list
+	uint32_t prev;
+	/// number of free pages of a used chunk
+	uint16_t nr_free;
+	/// order of a free buddy
+	uint8_t order;
+	/// CHUNK_USED, CHUNK_FREE or CHUNK_TAIL
+	uint8_t state;
+	/// NUMA node of the chunk
+	uint8_t node;
+} page_chunk_t;
+
+/** @brief Per-core cache of single pages
+ *
+ * Only the owning core accesses its cache with disabled interrupts
+ * => no lock required
+ */
+typedef struct page_cache {
+	/// number of cached pages
+	uint32_t count;
+	/// physical addresses of the cached pages
+	size_t pages[PAGE_CACHE_SIZE];
+} page_cache_t;
+
+typedef struct mem_region {
 	size_t start, end;
-	struct free_list* next;
-	struct free_list* prev;
-} free_list_t;
+} mem_region_t;
 
 /*
  * Note that linker symbols are not variables, they have no memory allocated for
@@ -63,68 +127,470 @@ extern const void kernel_start;
 
 static spinlock_irqsave_t list_lock = SPINLOCK_IRQSAVE_INIT;
 
-static free_list_t init_list = {0, 0, NULL, NULL};
-static free_list_t* free_start = &init_list;
+/// meta data of all chunks, NULL until chunk_init() has been called
+static page_chunk_t* page_chunks = NULL;
+static size_t nr_chunks = 0;
+/// free buddies per node, sorted by their order
+static uint32_t free_area[MAX_NUMA_NODES][CHUNK_ORDERS] = { [0 ... MAX_NUMA_NODES-1] = { [0 ... CHUNK_ORDERS-1] = CHUNK_NONE } };
+/// used chunks per node, which have still free pages
+static uint32_t partial_list[MAX_NUMA_NODES] = { [0 ... MAX_NUMA_NODES-1] = CHUNK_NONE };
+/// nodes sorted by their distance to each node
+static uint8_t node_order[MAX_NUMA_NODES][MAX_NUMA_NODES];
+static uint32_t nr_nodes = 1;
+static page_cache_t page_caches[MAX_CORES];
+
+/// boot region, which is used as bump allocator until chunk_init() has been called
+static size_t boot_start = 0;
+static size_t boot_end = 0;
+/// usable memory beside the boot region
+static mem_region_t mem_regions[MAX_MEM_REGIONS];
+static uint32_t nr_mem_regions = 0;
 
 atomic_int64_t total_pages = ATOMIC_INIT(0);
 atomic_int64_t total_allocated_pages = ATOMIC_INIT(0);
 atomic_int64_t total_available_pages = ATOMIC_INIT(0);
 
-static size_t __get_pages(size_t npages, size_t align)
+static inline void chunk_list_add(uint32_t* head, uint32_t idx)
+{
+	page_chunk_t* c = page_chunks + idx;
+
+	c->prev = CHUNK_NONE;
+	c->next = *head;
+	if (*head != CHUNK_NONE)
+		page_chunks[*head].prev = idx;
+	*head = idx;
+}
+
+static inline void chunk_list_remove(uint32_t* head, uint32_t idx)
+{
+	page_chunk_t* c = page_chunks + idx;
+
+	if (c->prev != CHUNK_NONE)
+		page_chunks[c->prev].next = c->next;
+	else
+		*head = c->next;
+	if (c->next != CHUNK_NONE)
+		page_chunks[c->next].prev = c->prev;
+	c->next = c->prev = CHUNK_NONE;
+}
+
+/** @brief Mark pages of a chunk as used */
+static void chunk_set_bits(page_chunk_t* c, uint32_t first, uint32_t n)
+{
+	while (n) {
+		uint32_t bit = first % 64;
+		uint32_t len = (n < 64 - bit) ? n : 64 - bit;
+		uint64_t mask = (len == 64) ? ~0ULL : ((1ULL << len) - 1) << bit;
+
+		c->bitmap[first / 64] |= mask;
+		first += len;
+		n -= len;
+	}
+}
+
+/** @brief Mark pages of a chunk as free
+ *
+ * @return Number of pages, which were in use before
+ */
+static uint32_t chunk_clear_bits(page_chunk_t* c, uint32_t first, uint32_t n)
+{
+	uint32_t cleared = 0;
+
+	while (n) {
+		uint32_t bit = first % 64;
+		uint32_t len = (n < 64 - bit) ? n : 64 - bit;
+		uint64_t mask = (len == 64) ? ~0ULL : ((1ULL << len) - 1) << bit;
+
+		cleared += __builtin_popcountll(c->bitmap[first / 64] & mask);
+		c->bitmap[first / 64] &= ~mask;
+		first += len;
+		n -= len;
+	}
+
+	return cleared;
+}
+
+/** @brief Find n consecutive free pages within a chunk
+ *
+ * @return Index of the first page or -1 if no such range exists
+ */
+static int chunk_find_run(page_chunk_t* c, uint32_t n)
+{
+	uint32_t i = 0, start = 0, len = 0;
+
+	while (i < CHUNK_PAGES) {
+		uint64_t w = c->bitmap[i / 64];
+
+		if (!(i % 64) && (w == ~0ULL)) {
+			len = 0;
+			i += 64;
+		} else if (!(i % 64) && !w) {
+			if (!len)
+				start = i;
+			len += 64;
+			i += 64;
+			if (len >= n)
+				return start;
+		} else {
+			if (w & (1ULL << (i % 64))) {
+				len = 0;
+			} else {
+				if (!len)
+					start = i;
+				if (++len >= n)
+					return start;
+			}
+			i++;
+		}
+	}
+
+	return -1;
+}
+
+/** @brief Insert a free buddy and merge it with its neighbours of the same node */
+static void chunk_free_block(uint32_t idx, uint8_t order)
+{
+	uint8_t node = page_chunks[idx].node;
+
+	while (order < CHUNK_ORDERS-1) {
+		uint32_t buddy = idx ^ (1U << order);
+
+		if ((buddy >= nr_chunks) || (page_chunks[buddy].state != CHUNK_FREE)
+		    || (page_chunks[buddy].order != order) || (page_chunks[buddy].node != node))
+			break;
+
+		chunk_list_remove(free_area[node]+order, buddy);
+		page_chunks[idx | (1U << order)].state = CHUNK_TAIL;
+		idx &= ~(1U << order);
+		order++;
+	}
+
+	page_chunks[idx].state = CHUNK_FREE;
+	page_chunks[idx].order = order;
+	chunk_list_add(free_area[node]+order, idx);
+}
+
+/** @brief Release the chunks [first, last) to the buddy system */
+static void chunk_free_range(uint32_t first, uint32_t last)
+{
+	while (first < last) {
+		uint8_t order = 0;
+
+		// use the largest aligned buddy, which fits into the range
+		while ((order < CHUNK_ORDERS-1) && !(first & ((2U << order) - 1))
+		       && (first + (2U << order) <= last))
+			order++;
+
+		chunk_free_block(first, order);
+		first += 1U << order;
+	}
+}
+
+/** @brief Remove a buddy of the given order and node and split larger ones if required
+ *
+ * @return Index of the first chunk or CHUNK_NONE
+ */
+static uint32_t chunk_alloc_block(uint8_t order, uint32_t node)
+{
+	uint32_t* area = free_area[node];
+	uint8_t o = order;
+	uint32_t idx;
+
+	while ((o < CHUNK_ORDERS) && (area[o] == CHUNK_NONE))
+		o++;
+	if (o >= CHUNK_ORDERS)
+		return CHUNK_NONE;
+
+	idx = area[o];
+	chunk_list_remove(area+o, idx);
+
+	while (o > order) {
+		o--;
+		page_chunks[idx + (1U << o)].state = CHUNK_FREE;
+		page_chunks[idx + (1U << o)].order = o;
+		chunk_list_add(area+o, idx + (1U << o));
+	}
+
+	return idx;
+}
+
+/** @brief Hand over a chunk to the bitmap allocator, the first n pages are used */
+static void chunk_use(uint32_t idx, uint32_t n)
+{
+	page_chunk_t* c = page_chunks + idx;
+
+	memset(c->bitmap, 0x00, sizeof(c->bitmap));
+	chunk_set_bits(c, 0, n);
+	c->nr_free = CHUNK_PAGES - n;
+	c->state = CHUNK_USED;
+	if (c->nr_free)
+		chunk_list_add(partial_list+c->node, idx);
+}
+
+/** @brief Search a partially used chunk of a node for n free pages (list_lock must be held) */
+static size_t chunk_get_partial(size_t npages, uint32_t max_scan, uint32_t node)
+{
+	uint32_t idx = partial_list[node];
+
+	for(uint32_t i=0; (i<max_scan) && (idx != CHUNK_NONE); i++, idx = page_chunks[idx].next) {
+		page_chunk_t* c = page_chunks + idx;
+		int pos;
+
+		if (c->nr_free < npages)
+			continue;
+
+		pos = chunk_find_run(c, npages);
+		if (pos < 0)
+			continue;
+
+		chunk_set_bits(c, pos, npages);
+		c->nr_free -= npages;
+		if (!c->nr_free)
+			chunk_list_remove(partial_list+node, idx);
+
+		return ((size_t) idx << HUGE_PAGE_BITS) + ((size_t) pos << PAGE_BITS);
+	}
+
+	return 0;
+}
+
+/** @brief Allocate pages from the chunks of a node (list_lock must be held)
+ *
+ * Supported alignments are PAGE_SIZE and HUGE_PAGE_SIZE. Requests of
+ * whole chunks are additionally aligned to the size of their buddy block,
+ * e.g. 512 chunks start at a 1 GiB boundary.
+ */
+static size_t chunk_get_node_pages(size_t npages, size_t align, uint32_t node)
+{
+	uint32_t idx, nchunks;
+	uint8_t order = 0;
+	size_t ret;
+
+	if ((npages < CHUNK_PAGES) && (align <= PAGE_SIZE)) {
+		ret = chunk_get_partial(npages, CHUNK_SCAN, node);
+		if (ret)
+			return ret;
+
+		idx = chunk_alloc_block(0, node);
+		if (idx == CHUNK_NONE)
+			return chunk_get_partial(npages, CHUNK_NONE, node);
+
+		chunk_use(idx, npages);
+
+		return (size_t) idx << HUGE_PAGE_BITS;
+	}
+
+	nchunks = (npages + CHUNK_PAGES - 1) / CHUNK_PAGES;
+	while ((1U << order) < nchunks)
+		order++;
+
+	idx = chunk_alloc_block(order, node);
+	if (idx == CHUNK_NONE)
+		return 0;
+
+	for(uint32_t i=0; i<nchunks-1; i++)
+		chunk_use(idx+i, CHUNK_PAGES);
+	chunk_use(idx+nchunks-1, npages - (nchunks-1) * CHUNK_PAGES);
+
+	// return the unused tail of the buddy
+	chunk_free_range(idx+nchunks, idx+(1U << order));
+
+	return (size_t) idx << HUGE_PAGE_BITS;
+}
+
+/** @brief Allocate pages from the chunks (list_lock must be held)
+ *
+ * The preferred node is tried first, then the remaining nodes
+ * by increasing distance.
+ */
+static size_t __chunk_get_pages(size_t npages, size_t align, uint32_t node)
+{
+	size_t ret = 0;
+
+	if (BUILTIN_EXPECT(node >= nr_nodes, 0))
+		node = 0;
+
+	for(uint32_t i=0; (i<nr_nodes) && !ret; i++)
+		ret = chunk_get_node_pages(npages, align, node_order[node][i]);
+
+	return ret;
+}
+
+/** @brief Release pages to the chunks (list_lock must be held) */
+static int __chunk_put_pages(size_t phyaddr, size_t npages)
+{
+	size_t first = phyaddr >> PAGE_BITS;
+	size_t last = first + npages;
+
+	if (BUILTIN_EXPECT(last > nr_chunks * CHUNK_PAGES, 0))
+		return -EINVAL;
+
+	while (first < last) {
+		uint32_t idx = first / CHUNK_PAGES;
+		uint32_t bit = first % CHUNK_PAGES;
+		uint32_t n = (last - first < CHUNK_PAGES - bit) ? last - first : CHUNK_PAGES - bit;
+		page_chunk_t* c = page_chunks + idx;
+		uint32_t cleared;
+		uint16_t old;
+
+		first += n;
+
+		if (BUILTIN_EXPECT(c->state != CHUNK_USED, 0)) {
+			LOG_ERROR("put_pages: chunk 0x%zx is already free\n", (size_t) idx << HUGE_PAGE_BITS);
+			continue;
+		}
+
+		cleared = chunk_clear_bits(c, bit, n);
+		if (BUILTIN_EXPECT(cleared != n, 0))
+			LOG_WARNING("put_pages: %u pages of chunk 0x%zx were already free\n",
+				n - cleared, (size_t) idx << HUGE_PAGE_BITS);
+		if (!cleared)
+			continue;
+
+		old = c->nr_free;
+		c->nr_free += cleared;
+
+		if (c->nr_free == CHUNK_PAGES) {
+			if (old)
+				chunk_list_remove(partial_list+c->node, idx);
+			chunk_free_block(idx, 0);
+		} else if (!old) {
+			chunk_list_add(partial_list+c->node, idx);
+		}
+	}
+
+	return 0;
+}
+
+/** @brief Bump allocator for the boot phase (list_lock must be held) */
+static size_t boot_get_pages(size_t npages, size_t align)
+{
+	size_t ret = (boot_start + align - 1) & ~(align - 1);
+
+	if (BUILTIN_EXPECT(ret + npages * PAGE_SIZE > boot_end, 0))
+		return 0;
+
+	boot_start = ret + npages * PAGE_SIZE;
+
+	return ret;
+}
+
+/** @brief Get a single page from the cache of the current core
+ *
+ * The cache is only refilled from the local node. If the local node is
+ * exhausted, a page of the nearest node bypasses the cache.
+ */
+static size_t page_cache_get(void)
+{
+	page_cache_t* cache;
+	size_t ret = 0;
+	uint32_t node;
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+
+	cache = page_caches + CORE_ID;
+	if (!cache->count) {
+		node = numa_cpu_node(CORE_ID);
+		if (BUILTIN_EXPECT(node >= nr_nodes, 0))
+			node = 0;
+
+		// refill the half cache
+		spinlock_irqsave_lock(&list_lock);
+		while (cache->count < PAGE_CACHE_SIZE / 2) {
+			size_t phyaddr = chunk_get_node_pages(1, PAGE_SIZE, node);
+			if (!phyaddr)
+				break;
+			cache->pages[cache->count++] = phyaddr;
+		}
+
+		if (!cache->count)
+			ret = __chunk_get_pages(1, PAGE_SIZE, node);
+		spinlock_irqsave_unlock(&list_lock);
+	}
+
+	if (cache->count)
+		ret = cache->pages[--cache->count];
+
+	irq_nested_enable(flags);
+
+	return ret;
+}
+
+/** @brief Put a single page into the cache of the current core
+ *
+ * Pages of remote nodes bypass the cache => the cache holds only local pages.
+ */
+static void page_cache_put(size_t phyaddr)
 {
-	size_t i, ret = 0;
-	free_list_t* curr = free_start;
+	page_cache_t* cache;
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+
+	if (page_chunks[phyaddr >> HUGE_PAGE_BITS].node != numa_cpu_node(CORE_ID)) {
+		spinlock_irqsave_lock(&list_lock);
+		__chunk_put_pages(phyaddr, 1);
+		spinlock_irqsave_unlock(&list_lock);
+		irq_nested_enable(flags);
+		return;
+	}
+
+	cache = page_caches + CORE_ID;
+	if (cache->count >= PAGE_CACHE_SIZE) {
+		// flush the half cache
+		spinlock_irqsave_lock(&list_lock);
+		while (cache->count > PAGE_CACHE_SIZE / 2)
+			__chunk_put_pages(cache->pages[--cache->count], 1);
+		spinlock_irqsave_unlock(&list_lock);
+	}
+
+	cache->pages[cache->count++] = phyaddr;
+
+	irq_nested_enable(flags);
+}
+
+/** @brief Return all pages of the current core's cache (list_lock must be held) */
+static void page_cache_drain(void)
+{
+	uint8_t flags = irq_nested_disable();
+	page_cache_t* cache = page_caches + CORE_ID;
+
+	while (cache->count)
+		__chunk_put_pages(cache->pages[--cache->count], 1);
+
+	irq_nested_enable(flags);
+}
+
+static size_t __get_pages(size_t npages, size_t align, uint32_t node)
+{
+	size_t ret;
 
 	if (BUILTIN_EXPECT(!npages, 0))
 		return 0;
 	if (BUILTIN_EXPECT(npages > atomic_int64_read(&total_available_pages), 0))
 		return 0;
 
-	spinlock_irqsave_lock(&list_lock);
+	if ((npages == 1) && (align <= PAGE_SIZE) && page_chunks && (node == numa_cpu_node(CORE_ID))) {
+		ret = page_cache_get();
+	} else {
+		spinlock_irqsave_lock(&list_lock);
 
-	while(curr) {
-		i = (curr->end - curr->start) / PAGE_SIZE;
-		if (i > npages) {
-			if (!(curr->start & (align-1)))	 {
-				ret = curr->start;
-				curr->start += npages * PAGE_SIZE;
-				goto out;
-			} else {
-				size_t tmp = HUGE_PAGE_CEIL(curr->start);
-				if (tmp < curr->end) {
-					// Ok, we have to split the list
-					free_list_t* n = kmalloc(sizeof(free_list_t));
-					if (n) {
-						n->start = tmp;
-						n->end = curr->end;
-						curr->end = n->start;
-						n->prev = curr;
-						n->next = curr->next;
-						curr->next = n;
-					}
-				}
-			}
-		} else if ((i == npages) && !(curr->start & (align-1))) {
-			ret = curr->start;
-			if (curr->prev) {
-				if (curr->next)
-					curr->next->prev = curr->prev;
-				curr->prev->next = curr->next;
-			} else {
-				free_start = curr->next;
-				free_start->prev = NULL;
+		if (BUILTIN_EXPECT(!page_chunks, 0)) {
+			ret = boot_get_pages(npages, align);
+		} else {
+			ret = __chunk_get_pages(npages, align, node);
+			if (!ret) {
+				// cached pages may prevent the merging of buddies
+				page_cache_drain();
+				ret = __chunk_get_pages(npages, align, node);
 			}
-			if (curr != &init_list)
-				kfree(curr);
-			goto out;
 		}
 
-		curr = curr->next;
+		spinlock_irqsave_unlock(&list_lock);
 	}
-out:
-	LOG_DEBUG("get_pages: ret 0%llx, curr->start 0x%llx, curr->end 0x%llx\n", ret, curr->start, curr->end);
 
-	spinlock_irqsave_unlock(&list_lock);
+	LOG_DEBUG("get_pages: ret 0x%zx, npages %zd\n", ret, npages);
 
 	if (ret) {
 		atomic_int64_add(&total_allocated_pages, npages);
@@ -136,15 +602,46 @@ out:
 
 size_t get_pages(size_t npages)
 {
-	return __get_pages(npages, PAGE_SIZE);
+	return __get_pages(npages, PAGE_SIZE, numa_cpu_node(CORE_ID));
+}
+
+size_t get_pages_node(size_t npages, uint32_t node)
+{
+	return __get_pages(npages, PAGE_SIZE, node);
 }
 
 size_t get_huge_page(void)
 {
-	return __get_pages(HUGE_PAGE_SIZE/PAGE_SIZE, HUGE_PAGE_SIZE);
+	return __get_pages(HUGE_PAGE_SIZE/PAGE_SIZE, HUGE_PAGE_SIZE, numa_cpu_node(CORE_ID));
+}
+
+size_t get_huge_pages(size_t n)
+{
+	return __get_pages(n*(HUGE_PAGE_SIZE/PAGE_SIZE), HUGE_PAGE_SIZE, numa_cpu_node(CORE_ID));
 }
 
 DEFINE_PER_CORE(size_t, ztmp_addr, 0);
+/// 2 MiB window to zero huge pages
+DEFINE_PER_CORE(size_t, zhuge_addr, 0);
+/// 2 MiB window of the idle task to refill the zero pool
+DEFINE_PER_CORE(size_t, zidle_addr, 0);
+
+#ifdef ZERO_POOL
+/// Pre-zeroed huge pages of a core
+typedef struct zero_pool {
+	/// physical addresses of the zeroed pages
+	size_t pages[ZERO_POOL];
+	/// number of zeroed pages
+	uint32_t count;
+	/// statistics
+	uint64_t hits, misses, refills;
+} zero_pool_t;
+
+static zero_pool_t zero_pools[MAX_CORES];
+
+/// set by the first request of a zeroed huge page
+static uint8_t zero_pool_enabled = 0;
+#endif
 
 static inline size_t get_ztmp_addr(void)
 {
@@ -162,6 +659,58 @@ static inline size_t get_ztmp_addr(void)
 	return viraddr;
 }
 
+/** @brief Reserve a huge page aligned window in the virtual address space */
+static size_t alloc_huge_window(void)
+{
+	size_t viraddr = vma_alloc(2*HUGE_PAGE_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return 0;
+
+	LOG_DEBUG("Core %d uses 0x%zx as temporary huge page\n", CORE_ID, HUGE_PAGE_CEIL(viraddr));
+
+	return HUGE_PAGE_CEIL(viraddr);
+}
+
+/** @brief Zero a range by non-temporal stores, which bypass the caches
+ *
+ * A zeroed huge page is typically not touched soon after. Regular
+ * stores would evict 2 MiB of useful data from the caches.
+ */
+static inline void zero_nt(size_t viraddr, size_t size)
+{
+	for(size_t addr=viraddr; addr<viraddr+size; addr+=64) {
+		asm volatile ("movnti %1, 0(%0)\n\t"
+			"movnti %1, 8(%0)\n\t"
+			"movnti %1, 16(%0)\n\t"
+			"movnti %1, 24(%0)\n\t"
+			"movnti %1, 32(%0)\n\t"
+			"movnti %1, 40(%0)\n\t"
+			"movnti %1, 48(%0)\n\t"
+			"movnti %1, 56(%0)"
+			:: "r"(addr), "r"(0UL) : "memory");
+	}
+
+	// non-temporal stores are weakly ordered
+	wmb();
+}
+
+/** @brief Map a huge page at a temporary window and zero it
+ *
+ * The window belongs to the current core, which flushes only its own TLB.
+ */
+static int zero_huge_page(size_t viraddr, size_t phyaddr)
+{
+	int ret = __page_map(viraddr, phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE, PG_GLOBAL|PG_RW|PG_PRESENT|PG_NX, 0);
+
+	if (BUILTIN_EXPECT(ret, 0))
+		return ret;
+
+	zero_nt(viraddr, HUGE_PAGE_SIZE);
+
+	return 0;
+}
+
 size_t get_zeroed_page(void)
 {
 	size_t phyaddr = get_page();
@@ -172,10 +721,13 @@ size_t get_zeroed_page(void)
 	uint8_t flags = irq_nested_disable();
 
 	size_t viraddr = get_ztmp_addr();
-	if (!viraddr) {
+	if (viraddr) {
 		__page_map(viraddr, phyaddr, 1, PG_GLOBAL|PG_RW|PG_PRESENT, 0);
 
 		memset((void*) viraddr, 0x00, PAGE_SIZE);
+	} else {
+		put_page(phyaddr);
+		phyaddr = 0;
 	}
 
 	irq_nested_enable(flags);
@@ -183,75 +735,222 @@ size_t get_zeroed_page(void)
 	return phyaddr;
 }
 
-size_t get_zeroed_huge_page(void)
+size_t get_zeroed_huge_pages(size_t n)
 {
-	size_t phyaddr = get_huge_page();
+	size_t phyaddr, viraddr;
+	uint8_t flags;
 
+	phyaddr = get_huge_pages(n);
 	if (BUILTIN_EXPECT(!phyaddr, 0))
 		return 0;
 
-	uint8_t flags = irq_nested_disable();
+	flags = irq_nested_disable();
 
-	size_t viraddr = get_ztmp_addr();
-	if (!viraddr) {
-		for(uint32_t i=0; i<HUGE_PAGE_SIZE/PAGE_SIZE; i++) {
-			__page_map(viraddr, phyaddr+i*PAGE_SIZE, 1, PG_GLOBAL|PG_RW|PG_PRESENT, 0);
-			memset((void*) viraddr, 0x00, PAGE_SIZE);
-		}
+	viraddr = per_core(zhuge_addr);
+	if (BUILTIN_EXPECT(!viraddr, 0)) {
+		viraddr = alloc_huge_window();
+		set_per_core(zhuge_addr, viraddr);
+	}
+
+	for(size_t i=0; viraddr && (i<n); i++) {
+		if (BUILTIN_EXPECT(zero_huge_page(viraddr, phyaddr+i*HUGE_PAGE_SIZE), 0))
+			viraddr = 0;
 	}
 
 	irq_nested_enable(flags);
 
+	if (BUILTIN_EXPECT(!viraddr, 0)) {
+		put_pages(phyaddr, n*(HUGE_PAGE_SIZE/PAGE_SIZE));
+		return 0;
+	}
+
 	return phyaddr;
 }
 
-/* TODO: reunion of elements is still missing */
+size_t get_zeroed_huge_page(void)
+{
+#ifdef ZERO_POOL
+	size_t phyaddr = 0;
+	uint8_t flags = irq_nested_disable();
+	zero_pool_t* pool = zero_pools + CORE_ID;
+
+	zero_pool_enabled = 1;
+
+	if (pool->count) {
+		phyaddr = pool->pages[--pool->count];
+		pool->hits++;
+	} else pool->misses++;
+
+	irq_nested_enable(flags);
+
+	if (phyaddr)
+		return phyaddr;
+#endif
+
+	return get_zeroed_huge_pages(1);
+}
+
+int zero_pool_refill(void)
+{
+#ifdef ZERO_POOL
+	zero_pool_t* pool;
+	size_t phyaddr, viraddr;
+	uint8_t flags;
+
+	if (!zero_pool_enabled)
+		return 0;
+
+	flags = irq_nested_disable();
+	pool = zero_pools + CORE_ID;
+	if (pool->count >= ZERO_POOL) {
+		irq_nested_enable(flags);
+		return 0;
+	}
+
+	viraddr = per_core(zidle_addr);
+	if (BUILTIN_EXPECT(!viraddr, 0)) {
+		viraddr = alloc_huge_window();
+		set_per_core(zidle_addr, viraddr);
+	}
+	irq_nested_enable(flags);
+
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return 0;
+
+	phyaddr = get_huge_page();
+	if (!phyaddr)
+		return 0;
+
+	/*
+	 * Interrupts stay enabled while zeroing. Only the idle task
+	 * uses this window, other tasks use zhuge_addr.
+	 */
+	if (BUILTIN_EXPECT(zero_huge_page(viraddr, phyaddr), 0)) {
+		put_pages(phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE);
+		return 0;
+	}
+
+	flags = irq_nested_disable();
+	if (pool->count < ZERO_POOL) {
+		pool->pages[pool->count++] = phyaddr;
+		pool->refills++;
+		phyaddr = 0;
+	}
+	irq_nested_enable(flags);
+
+	// a task filled the pool in the meantime
+	if (phyaddr)
+		put_pages(phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE);
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+void zero_pool_dump(void)
+{
+#ifdef ZERO_POOL
+	uint64_t hits = 0, misses = 0, refills = 0;
+	uint32_t count = 0;
+
+	for(uint32_t i=0; i<MAX_CORES; i++) {
+		count += zero_pools[i].count;
+		hits += zero_pools[i].hits;
+		misses += zero_pools[i].misses;
+		refills += zero_pools[i].refills;
+	}
+
+	if (zero_pool_enabled)
+		LOG_INFO("zero pool: %u pages, %llu hits, %llu misses, %llu refills\n", count, hits, misses, refills);
+#endif
+}
+
 int put_pages(size_t phyaddr, size_t npages)
 {
-	free_list_t* curr = free_start;
+	int ret = 0;
 
 	if (BUILTIN_EXPECT(!phyaddr, 0))
 		return -EINVAL;
 	if (BUILTIN_EXPECT(!npages, 0))
 		return -EINVAL;
+	if (BUILTIN_EXPECT(!page_chunks, 0)) {
+		// pages of the boot phase stay allocated
+		LOG_WARNING("put_pages: page allocator isn't initialized\n");
+		return -EINVAL;
+	}
+	if (BUILTIN_EXPECT((phyaddr >> PAGE_BITS) + npages > nr_chunks * CHUNK_PAGES, 0))
+		return -EINVAL;
 
-	spinlock_irqsave_lock(&list_lock);
+	if (npages == 1) {
+		page_cache_put(phyaddr);
+	} else {
+		spinlock_irqsave_lock(&list_lock);
+		ret = __chunk_put_pages(phyaddr, npages);
+		spinlock_irqsave_unlock(&list_lock);
+	}
 
-	while(curr) {
-		if (phyaddr+npages*PAGE_SIZE == curr->start) {
-			curr->start = phyaddr;
-			goto out;
-		} else if (phyaddr == curr->end) {
-			curr->end += npages*PAGE_SIZE;
-			goto out;
-		} if (phyaddr > curr->end) {
-			free_list_t* n = kmalloc(sizeof(free_list_t));
-
-			if (BUILTIN_EXPECT(!n, 0))
-				goto out_err;
-
-			/* add new element */
-			n->start = phyaddr;
-			n->end = phyaddr + npages * PAGE_SIZE;
-			n->prev = curr;
-			n->next = curr->next;
-			curr->next = n;
-		}
+	if (!ret) {
+		atomic_int64_sub(&total_allocated_pages, npages);
+		atomic_int64_add(&total_available_pages, npages);
+	}
 
-		curr = curr->next;
+	return ret;
+}
+
+/** @brief Map a large page_alloc() request by 1 GiB pages
+ *
+ * The virtual region is aligned to 1 GiB. The remainder, which doesn't
+ * fill a whole 1 GiB page, is mapped by 2 MiB and 4 KiB pages.
+ */
+static size_t page_alloc_1g(size_t npages, uint32_t flags, size_t pflags)
+{
+	const size_t size = npages << PAGE_BITS;
+	size_t viraddr, start, phyaddr, n;
+	int ret = 0;
+
+	// reserve an additional GiB to align the region
+	viraddr = vma_alloc(size + PAGE_1G_SIZE, flags);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return 0;
+
+	start = PAGE_1G_CEIL(viraddr);
+	if (start > viraddr)
+		vma_free(viraddr, start);
+	vma_free(start + size, viraddr + size + PAGE_1G_SIZE);
+
+	// blocks of the buddy allocator are aligned to their size
+	phyaddr = get_pages(npages);
+	if (BUILTIN_EXPECT(!phyaddr, 0)) {
+		vma_free(start, start + size);
+		return 0;
 	}
-out:
-	spinlock_irqsave_unlock(&list_lock);
 
-	atomic_int64_sub(&total_allocated_pages, npages);
-	atomic_int64_add(&total_available_pages, npages);
+	if (BUILTIN_EXPECT(phyaddr & (PAGE_1G_SIZE-1), 0)) {
+		ret = page_map(start, phyaddr, npages, pflags);
+	} else {
+		n = npages & ~(PAGE_1G_SIZE/PAGE_SIZE - 1);
+		ret = page_map(start, phyaddr, n, pflags|PG_PSE);
 
-	return 0;
+		if (!ret && (npages - n >= HUGE_PAGE_SIZE/PAGE_SIZE)) {
+			size_t m = (npages - n) & ~(HUGE_PAGE_SIZE/PAGE_SIZE - 1);
 
-out_err:
-	spinlock_irqsave_unlock(&list_lock);
+			ret = page_map(start + (n << PAGE_BITS), phyaddr + (n << PAGE_BITS), m, pflags|PG_PSE);
+			n += m;
+		}
+
+		if (!ret && (npages > n))
+			ret = page_map(start + (n << PAGE_BITS), phyaddr + (n << PAGE_BITS), npages - n, pflags);
+	}
+
+	if (BUILTIN_EXPECT(ret, 0)) {
+		page_unmap(start, npages);
+		vma_free(start, start + size);
+		put_pages(phyaddr, npages);
+		return 0;
+	}
 
-	return -ENOMEM;
+	return start;
 }
 
 void* page_alloc(size_t sz, uint32_t flags)
@@ -264,6 +963,14 @@ void* page_alloc(size_t sz, uint32_t flags)
 	if (BUILTIN_EXPECT(!npages, 0))
 		goto oom;
 
+	if (flags & VMA_WRITE)
+		pflags |= PG_RW;
+	if (!(flags & VMA_CACHEABLE))
+		pflags |= PG_PCD;
+
+	if (page_1g_enabled() && (npages >= PAGE_1G_SIZE/PAGE_SIZE))
+		return (void*) page_alloc_1g(npages, flags, pflags);
+
 	viraddr = vma_alloc(PAGE_CEIL(sz), flags);
 	if (BUILTIN_EXPECT(!viraddr, 0))
 		goto oom;
@@ -276,11 +983,6 @@ void* page_alloc(size_t sz, uint32_t flags)
 		goto oom;
 	}
 
-	if (flags & VMA_WRITE)
-		pflags |= PG_RW;
-	if (!(flags & VMA_CACHEABLE))
-		pflags |= PG_PCD;
-
 	int ret = page_map(viraddr, phyaddr, npages, pflags);
 	if (BUILTIN_EXPECT(ret, 0))
 	{
@@ -302,12 +1004,104 @@ void page_free(void* viraddr, size_t sz)
 
 	phyaddr = virt_to_phys((size_t)viraddr);
 
+	// remove the mapping before the pages are reused
+	page_unmap((size_t) viraddr, PAGE_CEIL(sz) >> PAGE_BITS);
 	vma_free((size_t) viraddr, (size_t) viraddr + PAGE_CEIL(sz));
 
 	if (phyaddr)
 		put_pages(phyaddr, PAGE_CEIL(sz) >> PAGE_BITS);
 }
 
+/** @brief Register a usable memory region beside the boot region */
+static void add_mem_region(size_t start, size_t end)
+{
+	if (BUILTIN_EXPECT(nr_mem_regions >= MAX_MEM_REGIONS, 0)) {
+		LOG_WARNING("Ignore region 0x%zx - 0x%zx\n", start, end);
+		return;
+	}
+
+	LOG_INFO("Add region 0x%zx - 0x%zx\n", start, end);
+
+	mem_regions[nr_mem_regions].start = start;
+	mem_regions[nr_mem_regions].end = end;
+	nr_mem_regions++;
+}
+
+/** @brief Allocate the meta data of all chunks and release the free memory to them */
+static int chunk_init(void)
+{
+	size_t phys_end = boot_end;
+	size_t nr, size, viraddr, phyaddr;
+	page_chunk_t* chunks;
+	int ret;
+
+	for(uint32_t i=0; i<nr_mem_regions; i++) {
+		if (mem_regions[i].end > phys_end)
+			phys_end = mem_regions[i].end;
+	}
+
+	nr = HUGE_PAGE_CEIL(phys_end) >> HUGE_PAGE_BITS;
+	size = PAGE_CEIL(nr * sizeof(page_chunk_t));
+
+	viraddr = vma_alloc(size, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return -ENOMEM;
+
+	phyaddr = get_pages(size >> PAGE_BITS);
+	if (BUILTIN_EXPECT(!phyaddr, 0)) {
+		vma_free(viraddr, viraddr+size);
+		return -ENOMEM;
+	}
+
+	ret = page_map(viraddr, phyaddr, size >> PAGE_BITS, PG_PRESENT|PG_GLOBAL|PG_RW|PG_XD);
+	if (BUILTIN_EXPECT(ret, 0)) {
+		vma_free(viraddr, viraddr+size);
+		return ret;
+	}
+
+	// initially, all pages are in use
+	chunks = (page_chunk_t*) viraddr;
+	for(size_t i=0; i<nr; i++) {
+		memset(chunks[i].bitmap, 0xFF, sizeof(chunks[i].bitmap));
+		chunks[i].next = chunks[i].prev = CHUNK_NONE;
+		chunks[i].nr_free = 0;
+		chunks[i].order = 0;
+		chunks[i].state = CHUNK_USED;
+		chunks[i].node = numa_mem_node(i << HUGE_PAGE_BITS);
+	}
+
+	// sort the nodes by their distance (insertion sort, only a few nodes)
+	nr_nodes = numa_nodes();
+	for(uint32_t n=0; n<nr_nodes; n++) {
+		for(uint32_t i=0; i<nr_nodes; i++) {
+			uint32_t j = i;
+
+			while ((j > 0) && (numa_distance(n, node_order[n][j-1]) > numa_distance(n, (i + n) % nr_nodes))) {
+				node_order[n][j] = node_order[n][j-1];
+				j--;
+			}
+			node_order[n][j] = (i + n) % nr_nodes;
+		}
+	}
+
+	spinlock_irqsave_lock(&list_lock);
+
+	page_chunks = chunks;
+	nr_chunks = nr;
+
+	for(uint32_t i=0; i<nr_mem_regions; i++)
+		__chunk_put_pages(mem_regions[i].start, (mem_regions[i].end - mem_regions[i].start) >> PAGE_BITS);
+	if (boot_start < boot_end)
+		__chunk_put_pages(boot_start, (boot_end - boot_start) >> PAGE_BITS);
+	boot_start = boot_end;
+
+	spinlock_irqsave_unlock(&list_lock);
+
+	LOG_INFO("Page allocator manages %zd chunks of %u nodes, meta data 0x%zx - 0x%zx\n", nr, nr_nodes, viraddr, viraddr+size);
+
+	return 0;
+}
+
 int memory_init(void)
 {
 	int ret = 0;
@@ -328,7 +1122,7 @@ int memory_init(void)
 			multiboot_memory_map_t* mmap = (multiboot_memory_map_t*) ((size_t) mb_info->mmap_addr);
 			multiboot_memory_map_t* mmap_end = (void*) ((size_t) mb_info->mmap_addr + mb_info->mmap_length);
 
-			// mark first available memory slot as free
+			// mark available memory as free
 			for(; mmap < mmap_end; mmap = (multiboot_memory_map_t*) ((size_t) mmap + sizeof(uint32_t) + mmap->size)) {
 				if (mmap->type == MULTIBOOT_MEMORY_AVAILABLE) {
 					start_addr = PAGE_CEIL(mmap->addr);
@@ -336,45 +1130,64 @@ int memory_init(void)
 
 					LOG_INFO("Free region 0x%zx - 0x%zx\n", start_addr, end_addr);
 
-					if ((start_addr <= base) && (end_addr >= PAGE_2M_FLOOR((size_t) &kernel_start + image_size))) {
-						init_list.start = PAGE_2M_CEIL((size_t) &kernel_start + image_size);
-						init_list.end = end_addr;
-
-						LOG_INFO("Add region 0x%zx - 0x%zx\n", init_list.start, init_list.end);
-					}
-
 					// determine available memory
 					atomic_int64_add(&total_pages, (end_addr-start_addr) >> PAGE_BITS);
 					atomic_int64_add(&total_available_pages, (end_addr-start_addr) >> PAGE_BITS);
+
+					// the memory behind the kernel is used as boot region
+					if ((start_addr <= base) && (end_addr >= PAGE_2M_CEIL((size_t) &kernel_start + image_size))) {
+						boot_start = PAGE_2M_CEIL((size_t) &kernel_start + image_size);
+						boot_end = end_addr;
+						end_addr = base;
+					}
+
+					// ignore everything below 1M => reserve for I/O devices
+					if ((start_addr < GAP_BELOW))
+						start_addr = GAP_BELOW;
+
+					if (start_addr < (size_t)mb_info)
+						start_addr = PAGE_CEIL((size_t)mb_info);
+
+					if ((mb_info->flags & MULTIBOOT_INFO_CMDLINE) && cmdline) {
+						if (start_addr < (size_t) cmdline+cmdsize)
+							start_addr = PAGE_CEIL((size_t) cmdline+cmdsize);
+					}
+
+					if (start_addr < end_addr)
+						add_mem_region(start_addr, end_addr);
 				}
 			}
 
-			if (!init_list.end)
+			if (!boot_end)
 				goto oom;
 		} else {
 			goto oom;
 		}
 	} else {
-		init_list.start = PAGE_2M_CEIL(base + image_size);
+		boot_start = PAGE_2M_CEIL(base + image_size);
 
 		if (limit < IO_GAP_START) {
 			atomic_int64_add(&total_pages, (limit-base) >> PAGE_BITS);
 			atomic_int64_add(&total_available_pages, (limit-base) >> PAGE_BITS);
 
-			init_list.end = limit;
+			boot_end = limit;
 		} else {
 			atomic_int64_add(&total_pages, (limit-base-IO_GAP_SIZE) >> PAGE_BITS);
 			atomic_int64_add(&total_available_pages, (limit-base-IO_GAP_SIZE) >> PAGE_BITS);
 
-			init_list.end = IO_GAP_START;
+			boot_end = IO_GAP_START;
 		}
+
+		// add region after the pci gap
+		if (limit > IO_GAP_START+IO_GAP_SIZE)
+			add_mem_region(IO_GAP_START+IO_GAP_SIZE, limit);
 	}
 
 	// determine allocated memory, we use 2MB pages to map the kernel
 	atomic_int64_add(&total_allocated_pages, PAGE_2M_CEIL(image_size) >> PAGE_BITS);
 	atomic_int64_sub(&total_available_pages, PAGE_2M_CEIL(image_size) >> PAGE_BITS);
 
-	LOG_INFO("free list starts at 0x%zx, limit 0x%zx\n", init_list.start, init_list.end);
+	LOG_INFO("boot region starts at 0x%zx, limit 0x%zx\n", boot_start, boot_end);
 
 	// init high bandwidth memory subsystem
 	hbmemory_init();
@@ -383,71 +1196,13 @@ int memory_init(void)
 	if (BUILTIN_EXPECT(ret, 0))
 		LOG_WARNING("Failed to initialize VMA regions: %d\n", ret);
 
-	// add missing free regions
-	if (mb_info) {
-		if (mb_info->flags & MULTIBOOT_INFO_MEM_MAP) {
-			free_list_t* last = &init_list;
-			size_t end_addr, start_addr;
-			multiboot_memory_map_t* mmap = (multiboot_memory_map_t*) ((size_t) mb_info->mmap_addr);
-			multiboot_memory_map_t* mmap_end = (void*) ((size_t) mb_info->mmap_addr + mb_info->mmap_length);
-
-			// mark available memory as free
-			for(; mmap < mmap_end; mmap = (multiboot_memory_map_t*) ((size_t) mmap + sizeof(uint32_t) + mmap->size))
-			{
-				if (mmap->type == MULTIBOOT_MEMORY_AVAILABLE) {
-					start_addr = PAGE_CEIL(mmap->addr);
-					end_addr = PAGE_FLOOR(mmap->addr + mmap->len);
-
-					if ((start_addr <= base) && (end_addr >= PAGE_2M_CEIL(base+image_size)))
-						end_addr = base;
-
-					// ignore everything below 1M => reserve for I/O devices
-					if ((start_addr < GAP_BELOW))
-						start_addr = GAP_BELOW;
+	// determine the nodes of the physical memory
+	acpi_numa_init();
 
-					if (start_addr < (size_t)mb_info)
-						start_addr = PAGE_CEIL((size_t)mb_info);
-
-					if ((mb_info->flags & MULTIBOOT_INFO_CMDLINE) && cmdline) {
-						if (start_addr < (size_t) cmdline+cmdsize)
-							start_addr = PAGE_CEIL((size_t) cmdline+cmdsize);
-					}
-
-					if (start_addr >= end_addr)
-						continue;
-
-					last->next = kmalloc(sizeof(free_list_t));
-					if (BUILTIN_EXPECT(!last->next, 0))
-						goto oom;
-
-					LOG_INFO("Add region 0x%zx - 0x%zx\n", start_addr, end_addr);
-
-					last->next->prev = last;
-					last = last->next;
-					last->next = NULL;
-					last->start = start_addr;
-					last->end = end_addr;
-				}
-			}
-		}
-	} else {
-		// add region after the pci gap
-		if (limit > IO_GAP_START+IO_GAP_SIZE) {
-			free_list_t* last = &init_list;
-
-			last->next = kmalloc(sizeof(free_list_t));
-			if (BUILTIN_EXPECT(!last->next, 0))
-				goto oom;
-
-			last->next->prev = last;
-			last = last->next;
-			last->next = NULL;
-			last->start = IO_GAP_START+IO_GAP_SIZE;
-			last->end = limit;
-
-			LOG_INFO("Add region 0x%zx - 0x%zx\n", last->start, last->end);
-		}
-	}
+	// switch from the boot region to the buddy system
+	ret = chunk_init();
+	if (BUILTIN_EXPECT(ret, 0))
+		goto oom;
 
 	// Ok, we are now able to use our memory management => update tss
 	tss_init(0);
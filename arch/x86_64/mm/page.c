@@ -41,6 +41,7 @@
 #include <hermit/spinlock.h>
 #include <hermit/tasks.h>
 #include <hermit/logging.h>
+#include <hermit/fmap.h>
 
 #include <asm/multiboot.h>
 #include <asm/irq.h>
@@ -64,10 +65,62 @@ static size_t* const self[PAGE_LEVELS] = {
 
 static uint8_t expect_zeroed_pages = 0;
 
-size_t virt_to_phys(size_t addr)
+/** @brief Cores, which may cache translations of a range (NULL => all cores)
+ *
+ * The heap and the task stacks are only touched by the cores, which ran
+ * a task. Everything else may be touched by interrupt handlers, too.
+ */
+static inline const cpumask_t* tlb_cpus(size_t start, size_t end)
 {
-	task_t* task = per_core(current_task);
+	if ((start >= HEAP_START) && (end <= HEAP_START+HEAP_SIZE))
+		return get_task_cpus();
+
+	return NULL;
+}
 
+/// Back the heap and large page_alloc() requests by 1 GiB pages
+static uint8_t use_1g_pages = 0;
+
+/// Maximal number of released heap pages, which wait for a TLB shootdown
+#define RELEASE_MAX	32
+
+/** Unmapped heap pages, which may be still cached by the TLB of another core.
+ * They are returned to the page allocator after all cores flushed. */
+static struct {
+	size_t phyaddr;
+	size_t npages;
+} release_pages[RELEASE_MAX];
+static uint32_t release_count = 0;
+
+/** @brief Find the entry, which maps viraddr
+ *
+ * The walk stops at a non-present entry, at a large page or at the
+ * last level.
+ *
+ * @param lvl Level of the returned entry (0 = 4 KiB, 1 = 2 MiB, 2 = 1 GiB)
+ */
+static size_t* page_walk(size_t viraddr, int* lvl)
+{
+	size_t vpn = viraddr >> PAGE_BITS;
+	size_t* entry;
+	int i;
+
+	for (i=PAGE_LEVELS-1; i>0; i--) {
+		entry = &self[i][vpn >> (i * PAGE_MAP_BITS)];
+		if (!(*entry & PG_PRESENT) || ((i < PAGE_LEVELS-1) && (*entry & PG_PSE)))
+			goto out;
+	}
+
+	entry = &self[0][vpn];
+
+out:
+	*lvl = i;
+
+	return entry;
+}
+
+size_t virt_to_phys(size_t addr)
+{
 	if ((addr > (size_t) &kernel_start) &&
 	    (addr <= PAGE_2M_CEIL((size_t) &kernel_start + image_size)))
 	{
@@ -76,19 +129,17 @@ size_t virt_to_phys(size_t addr)
 		size_t off   = addr  & ~PAGE_2M_MASK;	// offset within page
 		size_t phy   = entry &  PAGE_2M_MASK;	// physical page frame number
 
-		return phy | off;
-	} else if ((task->heap) && (addr >= task->heap->start) && (addr < task->heap->end)) {
-		size_t vpn   = addr >> (HUGE_PAGE_BITS); // virtual page number
-		size_t entry = (HUGE_PAGE_SIZE == PAGE_2M_SIZE) ? self[1][vpn] : self[2][vpn];	// page table entry
-		size_t off   = addr  & ~HUGE_PAGE_MASK;	// offset within page
-		size_t phy   = entry &  HUGE_PAGE_MASK;	// physical page frame number
-
 		return phy | off;
 	} else {
-		size_t vpn   = addr >> PAGE_BITS;	// virtual page number
-		size_t entry = self[0][vpn];		// page table entry
-		size_t off   = addr  & ~PAGE_MASK;	// offset within page
-		size_t phy   = entry &  PAGE_MASK;	// physical page frame number
+		// the heap and page_alloc() use 4 KiB, 2 MiB and 1 GiB pages
+		int lvl;
+		size_t entry = *page_walk(addr, &lvl);	// page table entry
+		size_t size  = 1UL << (PAGE_BITS + lvl * PAGE_MAP_BITS);
+		size_t off   = addr  & (size - 1);	// offset within page
+		size_t phy   = entry & PAGE_MASK & ~(size - 1);	// physical page frame number
+
+		if (!(entry & PG_PRESENT))
+			return 0;
 
 		return phy | off;
 	}
@@ -117,16 +168,29 @@ int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits, uint8
 	size_t page_bits = PAGE_BITS;
 	int32_t offset = 0;
 	int ret = -ENOMEM;
-	int8_t send_ipi = 0;
+	size_t flush_start = ~0ULL, flush_end = 0;
 
 	//kprintf("Map %d pages at 0x%zx (0x%zx)\n", npages, viraddr, phyaddr);
 
-	if ((HUGE_PAGE_SIZE != PAGE_SIZE) && !(viraddr & (HUGE_PAGE_SIZE-1))
+	// PG_PSE requests huge pages for a larger range
+	if ((bits & PG_PSE) && has_1gbhp() && (HUGE_PAGE_SIZE == PAGE_2M_SIZE)
+	   && !(viraddr & (PAGE_1G_SIZE-1)) && !(phyaddr & (PAGE_1G_SIZE-1))
+	   && npages && !(npages % (PAGE_1G_SIZE/PAGE_SIZE))) {
+		LOG_DEBUG("Map 1G page...\n");
+
+		npages /= PAGE_1G_SIZE/PAGE_SIZE;
+		bits &= ~PG_PSE;
+		page_size = PAGE_1G_SIZE;
+		page_bits = PAGE_1G_BITS;
+		offset = 2;
+	} else if ((HUGE_PAGE_SIZE != PAGE_SIZE) && !(viraddr & (HUGE_PAGE_SIZE-1))
 	   && !(phyaddr & (HUGE_PAGE_SIZE-1))
-	   && (npages == HUGE_PAGE_SIZE/PAGE_SIZE)) {
+	   && ((npages == HUGE_PAGE_SIZE/PAGE_SIZE)
+	       || ((bits & PG_PSE) && npages && !(npages % (HUGE_PAGE_SIZE/PAGE_SIZE))))) {
 		LOG_DEBUG("Map huge page...\n");
 
-		npages = 1;
+		npages /= HUGE_PAGE_SIZE/PAGE_SIZE;
+		bits &= ~PG_PSE;
 		page_size = HUGE_PAGE_SIZE;
 		page_bits = HUGE_PAGE_BITS;
 
@@ -168,7 +232,10 @@ int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits, uint8
 				/* do we have to flush the TLB? */
 				if (self[lvl][vpn] & PG_PRESENT) {
 					//kprintf("Remap address 0x%zx at core %d\n", viraddr, CORE_ID);
-					send_ipi = flush = 1;
+					flush = 1;
+					if ((vpn << page_bits) < flush_start)
+						flush_start = vpn << page_bits;
+					flush_end = (vpn << page_bits) + page_size;
 				}
 
 				self[lvl][vpn] = phyaddr | bits | PG_PRESENT | PG_ACCESSED | PG_DIRTY;
@@ -185,8 +252,8 @@ int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits, uint8
 		}
 	}
 
-	if (do_ipi && send_ipi)
-		ipi_tlb_flush();
+	if (do_ipi && (flush_start < flush_end))
+		ipi_tlb_flush_range(flush_start, flush_end, page_size, tlb_cpus(flush_start, flush_end));
 
 	ret = 0;
 out:
@@ -195,7 +262,26 @@ out:
 	return ret;
 }
 
-int page_unmap(size_t viraddr, size_t npages)
+void tlb_flush_range(size_t start, size_t end, size_t page_size)
+{
+	if (BUILTIN_EXPECT(start >= end, 0))
+		return;
+	if (BUILTIN_EXPECT(page_size < PAGE_SIZE, 0))
+		page_size = PAGE_SIZE;
+
+	// count the entries and not the 4 KiB pages of the range
+	if ((end - start) / page_size <= TLB_FLUSH_MAX_PAGES) {
+		for(size_t addr=start & ~(page_size-1); addr<end; addr+=page_size)
+			tlb_flush_one_page(addr, 0);
+	} else if ((start >= HEAP_START) && (end <= HEAP_START+HEAP_SIZE)) {
+		// the heap is mapped by non-global pages
+		tlb_flush_context();
+	} else {
+		tlb_flush_all();
+	}
+}
+
+int __page_unmap(size_t viraddr, size_t npages, const cpumask_t* mask)
 {
 	if (BUILTIN_EXPECT(!npages, 0))
 		return 0;
@@ -205,14 +291,29 @@ int page_unmap(size_t viraddr, size_t npages)
 	spinlock_irqsave_lock(&page_lock);
 
 	/* Start iterating through the entries.
-	 * Only the PGT entries are removed. Tables remain allocated. */
+	 * Only the leaf entries are removed. Tables remain allocated. */
 	size_t start = viraddr>>PAGE_BITS;
-	for (size_t vpn=viraddr>>PAGE_BITS; vpn<start+npages; vpn++) {
-		self[0][vpn] = 0;
-		tlb_flush_one_page(vpn << PAGE_BITS, 0);
+	size_t flush_size = 0;
+	for (size_t vpn=start; vpn<start+npages; ) {
+		int lvl;
+		size_t* entry = page_walk(vpn << PAGE_BITS, &lvl);
+
+		// the smallest mapped page determines the flush granularity
+		if ((*entry & PG_PRESENT) && (!flush_size || (1UL << (PAGE_BITS + lvl * PAGE_MAP_BITS)) < flush_size))
+			flush_size = 1UL << (PAGE_BITS + lvl * PAGE_MAP_BITS);
+
+		*entry = 0;
+		vpn = (vpn | ((1UL << (lvl * PAGE_MAP_BITS)) - 1)) + 1;
 	}
 
-	ipi_tlb_flush();
+	if (flush_size) {
+		tlb_flush_range(start << PAGE_BITS, (start+npages) << PAGE_BITS, flush_size);
+
+		// one shootdown for the whole range
+		if (!mask)
+			mask = tlb_cpus(start << PAGE_BITS, (start+npages) << PAGE_BITS);
+		ipi_tlb_flush_range(start << PAGE_BITS, (start+npages) << PAGE_BITS, flush_size, mask);
+	}
 
 	spinlock_irqsave_unlock(&page_lock);
 
@@ -220,6 +321,206 @@ int page_unmap(size_t viraddr, size_t npages)
 	return 0;
 }
 
+/** @brief Return the released heap pages, if no shootdown is in flight (page_lock held) */
+static void release_drain(void)
+{
+	if (!release_count || ipi_tlb_pending())
+		return;
+
+	while(release_count > 0) {
+		release_count--;
+		put_pages(release_pages[release_count].phyaddr, release_pages[release_count].npages);
+	}
+}
+
+/** @brief Shoot down the collected range and wait until all released pages are returned
+ *
+ * The page_lock is dropped while waiting, because the other cores may
+ * spin on it with disabled interrupts.
+ */
+static void release_wait(size_t* flush_start, size_t* flush_end)
+{
+	if (*flush_start < *flush_end)
+		ipi_tlb_flush_range(*flush_start, *flush_end, HUGE_PAGE_SIZE, get_task_cpus());
+	*flush_start = ~0ULL;
+	*flush_end = 0;
+
+	while(release_count) {
+		if (ipi_tlb_pending()) {
+			spinlock_irqsave_unlock(&page_lock);
+			PAUSE;
+			spinlock_irqsave_lock(&page_lock);
+		}
+
+		release_drain();
+	}
+}
+
+/** @brief Get 1 GiB of physically aligned memory for the heap
+ *
+ * Blocks of whole chunks are aligned to their buddy order. Therefore,
+ * 1 GiB of huge pages should start at a 1 GiB boundary.
+ *
+ * @return Physical address or 0, if the allocator has no aligned range
+ */
+static size_t get_heap_1g_page(void)
+{
+	const size_t n = PAGE_1G_SIZE / HUGE_PAGE_SIZE;
+	size_t phyaddr = expect_zeroed_pages ? get_zeroed_huge_pages(n) : get_huge_pages(n);
+
+	if (BUILTIN_EXPECT(phyaddr & (PAGE_1G_SIZE-1), 0)) {
+		put_pages(phyaddr, PAGE_1G_SIZE/PAGE_SIZE);
+		return 0;
+	}
+
+	return phyaddr;
+}
+
+ssize_t page_release(size_t start, size_t end)
+{
+	size_t viraddr, size, flush_start = ~0ULL, flush_end = 0;
+	size_t* entry;
+	ssize_t ret = 0;
+	int lvl;
+
+	start = HUGE_PAGE_CEIL(start);
+	end = HUGE_PAGE_FLOOR(end);
+	if (BUILTIN_EXPECT((start < HEAP_START) || (end > HEAP_START+HEAP_SIZE), 0))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&page_lock);
+
+	release_drain();
+
+	for (viraddr=start; viraddr < end; viraddr+=size) {
+		// no space for further pages => the whole range has to be released
+		if (release_count >= RELEASE_MAX) {
+			release_wait(&flush_start, &flush_end);
+			// the lock was dropped => check the entry again
+			size = 0;
+			continue;
+		}
+
+		entry = page_walk(viraddr, &lvl);
+		size = HUGE_PAGE_SIZE;
+		if (!lvl || !(*entry & PG_PRESENT))
+			continue;
+
+		// a 1 GiB page is only released as a whole
+		if (lvl == 2) {
+			size = PAGE_1G_SIZE - (viraddr & (PAGE_1G_SIZE-1));
+			if ((viraddr & (PAGE_1G_SIZE-1)) || (viraddr + PAGE_1G_SIZE > end))
+				continue;
+		}
+
+		release_pages[release_count].phyaddr = *entry & PAGE_MASK & ~(size-1);
+		release_pages[release_count].npages = size >> PAGE_BITS;
+		release_count++;
+		*entry = 0;
+		tlb_flush_one_page(viraddr, 0);
+
+		if (viraddr < flush_start)
+			flush_start = viraddr;
+		flush_end = viraddr + size;
+		ret += size >> HUGE_PAGE_BITS;
+	}
+
+	// one shootdown for all pages, the other cores flush their TLBs lazily
+	if (flush_start < flush_end)
+		ipi_tlb_flush_range(flush_start, flush_end, HUGE_PAGE_SIZE, get_task_cpus());
+
+	// single core => nothing to wait for
+	release_drain();
+
+	spinlock_irqsave_unlock(&page_lock);
+
+	LOG_DEBUG("page_release: %zd huge pages of 0x%zx - 0x%zx\n", ret, start, end);
+
+	return ret;
+}
+
+ssize_t page_populate(size_t start, size_t end)
+{
+	size_t viraddr, last, phyaddr, n;
+	size_t flags = PG_USER|PG_RW|PG_PSE;
+	size_t* entry;
+	ssize_t ret = 0;
+	int err, lvl;
+
+	start = HUGE_PAGE_FLOOR(start);
+	end = HUGE_PAGE_CEIL(end);
+	if (BUILTIN_EXPECT((start < HEAP_START) || (end > HEAP_START+HEAP_SIZE), 0))
+		return -EINVAL;
+
+	if (has_nx()) // set no execution flag to protect the heap
+		flags |= PG_XD;
+
+	spinlock_irqsave_lock(&page_lock);
+
+	for (viraddr=start; viraddr < end; viraddr=last) {
+		// skip mapped pages
+		entry = page_walk(viraddr, &lvl);
+		if (!lvl || (*entry & PG_PRESENT)) {
+			last = (lvl == 2) ? PAGE_1G_FLOOR(viraddr) + PAGE_1G_SIZE : viraddr + HUGE_PAGE_SIZE;
+			continue;
+		}
+
+		// search the end of the unmapped range
+		for (last=viraddr+HUGE_PAGE_SIZE; last < end; last+=HUGE_PAGE_SIZE) {
+			// 1 GiB pages are placed per GiB
+			if (use_1g_pages && !(last & (PAGE_1G_SIZE-1)))
+				break;
+
+			entry = page_walk(last, &lvl);
+			if (!lvl || (*entry & PG_PRESENT))
+				break;
+		}
+
+		// cover a whole unmapped GiB by a single page
+		if (use_1g_pages && !(viraddr & (PAGE_1G_SIZE-1)) && (last - viraddr == PAGE_1G_SIZE)) {
+			phyaddr = get_heap_1g_page();
+			if (phyaddr) {
+				err = __page_map(viraddr, phyaddr, PAGE_1G_SIZE/PAGE_SIZE, flags, 0);
+				if (BUILTIN_EXPECT(!err, 1)) {
+					ret += PAGE_1G_SIZE/HUGE_PAGE_SIZE;
+					continue;
+				}
+
+				put_pages(phyaddr, PAGE_1G_SIZE/PAGE_SIZE);
+			}
+		}
+
+		// use the largest physically continuous block
+		phyaddr = 0;
+		for (n=(last-viraddr) >> HUGE_PAGE_BITS; n > 0; n >>= 1) {
+			phyaddr = expect_zeroed_pages ? get_zeroed_huge_pages(n) : get_huge_pages(n);
+			if (phyaddr)
+				break;
+		}
+		if (BUILTIN_EXPECT(!phyaddr, 0)) {
+			ret = ret ? ret : -ENOMEM;
+			break;
+		}
+
+		// one call maps the block and creates all page tables
+		err = __page_map(viraddr, phyaddr, n*(HUGE_PAGE_SIZE/PAGE_SIZE), flags, 0);
+		if (BUILTIN_EXPECT(err, 0)) {
+			put_pages(phyaddr, n*(HUGE_PAGE_SIZE/PAGE_SIZE));
+			ret = ret ? ret : err;
+			break;
+		}
+
+		last = viraddr + n*HUGE_PAGE_SIZE;
+		ret += n;
+	}
+
+	spinlock_irqsave_unlock(&page_lock);
+
+	LOG_DEBUG("page_populate: %zd huge pages of 0x%zx - 0x%zx\n", ret, start, end);
+
+	return ret;
+}
+
 void page_fault_handler(struct state *s)
 {
 	size_t viraddr = read_cr2();
@@ -228,23 +529,37 @@ void page_fault_handler(struct state *s)
 	int check_pagetables(size_t vaddr)
 	{
 		int lvl;
-		int start = (HUGE_PAGE_SIZE == PAGE_2M_SIZE) ? 1 : 2;
-		ssize_t vpn = vaddr >> PAGE_BITS;
-		ssize_t index[PAGE_LEVELS];
-
-		/* Calculate index boundaries for page map traversal */
-		for (lvl=start; lvl<PAGE_LEVELS; lvl++)
-			index[lvl] = vpn >> (lvl * PAGE_MAP_BITS);
+		size_t* entry = page_walk(vaddr, &lvl);
 
 		/* do we have already a valid entry in the page tables */
-		for (lvl=PAGE_LEVELS-1; lvl>=start; lvl--) {
-			vpn = index[lvl];
+		return (*entry & PG_PRESENT) ? 1 : 0;
+	}
+
+	// is a whole GiB around vaddr part of the heap and still unmapped?
+	int check_1g_slot(size_t vaddr)
+	{
+		size_t start = PAGE_1G_FLOOR(vaddr);
+		int lvl;
+
+		if ((start < HEAP_START) || (start + PAGE_1G_SIZE > HEAP_START+HEAP_SIZE))
+			return 0;
+
+		// no 2 MiB or 4 KiB page tables below this GiB
+		page_walk(start, &lvl);
+
+		return (lvl >= 2) ? 1 : 0;
+	}
 
-			if (!(self[lvl][vpn] & PG_PRESENT))
-				return 0;
+	// mapped files are read from the host without holding the page_lock
+	if (fmap_contains(viraddr)) {
+		if (BUILTIN_EXPECT(!fmap_fault(viraddr), 1)) {
+			// clear cr2 to signalize that the pagefault is solved by the pagefault handler
+			write_cr2(0);
+			return;
 		}
 
-		return 1;
+		spinlock_irqsave_lock(&page_lock);
+		goto default_handler;
 	}
 
 	spinlock_irqsave_lock(&page_lock);
@@ -258,11 +573,34 @@ void page_fault_handler(struct state *s)
 		 * do we have a valid page table entry? => flush TLB and return
 		 */
 		if (check_pagetables(viraddr)) {
-			//tlb_flush_one_page(viraddr, 0);
+			tlb_flush_one_page(viraddr, 0);
 			spinlock_irqsave_unlock(&page_lock);
 			return;
 		}
 
+		// reuse released pages, which are no longer cached by a TLB
+		release_drain();
+
+		flags = PG_USER|PG_RW;
+		if (has_nx()) // set no execution flag to protect the heap
+			flags |= PG_XD;
+
+		// try to map the whole GiB by one page, otherwise use a huge page
+		if (use_1g_pages && check_1g_slot(viraddr)) {
+			size_t phyaddr = get_heap_1g_page();
+
+			if (phyaddr) {
+				ret = __page_map(PAGE_1G_FLOOR(viraddr), phyaddr, PAGE_1G_SIZE/PAGE_SIZE, flags|PG_PSE, 0);
+				if (BUILTIN_EXPECT(!ret, 1)) {
+					spinlock_irqsave_unlock(&page_lock);
+					write_cr2(0);
+					return;
+				}
+
+				put_pages(phyaddr, PAGE_1G_SIZE/PAGE_SIZE);
+			}
+		}
+
 		 // on demand userspace heap mapping
 		viraddr &= HUGE_PAGE_MASK;
 
@@ -272,14 +610,53 @@ void page_fault_handler(struct state *s)
 			goto default_handler;
 		}
 
+		ret = __page_map(viraddr, phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE, flags, 0);
+
+		if (BUILTIN_EXPECT(ret, 0)) {
+			LOG_ERROR("map_region: could not map %#lx to %#lx, task = %u\n", phyaddr, viraddr, task->id);
+			put_pages(phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE);
+
+			goto default_handler;
+		}
+
+		spinlock_irqsave_unlock(&page_lock);
+
+		// clear cr2 to signalize that the pagefault is solved by the pagefault handler
+		write_cr2(0);
+
+		return;
+	}
+
+	// on demand mapping of the hbw heap, the policy selects the memory
+	if (hbw_contains(viraddr)) {
+		size_t flags, phyaddr;
+		int ret;
+
+		if (check_pagetables(viraddr)) {
+			tlb_flush_one_page(viraddr, 0);
+			spinlock_irqsave_unlock(&page_lock);
+			return;
+		}
+
 		flags = PG_USER|PG_RW;
-		if (has_nx()) // set no execution flag to protect the heap
+		if (has_nx())
 			flags |= PG_XD;
-		ret = __page_map(viraddr, phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE, flags, 0);
 
+		viraddr &= HUGE_PAGE_MASK;
+
+		phyaddr = hbw_get_huge_page(viraddr);
+		if (BUILTIN_EXPECT(!phyaddr, 0)) {
+			LOG_ERROR("out of hbw memory: task = %u\n", task->id);
+			goto default_handler;
+		}
+
+		ret = __page_map(viraddr, phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE, flags, 0);
 		if (BUILTIN_EXPECT(ret, 0)) {
 			LOG_ERROR("map_region: could not map %#lx to %#lx, task = %u\n", phyaddr, viraddr, task->id);
-			put_page(phyaddr);
+			if ((phyaddr >= get_hbmem_base()) && (phyaddr < get_hbmem_base() + get_hbmem_size()))
+				hbmem_put_pages(phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE);
+			else
+				put_pages(phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE);
 
 			goto default_handler;
 		}
@@ -315,6 +692,23 @@ default_handler:
 	sys_exit(-EFAULT);
 }
 
+int page_enable_1g(uint8_t enable)
+{
+	if (enable && !has_1gbhp())
+		return -EOPNOTSUPP;
+
+	use_1g_pages = enable ? 1 : 0;
+
+	LOG_INFO("%s 1 GiB pages for the heap\n", use_1g_pages ? "Enable" : "Disable");
+
+	return 0;
+}
+
+int page_1g_enabled(void)
+{
+	return use_1g_pages;
+}
+
 // weak symbol is used to detect a Go application
 void __attribute__((weak)) runtime_osinit();
 
@@ -327,6 +721,10 @@ int page_init(void)
 		LOG_INFO("Detect Go runtime! Consequently, HermitCore zeroed heap.\n");
 	}
 
+#ifdef ZEROED_HEAP
+	expect_zeroed_pages = 1;
+#endif
+
 	if (mb_info && (mb_info->flags & MULTIBOOT_INFO_CMDLINE) && (cmdline))
 	{
 		size_t i = 0;
@@ -337,6 +735,9 @@ int page_init(void)
 				1, PG_NX|PG_GLOBAL|PG_RW|PG_PRESENT);
 			i += PAGE_SIZE;
 		}
+
+		if (strstr((char*) (size_t) cmdline, "-hugepage1g"))
+			page_enable_1g(1);
 	} else cmdline = 0;
 
 	/* Replace default pagefault handler */
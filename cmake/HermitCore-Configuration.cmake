@@ -7,6 +7,15 @@ set(MAX_CORES "512" CACHE STRING
 set(MAX_TASKS "((MAX_CORES * 2) + 2)" CACHE STRING
 	"Maximum number of tasks")
 
+set(TASK_SLOT_CACHE "8" CACHE STRING
+	"Number of finished tasks per core, which keep their stacks for reuse")
+
+set(STACK_CACHE "16" CACHE STRING
+	"High watermark of mapped stacks per core and stack size, which are kept for reuse")
+
+set(ZERO_POOL "4" CACHE STRING
+	"Number of pre-zeroed huge pages per core, which idle cores prepare for the heap (0 = disabled)")
+
 set(MAX_ISLE "8" CACHE STRING
 	"Maximum number of NUMA isles")
 
@@ -26,9 +35,22 @@ set(MAX_ARGC_ENVC 128 CACHE STRING
 option(DYNAMIC_TICKS
 	"Don't use a periodic timer event to keep track of time" ON)
 
+option(ZEROED_HEAP
+	"Map only zeroed pages into the heap (always enabled for Go applications)" OFF)
+
 option(SAVE_FPU
 	"Save FPU registers on context switch" ON)
 
+option(WORK_STEALING
+	"Idle cores steal ready tasks from the readyqueue of the busiest core" ON)
+
+set(STEAL_THRESHOLD 2 CACHE STRING
+	"Minimum number of tasks on a core before idle cores steal from it")
+
+set(MIGRATION_COST 500 CACHE STRING
+	"Tasks, which got the CPU within the last MIGRATION_COST microseconds,
+	are cache hot and won't be migrated")
+
 set(HAVE_ARCH_MEMSET "1" CACHE STRING
 	"Use machine specific version of memset")
 set(HAVE_ARCH_MEMCPY "1" CACHE STRING
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/cpumask.h
+ * @brief Sets of cores
+ */
+
+#ifndef __CPUMASK_H__
+#define __CPUMASK_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CPUMASK_WORDS	((MAX_CORES + 63) / 64)
+
+/** @brief Bitmap with one bit per core */
+typedef struct cpumask {
+	uint64_t bits[CPUMASK_WORDS];
+} cpumask_t;
+
+/** @brief Remove all cores from the mask */
+static inline void cpumask_clear(cpumask_t* mask)
+{
+	for(uint32_t i=0; i<CPUMASK_WORDS; i++)
+		mask->bits[i] = 0;
+}
+
+/** @brief Add a core to the mask */
+static inline void cpumask_set(cpumask_t* mask, uint32_t core_id)
+{
+	mask->bits[core_id / 64] |= 1ULL << (core_id % 64);
+}
+
+/** @brief Add a core to a mask, which is updated by several cores */
+static inline void cpumask_set_atomic(cpumask_t* mask, uint32_t core_id)
+{
+	__atomic_fetch_or(mask->bits + core_id / 64, 1ULL << (core_id % 64), __ATOMIC_SEQ_CST);
+}
+
+/** @brief Remove a core from the mask */
+static inline void cpumask_unset(cpumask_t* mask, uint32_t core_id)
+{
+	mask->bits[core_id / 64] &= ~(1ULL << (core_id % 64));
+}
+
+/** @brief Check if a core is part of the mask */
+static inline int cpumask_test(const cpumask_t* mask, uint32_t core_id)
+{
+	return (mask->bits[core_id / 64] >> (core_id % 64)) & 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/fmap.h
+ * @brief Memory mapped files, which are forwarded to the host
+ *
+ * A mapping reserves a virtual window, which is filled by blocks of
+ * HUGE_PAGE_SIZE bytes. With positional I/O of uhyve, the pages are
+ * read on the first access by the page fault handler and sequential
+ * faults read ahead. Otherwise, the whole file is read by sys_mmap().
+ * The pages are private copies, changes are never written back.
+ */
+
+#ifndef __FMAP_H__
+#define __FMAP_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Check if an address is part of a file mapping */
+int fmap_contains(size_t viraddr);
+
+/** @brief Fill the page of a file mapping at viraddr
+ *
+ * Called by the page fault handler. Doesn't reschedule.
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if viraddr isn't part of a file mapping
+ * - -ENOMEM (-12) if out of memory
+ * - -EFAULT (-14) if the page can't be read from the host
+ */
+int fmap_fault(size_t viraddr);
+
+/** @brief Read all missing pages of the file mappings in [start, end) */
+int fmap_populate(size_t start, size_t end);
+
+/** @brief Remove a whole file mapping and release its pages
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if [addr, addr+len) doesn't cover a whole mapping
+ */
+int fmap_unmap(size_t addr, size_t len);
+
+/** @brief Read the missing pages of all mappings of fd, before fd is closed */
+void fmap_close(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
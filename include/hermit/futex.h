@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/futex.h
+ * @brief Fast user-space mutex (futex) support
+ */
+
+#ifndef __FUTEX_H__
+#define __FUTEX_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Block the current task, if *addr still contains val
+ *
+ * @param addr Address of the futex word
+ * @param val Expected value of the futex word
+ * @param ms Timeout in milliseconds (0 = wait forever)
+ * @return
+ * - 0 on success (woken by futex_wake())
+ * - -EINVAL on an invalid address
+ * - -EAGAIN if *addr didn't contain val
+ * - -ETIME if the timeout expired
+ * - -EINTR if the task was woken by someone else
+ */
+int futex_wait(volatile int* addr, int val, unsigned int ms);
+
+/** @brief Wake up tasks, which are waiting on addr
+ *
+ * @param addr Address of the futex word
+ * @param n Maximum number of tasks to wake up
+ * @return
+ * - Number of woken tasks
+ * - -EINVAL on an invalid address
+ */
+int futex_wake(volatile int* addr, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
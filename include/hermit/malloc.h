@@ -46,34 +46,58 @@ extern "C" {
 /// Binary exponent of the size which we allocate with buddy_fill()
 #define BUDDY_ALLOC	16 // 64 KByte = 16 * PAGE_SIZE
 
+/// Binary exponent of the largest size, which is cached per core
+#define BUDDY_MAG_MAX	10 // 1 KByte
+/// Number of blocks per core and size class
+#define BUDDY_MAG_SIZE	32
+
 #define BUDDY_LISTS	(BUDDY_MAX-BUDDY_MIN+1)
+#define BUDDY_MAG_CLASSES	(BUDDY_MAG_MAX-BUDDY_MIN+1)
 #define BUDDY_MAGIC	0xBABE
-
-union buddy;
+#define BUDDY_FREE	0xF4EE
+/// blocks in a magazine aren't free for merges and can't be freed again
+#define BUDDY_CACHED	0xCAC4
 
 /** @brief Buddy
  *
- * Every free memory block is stored in a linked list according to its size.
- *  We can use this free memory to store this buddy_t union which represents
- *  this block (the buddy_t union is alligned to the front).
- *  Therefore the address of the buddy_t union is equal with the address
- *  of the underlying free memory block.
+ * Every memory block is prefixed with its binary size exponent, the
+ *  binary exponent of the memory chunk, which contains the block, and a
+ *  magic number. For allocated blocks, this prefix is hidden by the user
+ *  because its located before the actual memory address returned by kmalloc().
  *
- * Every allocated memory block is prefixed with its binary size exponent and
- *  a known magic number. This prefix is hidden by the user because its located
- *  before the actual memory address returned by kmalloc()
+ * A chunk is mapped by buddy_chunk() with vma_alloc() and get_pages() and
+ *  aligned to its size. Therefore the buddy of a block is found by flipping
+ *  the bit of its size in the address.
  */
 typedef union buddy {
-	/// Pointer to the next buddy in the linked list.
-	union buddy* next;
 	struct {
 		/// The binary exponent of the block size
 		uint8_t exponent;
-		/// Must be equal to BUDDY_MAGIC for a valid memory block
+		/// The binary exponent of the chunk size
+		uint8_t chunk;
+		/// BUDDY_MAGIC for an allocated block, BUDDY_FREE for a free one,
+		/// BUDDY_CACHED for a block in a magazine
 		uint16_t magic;
 	} prefix;
+	/// keeps the memory behind the prefix aligned
+	uint64_t align;
 } buddy_t;
 
+/** @brief Free buddy
+ *
+ * Every free memory block is stored in a doubly linked list according to
+ *  its size. We can use this free memory to store the list pointers behind
+ *  the prefix.
+ */
+typedef struct buddy_free {
+	/// prefix with magic BUDDY_FREE
+	buddy_t hdr;
+	/// Pointer to the next buddy in the linked list
+	struct buddy_free* next;
+	/// Pointer to the previous buddy in the linked list
+	struct buddy_free* prev;
+} buddy_free_t;
+
 /** @brief Dump free buddies */
 void buddy_dump(void);
 
@@ -39,9 +39,19 @@
 /** @brief Initialize the memory subsystem */
 int memory_init(void);
 
-/** @brief Request physical page frames */
+/** @brief Request physical page frames
+ *
+ * The pages are taken from the NUMA node of the current core,
+ * if it has enough free memory.
+ */
 size_t get_pages(size_t npages);
 
+/** @brief Request physical page frames of a NUMA node
+ *
+ * Falls back to the nearest node, if the node has not enough free memory.
+ */
+size_t get_pages_node(size_t npages, uint32_t node);
+
 /** @brief Get a single page
  *
  * Convenience function: uses get_pages(1);
@@ -51,12 +61,33 @@ static inline size_t get_page(void) { return get_pages(1); }
 /** @brief Get a single huge page */
 size_t get_huge_page(void);
 
+/** @brief Get n physically contiguous huge pages */
+size_t get_huge_pages(size_t n);
+
+/** @brief Get n physically contiguous and zeroed huge pages */
+size_t get_zeroed_huge_pages(size_t n);
+
 /** @brief Get a single zeroed page */
 size_t get_zeroed_page(void);
 
-/** @brief Get a single zeroed huge page */
+/** @brief Get a single zeroed huge page
+ *
+ * The page is taken from the zero pool of the current core, if available.
+ */
 size_t get_zeroed_huge_page(void);
 
+/** @brief Zero a huge page for the pool of the current core
+ *
+ * Called by the idle task. The pool is used after the first request of
+ * a zeroed huge page.
+ *
+ * @return 1 if a page was added to the pool, 0 otherwise
+ */
+int zero_pool_refill(void);
+
+/** @brief Print the statistics of the zero pools */
+void zero_pool_dump(void);
+
 /** @brief release physical page frames */
 int put_pages(size_t phyaddr, size_t npages);
 
@@ -69,6 +100,9 @@ static inline int put_page(size_t phyaddr) { return put_pages(phyaddr, 1); }
 /** @brief Request physical hbmem page frames */
 size_t hbmem_get_pages(size_t npages);
 
+/** @brief Get a single hbmem huge page, aligned to HUGE_PAGE_SIZE */
+size_t hbmem_get_huge_page(void);
+
 /** @brief Get a single hbmem page
  *
  * Convenience function: uses hbmem_get_pages(1);
@@ -90,4 +124,23 @@ int is_hbmem_available(void);
 /** @brief Initialize the high bandwidth memory subsystem */
 int hbmemory_init(void);
 
+/// hbw pages are taken only from the high bandwidth memory
+#define HBW_POLICY_BIND		1
+/// hbw pages are taken from the regular memory, if the high bandwidth memory is exhausted
+#define HBW_POLICY_PREFERRED	2
+/// hbw huge pages alternate between the high bandwidth and the regular memory
+#define HBW_POLICY_INTERLEAVE	3
+
+/** @brief Check if an address is part of the hbw heap */
+int hbw_contains(size_t viraddr);
+
+/** @brief Get a physical huge page for the hbw heap
+ *
+ * The memory is selected by the hbw policy.
+ *
+ * @param viraddr Virtual address of the page fault
+ * @return Physical address of the huge page or 0
+ */
+size_t hbw_get_huge_page(size_t viraddr);
+
 #endif
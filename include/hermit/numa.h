@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/numa.h
+ * @brief NUMA topology of cores and physical memory
+ *
+ * Without a detected topology, all cores and the whole memory
+ * belong to node 0.
+ */
+
+#ifndef __NUMA_H__
+#define __NUMA_H__
+
+#include <hermit/stddef.h>
+#include <hermit/cpumask.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Maximum number of NUMA nodes
+#define MAX_NUMA_NODES		MAX_ISLE
+/// No node preference
+#define NUMA_NO_NODE		(-1)
+/// Distance of a node to itself (ACPI SLIT)
+#define NUMA_LOCAL_DISTANCE	10
+/// Distance to a remote node, if the firmware doesn't provide a SLIT
+#define NUMA_REMOTE_DISTANCE	20
+
+/** @brief Number of detected NUMA nodes (at least 1) */
+uint32_t numa_nodes(void);
+
+/** @brief Node of a core */
+uint32_t numa_cpu_node(uint32_t core_id);
+
+/** @brief Node of a physical address */
+uint32_t numa_mem_node(size_t phyaddr);
+
+/** @brief Relative memory latency between two nodes
+ *
+ * @return NUMA_LOCAL_DISTANCE for the same node, larger values for
+ * remote nodes
+ */
+uint32_t numa_distance(uint32_t from, uint32_t to);
+
+/** @brief Determine all cores of a node
+ *
+ * @param node Node id
+ * @param mask Receives the cores of the node
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the node doesn't exist
+ */
+int numa_node_cpus(uint32_t node, cpumask_t* mask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
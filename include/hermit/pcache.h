@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/pcache.h
+ * @brief Read cache for files, which are forwarded to the host
+ *
+ * The cache is enabled by the command line option "-pcache <MiB>".
+ * It keeps blocks of HUGE_PAGE_SIZE bytes of files, which are opened
+ * read-only, and serves the reads of these files without a request to
+ * the proxy or uhyve. Writes by the guest invalidate the cached blocks
+ * of a file. Changes of the host are not detected.
+ */
+
+#ifndef __PCACHE_H__
+#define __PCACHE_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Statistics of the page cache */
+typedef struct pcache_stats {
+	/// block accesses, which are served by the cache
+	uint64_t hits;
+	/// block accesses, which are read from the host
+	uint64_t misses;
+	/// blocks, which are read ahead of a sequential access
+	uint64_t readahead;
+	/// blocks, which are replaced by other blocks
+	uint64_t evictions;
+	/// blocks, which are dropped after a write
+	uint64_t invalidations;
+	/// memory budget in bytes
+	size_t budget;
+	/// used memory in bytes
+	size_t used;
+} pcache_stats_t;
+
+/** @brief Initialize the page cache, if "-pcache" is set */
+int pcache_init(void);
+
+/** @brief Register an opened file descriptor
+ *
+ * Read-only descriptors of seekable files are served by the cache.
+ * Other read-only descriptors are not tracked. Writable descriptors
+ * invalidate the blocks of the file.
+ */
+void pcache_open(int fd, const char* name, int flags);
+
+/** @brief Unregister a file descriptor */
+void pcache_close(int fd);
+
+/** @brief Invalidate the cached blocks of the file of fd */
+void pcache_write(int fd);
+
+/** @brief Check if the reads of fd are served by the cache */
+int pcache_cached(int fd);
+
+/** @brief Read at the position of fd from the cache and advance the position */
+ssize_t pcache_read(int fd, char* buf, size_t len);
+
+/** @brief Read at offset from the cache */
+ssize_t pcache_pread(int fd, char* buf, size_t len, off_t offset);
+
+/** @brief Change the position of fd */
+off_t pcache_lseek(int fd, off_t offset, int whence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
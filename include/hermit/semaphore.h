@@ -58,20 +58,67 @@ extern "C" {
  */
 inline static int sem_init(sem_t* s, unsigned int v)
 {
-	unsigned int i;
-
 	if (BUILTIN_EXPECT(!s, 0))
 		return -EINVAL;
 
 	s->value = v;
-	s->rpos = s->wpos = 0;
-	for(i=0; i<MAX_TASKS; i++)
-		s->queue[i] = MAX_TASKS;
+	s->first = s->last = NULL;
 	spinlock_irqsave_init(&s->lock);
 
 	return 0;
 }
 
+/*
+ * Helper functions to maintain the wait queue,
+ * the caller holds the semaphore lock.
+ */
+inline static void sem_queue_push(sem_t* s, task_t* task)
+{
+	task->sem_next = NULL;
+	if (s->last)
+		s->last->sem_next = task;
+	else
+		s->first = task;
+	s->last = task;
+	task->sem_queued = 1;
+}
+
+inline static task_t* sem_queue_pop(sem_t* s)
+{
+	task_t* task = s->first;
+
+	if (task) {
+		s->first = task->sem_next;
+		if (!s->first)
+			s->last = NULL;
+		task->sem_next = NULL;
+		task->sem_queued = 0;
+	}
+
+	return task;
+}
+
+inline static void sem_queue_remove(sem_t* s, task_t* task)
+{
+	task_t* prev = NULL;
+	task_t* tmp;
+
+	for(tmp=s->first; tmp && (tmp != task); tmp=tmp->sem_next)
+		prev = tmp;
+
+	if (tmp) {
+		if (prev)
+			prev->sem_next = task->sem_next;
+		else
+			s->first = task->sem_next;
+		if (s->last == task)
+			s->last = prev;
+	}
+
+	task->sem_next = NULL;
+	task->sem_queued = 0;
+}
+
 /** @brief Destroy semaphore
  * @return
  * - 0 on success
@@ -134,35 +181,52 @@ next_try1:
 		spinlock_irqsave_lock(&s->lock);
 		if (s->value > 0) {
 			s->value--;
+			// woken by someone else => leave the wait queue
+			if (curr_task->sem_queued)
+				sem_queue_remove(s, curr_task);
 			spinlock_irqsave_unlock(&s->lock);
 		} else {
-			s->queue[s->wpos] = curr_task->id;
-			s->wpos = (s->wpos + 1) % MAX_TASKS;
+			if (!curr_task->sem_queued)
+				sem_queue_push(s, curr_task);
 			block_current_task();
 			spinlock_irqsave_unlock(&s->lock);
 			reschedule();
 			goto next_try1;
 		}
 	} else {
+#ifdef TIMER_CLOCK_TSC
+		// the timeout isn't rounded to the tick period
+		const uint8_t blocking = 1;
+		uint32_t remain = 0;
+		uint64_t deadline = get_timer_clock() + usecs_to_timer_clock(1000ULL * ms);
+#else
 		uint32_t ticks = (ms * TIMER_FREQ) / 1000;
 		uint32_t remain = (ms * TIMER_FREQ) % 1000;
+		uint64_t deadline = get_clock_tick() + ticks;
+		// timeouts below the tick period are only polled
+		const uint8_t blocking = (ticks > 0);
+#endif
 
-		if (ticks) {
-			uint64_t deadline = get_clock_tick() + ticks;
-
+		if (blocking) {
 next_try2:
 			spinlock_irqsave_lock(&s->lock);
 			if (s->value > 0) {
 				s->value--;
+				// woken by the timer => leave the wait queue
+				if (curr_task->sem_queued)
+					sem_queue_remove(s, curr_task);
 				spinlock_irqsave_unlock(&s->lock);
 				return 0;
 			} else {
-				if (get_clock_tick() >= deadline) {
+				if (get_timer_clock() >= deadline) {
+					// timer expired => leave the wait queue
+					if (curr_task->sem_queued)
+						sem_queue_remove(s, curr_task);
 					spinlock_irqsave_unlock(&s->lock);
 					goto timeout;
 				}
-				s->queue[s->wpos] = curr_task->id;
-				s->wpos = (s->wpos + 1) % MAX_TASKS;
+				if (!curr_task->sem_queued)
+					sem_queue_push(s, curr_task);
 				set_timer(deadline);
 				spinlock_irqsave_unlock(&s->lock);
 				reschedule();
@@ -192,17 +256,17 @@ timeout:
  */
 inline static int sem_post(sem_t* s)
 {
+	task_t* task;
+
 	if (BUILTIN_EXPECT(!s, 0))
 		return -EINVAL;
 
 	spinlock_irqsave_lock(&s->lock);
 
 	s->value++;
-	if (s->queue[s->rpos] < MAX_TASKS) {
-		wakeup_task(s->queue[s->rpos]);
-		s->queue[s->rpos] = MAX_TASKS;
-		s->rpos = (s->rpos + 1) % MAX_TASKS;
-	}
+	task = sem_queue_pop(s);
+	if (task)
+		wakeup_task(task->id);
 
 	spinlock_irqsave_unlock(&s->lock);
 
@@ -40,22 +40,22 @@
 extern "C" {
 #endif
 
+struct task;
+
 /** @brief Semaphore structure */
 typedef struct sem {
 	/// Resource available count
 	unsigned int value;
-	/// Queue of waiting tasks
-	tid_t queue[MAX_TASKS];
-	/// Position in queue to add a task
-	unsigned int wpos;
-	/// Position in queue to get a task
-	unsigned int rpos;
+	/// First waiting task (the queue is linked by task_t.sem_next)
+	struct task* first;
+	/// Last waiting task
+	struct task* last;
 	/// Access lock
 	spinlock_irqsave_t lock;
 } sem_t;
 
 /// Macro for initialization of semaphore
-#define SEM_INIT(v) {v, {[0 ... MAX_TASKS-1] = MAX_TASKS}, 0, SPINLOCK_IRQSAVE_INIT}
+#define SEM_INIT(v) {v, NULL, NULL, SPINLOCK_IRQSAVE_INIT}
 
 #ifdef __cplusplus
 }
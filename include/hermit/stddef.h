@@ -79,6 +79,18 @@ extern size_t image_size;
 #define UHYVE_PORT_CMDSIZE		0x740
 #define UHYVE_PORT_CMDVAL		0x780
 
+/* Ports of the shared syscall ring (see asm/uhyve.h) */
+#define UHYVE_PORT_RINGSETUP		0x7C0
+#define UHYVE_PORT_RINGNOTIFY		0x800
+
+/* Ports of the vectored I/O requests */
+#define UHYVE_PORT_READV		0x840
+#define UHYVE_PORT_WRITEV		0x880
+
+/* Ports of the positional I/O requests */
+#define UHYVE_PORT_PREAD		0x8C0
+#define UHYVE_PORT_PWRITE		0x900
+
 
 #define BUILTIN_EXPECT(exp, b)		__builtin_expect((exp), (b))
 //#define BUILTIN_EXPECT(exp, b)	(exp)
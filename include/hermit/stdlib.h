@@ -72,10 +72,17 @@ void* palloc(size_t sz, uint32_t flags);
 void* kmalloc(size_t sz);
 
 /** @brief Create a stack with guard pages
+ *
+ * User and kernel stacks are taken from the stack cache of the
+ * current core, if possible.
  */
 void* create_stack(size_t sz);
 
 /** @brief Destroy stack with its guard pages
+ *
+ * User and kernel stacks stay mapped in the stack cache of the current
+ * core, until STACK_CACHE stacks of the same size are cached. Otherwise,
+ * only the cores, which ran a task, are shot down.
  */
 int destroy_stack(void* addr, size_t sz);
 
@@ -87,9 +94,7 @@ int destroy_stack(void* addr, size_t sz);
  * of free buddies.
  *
  * Released memory will still be managed by the buddy system.
- * Pages are not unmapped.
- *
- * Note: adjacent buddies are currently not merged!
+ * Pages are not unmapped. Adjacent free buddies are merged.
  *
  * @see buddy_t
  * @param addr The address to the memory block allocated by kmalloc()
@@ -57,8 +57,28 @@ extern "C" {
 struct sem;
 typedef struct sem sem_t;
 
+struct pcache_stats;
+
 typedef void (*signal_handler_t)(int);
 
+/// advice values of sys_madvise() (Linux compatible)
+#define MADV_NORMAL		0
+#define MADV_RANDOM		1
+#define MADV_SEQUENTIAL		2
+#define MADV_WILLNEED		3
+#define MADV_DONTNEED		4
+
+/// protection and flags of sys_mmap() (Linux compatible)
+#ifndef PROT_READ
+#define PROT_READ		0x1
+#define PROT_WRITE		0x2
+#define PROT_EXEC		0x4
+#define MAP_SHARED		0x01
+#define MAP_PRIVATE		0x02
+#define MAP_FIXED		0x10
+#define MAP_ANONYMOUS		0x20
+#endif
+
 /*
  * HermitCore is a libOS.
  * => classical system calls are realized as normal function
@@ -74,6 +94,22 @@ void NORETURN sys_exit(int arg);
 ssize_t sys_read(int fd, char* buf, size_t len);
 ssize_t sys_write(int fd, const char* buf, size_t len);
 ssize_t sys_sbrk(ssize_t incr);
+void* sys_malloc(size_t size);
+void* sys_calloc(size_t nmemb, size_t size);
+void* sys_realloc(void* ptr, size_t size);
+void* sys_memalign(size_t align, size_t size);
+size_t sys_malloc_usable_size(void* ptr);
+void sys_free(void* ptr);
+void sys_malloc_stats(void);
+void* sys_hbw_malloc(size_t size);
+void* sys_hbw_calloc(size_t nmemb, size_t size);
+void* sys_hbw_realloc(void* ptr, size_t size);
+int sys_hbw_posix_memalign(void** memptr, size_t align, size_t size);
+size_t sys_hbw_usable_size(void* ptr);
+void sys_hbw_free(void* ptr);
+int sys_hbw_check_available(void);
+int sys_hbw_set_policy(int policy);
+int sys_hbw_get_policy(void);
 int sys_open(const char* name, int flags, int mode);
 int sys_close(int fd);
 void sys_msleep(unsigned int ms);
@@ -83,8 +119,25 @@ int sys_sem_wait(sem_t* sem);
 int sys_sem_post(sem_t* sem);
 int sys_sem_timedwait(sem_t *sem, unsigned int ms);
 int sys_sem_cancelablewait(sem_t* sem, unsigned int ms);
+int sys_futex_wait(int* addr, int val, unsigned int ms);
+int sys_futex_wake(int* addr, int n);
+int sys_madvise(void* addr, size_t len, int advice);
+int sys_mmap(void** addr, size_t len, int prot, int flags, int fd, off_t offset);
+int sys_munmap(void* addr, size_t len);
+ssize_t sys_heap_populate(size_t size);
+int sys_heap_pagesize(size_t size);
 int sys_clone(tid_t* id, void* ep, void* argv);
+int sys_clone_node(tid_t* id, void* ep, void* argv, int node);
+int sys_numa_node(void);
 off_t sys_lseek(int fd, off_t offset, int whence);
+ssize_t sys_pread(int fd, char* buf, size_t len, off_t offset);
+ssize_t sys_pwrite(int fd, const char* buf, size_t len, off_t offset);
+/* variants without the page cache, used by the page cache */
+off_t __sys_lseek(int fd, off_t offset, int whence);
+ssize_t __sys_pread(int fd, char* buf, size_t len, off_t offset);
+/* positional read by port I/O to uhyve, which doesn't reschedule */
+ssize_t __sys_pread_direct(int fd, char* buf, size_t len, off_t offset);
+int sys_pcache_stats(struct pcache_stats* stats);
 size_t sys_get_ticks(void);
 int sys_rcce_init(int session_id);
 size_t sys_rcce_malloc(int session_id, int ue);
@@ -131,6 +184,18 @@ int setcontext(ucontext_t *ucp);
 #define __NR_clone		27
 #define __NR_sem_cancelablewait	28
 #define __NR_get_ticks		29
+#define __NR_futex_wait		30
+#define __NR_futex_wake		31
+#define __NR_madvise		32
+#define __NR_munmap		33
+#define __NR_heap_populate	34
+#define __NR_heap_pagesize	35
+#define __NR_clone_node		36
+#define __NR_numa_node		37
+#define __NR_pread		38
+#define __NR_pwrite		39
+#define __NR_pcache_stats	40
+#define __NR_mmap		41
 
 #ifndef __KERNEL__
 inline static long
@@ -38,6 +38,7 @@
 
 #include <hermit/stddef.h>
 #include <hermit/tasks_types.h>
+#include <hermit/cpumask.h>
 #include <asm/tasks.h>
 
 #ifdef __cplusplus
@@ -79,13 +80,14 @@ int multitasking_init(void);
  * @param ep Pointer to the function the task shall start with
  * @param arg Arguments list
  * @param prio Desired priority of the new task
- * @param core_id Start the new task on the core with this id
+ * @param node Preferred NUMA node of the new task or NUMA_NO_NODE.
+ * If no core of the node is available, the task is started on another core.
  *
  * @return
  * - 0 on success
  * - -ENOMEM (-12) or -EINVAL (-22) on failure
  */
-int clone_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio);
+int clone_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio, int32_t node);
 
 
 /** @brief Create a task with a specific entry point
@@ -197,6 +199,16 @@ void wait_for_task(void);
  */
 void* get_readyqueue(void);
 
+/** @brief Get the cores, which ran other tasks than their idle task
+ *
+ * Only these cores may cache translations of the heap and of the task
+ * stacks. The mask only grows.
+ *
+ * @return
+ *  - address of the mask
+ */
+const cpumask_t* get_task_cpus(void);
+
 /** @brief Get a process control block
  *
  * @param id	ID of the task to retrieve
@@ -212,7 +224,7 @@ int get_task(tid_t id, task_t** task);
 
 /** @brief Block current task until timer expires
  *
- * @param deadline Clock tick, when the timer expires
+ * @param deadline Time (see get_timer_clock()), when the timer expires
  * @return
  *  - 0 on success
  *  - -EINVAL (-22) on failure
@@ -239,6 +251,20 @@ void check_scheduling(void);
 /** @brief return true if a task is available and ready. */
 int is_task_available(void);
 
+/** @brief Steal a ready task from the busiest core
+ *
+ * Called by an idle core. Tasks, which are cache hot or whose FPU
+ * state is still loaded on the other core, won't be migrated.
+ *
+ * @return
+ * - 1 if a task was moved to the readyqueue of the current core
+ * - 0 if no task was found
+ */
+int steal_task(void);
+
+/** @brief Print the scheduler statistics (work stealing, timers) of all cores */
+void print_sched_stats(void);
+
 /** @brief This function shutdowns the (ip) network */
 int network_shutdown(void);
 
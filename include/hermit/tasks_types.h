@@ -87,6 +87,10 @@ typedef struct task {
 	uint8_t			flags;
 	/// Task priority
 	uint8_t			prio;
+	/// task is enqueued in the wait queue of a semaphore (protected by the semaphore lock)
+	uint8_t			sem_queued;
+	/// task runs on a core or its context isn't saved yet (protected by the readyqueue lock)
+	uint8_t			on_cpu;
 	/// timeout for a blocked task
 	uint64_t		timeout;
 	/// starting time/tick of the task
@@ -101,6 +105,10 @@ typedef struct task {
 	struct task*	next;
 	/// previous task in the queue
 	struct task*	prev;
+	/// first child in the timer heap
+	struct task*	child;
+	/// next task in the wait queue of a semaphore
+	struct task*	sem_next;
 	/// TLS address
 	size_t		tls_addr;
 	/// TLS file size
@@ -130,12 +138,30 @@ typedef struct {
 	uint32_t	nr_tasks;
 	/// indicates the used priority queues
 	uint32_t	prio_bitmap;
+	/// set by other cores to trigger work stealing on this (idle) core
+	uint32_t	kick;
 	/// a queue for each priority
 	task_list_t	queue[MAX_PRIO];
-	/// a queue for timers
-	task_list_t     timers;
+	/// pairing heap of blocked tasks with a timeout (root = next deadline)
+	task_t*		timers;
+	/// number of tasks, which this core has stolen from other cores
+	uint64_t	nr_steals;
+	/// number of tasks, which other cores have stolen from this core
+	uint64_t	nr_stolen;
+	/// number of tasks inserted into the timer heap
+	uint64_t	nr_timer_inserts;
+	/// number of expired timers
+	uint64_t	nr_timer_expires;
+	/// number of timer reprogramming events
+	uint64_t	nr_timer_reprograms;
+	/// finished tasks, which are ready for reuse (linked by next)
+	task_t*		free_tasks;
+	/// number of tasks in free_tasks
+	uint32_t	nr_free_tasks;
 	/// lock for this runqueue
 	spinlock_irqsave_t lock;
+	/// task, which left the core by the current switch (cleared by finish_task_switch)
+	task_t*		prev_task;
 } readyqueues_t;
 
 
@@ -34,6 +34,7 @@
 #ifndef __TIME_H__
 #define __TIME_H__
 
+#include <hermit/processor.h>
 #include <asm/time.h>
 
 #ifdef __cplusplus
@@ -76,6 +77,40 @@ static inline uint64_t get_clock_tick(void)
 	return per_core(timer_ticks);
 }
 
+/** @brief Returns the current time in the unit of task timeouts
+ *
+ * Task timeouts (see set_timer()) are absolute TSC values, if
+ * the architecture defines TIMER_CLOCK_TSC. Otherwise, they are ticks.
+ */
+static inline uint64_t get_timer_clock(void)
+{
+#ifdef TIMER_CLOCK_TSC
+	return get_rdtsc();
+#else
+	return get_clock_tick();
+#endif
+}
+
+/** @brief Convert microseconds into the unit of task timeouts */
+static inline uint64_t usecs_to_timer_clock(uint64_t usecs)
+{
+#ifdef TIMER_CLOCK_TSC
+	return usecs * (uint64_t) get_cpu_frequency();
+#else
+	return (usecs * TIMER_FREQ) / 1000000ULL;
+#endif
+}
+
+/** @brief Convert ticks into the unit of task timeouts */
+static inline uint64_t ticks_to_timer_clock(uint64_t ticks)
+{
+#ifdef TIMER_CLOCK_TSC
+	return (ticks * 1000000ULL * (uint64_t) get_cpu_frequency()) / TIMER_FREQ;
+#else
+	return ticks;
+#endif
+}
+
 /** @brief sleep some seconds
  *
  * This function sleeps some seconds
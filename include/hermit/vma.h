@@ -55,6 +55,8 @@ extern "C" {
 #define VMA_NO_ACCESS	(1 << 4)
 /// This VMA should be part of the userspace
 #define VMA_USER	(1 << 5)
+/// This VMA maps a file
+#define VMA_FILE	(1 << 6)
 /// A collection of flags used for the kernel heap (kmalloc)
 #define VMA_HEAP	(VMA_READ|VMA_WRITE|VMA_CACHEABLE)
 
@@ -68,8 +70,10 @@ struct vma;
 
 /** @brief VMA structure definition
  *
- * Each item in this linked list marks a used part of the virtual address space.
- * Its used by vm_alloc() to find holes between them.
+ * Each item marks a used part of the virtual address space. The items are
+ * sorted by their start address in a linked list and in a red-black tree.
+ * Each tree node knows the largest hole in its subtree, which is used by
+ * vma_alloc() to find a hole in O(log n).
  */
 typedef struct vma {
 	/// Start address of the memory area
@@ -82,6 +86,16 @@ typedef struct vma {
 	struct vma* next;
 	/// Pointer to previous VMA element in the list
 	struct vma* prev;
+	/// Parent node in the VMA tree
+	struct vma* parent;
+	/// Left child in the VMA tree
+	struct vma* left;
+	/// Right child in the VMA tree
+	struct vma* right;
+	/// Largest hole in front of a VMA of this subtree
+	size_t max_gap;
+	/// Color of the tree node
+	uint8_t color;
 } vma_t;
 
 /** @brief Initalize the kernelspace VMA list
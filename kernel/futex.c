@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/futex.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/time.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+
+/*
+ * The wait queues are hashed by the address of the futex word. A
+ * waiter lives on the stack of the blocked task.
+ */
+#define FUTEX_HASH_SIZE		256
+
+typedef struct futex_waiter {
+	/// address of the futex word
+	volatile int* addr;
+	/// id of the waiting task
+	tid_t id;
+	/// set by futex_wake()
+	int woken;
+	/// next waiter in the bucket
+	struct futex_waiter* next;
+	/// previous waiter in the bucket
+	struct futex_waiter* prev;
+} futex_waiter_t;
+
+typedef struct futex_bucket {
+	/// first waiter
+	futex_waiter_t* first;
+	/// last waiter
+	futex_waiter_t* last;
+	/// access lock
+	spinlock_irqsave_t lock;
+} __attribute__ ((aligned (CACHE_LINE))) futex_bucket_t;
+
+static futex_bucket_t futex_queues[FUTEX_HASH_SIZE] = { \
+	[0 ... FUTEX_HASH_SIZE-1] = {NULL, NULL, SPINLOCK_IRQSAVE_INIT}};
+
+static inline futex_bucket_t* futex_hash(volatile int* addr)
+{
+	size_t key = (size_t) addr >> 2;
+
+	key ^= key >> 8;
+	key ^= key >> 16;
+
+	return &futex_queues[key % FUTEX_HASH_SIZE];
+}
+
+static inline void futex_remove(futex_bucket_t* bucket, futex_waiter_t* waiter)
+{
+	if (waiter->prev)
+		waiter->prev->next = waiter->next;
+	else
+		bucket->first = waiter->next;
+
+	if (waiter->next)
+		waiter->next->prev = waiter->prev;
+	else
+		bucket->last = waiter->prev;
+
+	waiter->next = waiter->prev = NULL;
+}
+
+int futex_wait(volatile int* addr, int val, unsigned int ms)
+{
+	futex_bucket_t* bucket;
+	futex_waiter_t waiter;
+	task_t* curr_task = per_core(current_task);
+	int ret = 0;
+
+	if (BUILTIN_EXPECT(!addr || ((size_t) addr & 0x3), 0))
+		return -EINVAL;
+
+	bucket = futex_hash(addr);
+
+	spinlock_irqsave_lock(&bucket->lock);
+
+	if (*addr != val) {
+		spinlock_irqsave_unlock(&bucket->lock);
+		return -EAGAIN;
+	}
+
+	waiter.addr = addr;
+	waiter.id = curr_task->id;
+	waiter.woken = 0;
+	waiter.next = NULL;
+	waiter.prev = bucket->last;
+	if (bucket->last)
+		bucket->last->next = &waiter;
+	else
+		bucket->first = &waiter;
+	bucket->last = &waiter;
+
+	if (ms)
+		set_timer(get_timer_clock() + usecs_to_timer_clock(1000ULL * ms));
+	else
+		block_current_task();
+
+	spinlock_irqsave_unlock(&bucket->lock);
+
+	reschedule();
+
+	spinlock_irqsave_lock(&bucket->lock);
+	// not woken by futex_wake() => timeout or signal
+	if (!waiter.woken) {
+		futex_remove(bucket, &waiter);
+		ret = ms ? -ETIME : -EINTR;
+	}
+	spinlock_irqsave_unlock(&bucket->lock);
+
+	return ret;
+}
+
+int futex_wake(volatile int* addr, int n)
+{
+	futex_bucket_t* bucket;
+	futex_waiter_t* waiter;
+	futex_waiter_t* next;
+	int count = 0;
+
+	if (BUILTIN_EXPECT(!addr || ((size_t) addr & 0x3), 0))
+		return -EINVAL;
+
+	bucket = futex_hash(addr);
+
+	spinlock_irqsave_lock(&bucket->lock);
+
+	for(waiter=bucket->first; waiter && (count < n); waiter=next) {
+		next = waiter->next;
+
+		if (waiter->addr != addr)
+			continue;
+
+		futex_remove(bucket, waiter);
+		waiter->woken = 1;
+		// the waiter leaves futex_wait() not before we release the lock
+		wakeup_task(waiter->id);
+		count++;
+	}
+
+	spinlock_irqsave_unlock(&bucket->lock);
+
+	return count;
+}
@@ -35,6 +35,7 @@
 #include <hermit/syscall.h>
 #include <hermit/memory.h>
 #include <hermit/logging.h>
+#include <hermit/pcache.h>
 #include <asm/irq.h>
 #include <asm/page.h>
 #include <asm/uart.h>
@@ -65,6 +66,8 @@
 
 #define HERMIT_PORT	0x494E
 #define HERMIT_MAGIC	0x7E317
+/// magic of a proxy, which announces its features after the magic
+#define HERMIT_MAGIC_FEATURES	0x7E318
 
 typedef struct {
 	int argc;
@@ -105,6 +108,7 @@ extern int32_t isle;
 extern int32_t possible_isles;
 extern uint32_t boot_processor;
 extern volatile int libc_sd;
+extern uint32_t proxy_features;
 extern uint8_t hcip[4];
 extern uint8_t hcgateway[4];
 extern uint8_t hcmask[4];
@@ -353,6 +357,25 @@ static int initd(void* arg)
 	vma_free(curr_task->heap->start, curr_task->heap->start+PAGE_SIZE);
 	vma_add(curr_task->heap->start, curr_task->heap->start+PAGE_SIZE, VMA_HEAP|VMA_USER);
 
+	// map the heap ahead of time to avoid page faults at runtime
+	if (get_cmdline()) {
+		char* found = strstr(get_cmdline(), "-prefault");
+
+		if (found) {
+			size_t size = (size_t) atoi(found+strlen("-prefault")) << 20;
+			ssize_t ret = sys_heap_populate(size);
+
+			if (ret < 0)
+				LOG_WARNING("Unable to prefault %zd MiB of the heap: %zd\n", size >> 20, ret);
+			else
+				LOG_INFO("Prefault %zd MiB of the heap\n", ret >> 20);
+		}
+	}
+
+	// read cache for the files of the host
+	if (pcache_init())
+		LOG_WARNING("Unable to initialize the page cache\n");
+
 #ifndef __aarch64__
 	// initialize network
 	err = init_netifs();
@@ -366,6 +389,10 @@ static int initd(void* arg)
 		uhyve_cmdval_t uhyve_cmdval;
 		uhyve_cmdval_t uhyve_cmdval_phys;
 
+		// batch the I/O requests of the application
+		if (uhyve_ring_init())
+			LOG_WARNING("Unable to initialize the uhyve syscall ring\n");
+
 		uhyve_send(UHYVE_PORT_CMDSIZE,
 				(unsigned)virt_to_phys((size_t)&uhyve_cmdsize));
 
@@ -471,7 +498,19 @@ static int initd(void* arg)
 
 	magic = 0;
 	lwip_read(c, &magic, sizeof(magic));
-	if (magic != HERMIT_MAGIC)
+	if (magic == HERMIT_MAGIC_FEATURES)
+	{
+		err = lwip_read(c, &proxy_features, sizeof(proxy_features));
+		if (err != sizeof(proxy_features))
+		{
+			LOG_ERROR("Unable to read the proxy features\n");
+			lwip_close(c);
+			return -1;
+		}
+
+		LOG_INFO("Proxy features 0x%x\n", proxy_features);
+	}
+	else if (magic != HERMIT_MAGIC)
 	{
 		LOG_ERROR("Invalid magic number %d\n", magic);
 		lwip_close(c);
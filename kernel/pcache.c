@@ -0,0 +1,569 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Read cache for files of the host (see include/hermit/pcache.h).
+ *
+ * The blocks live in a virtual window of the size of the budget. A
+ * block is backed by HUGE_PAGE_SIZE physically contiguous bytes, which
+ * are mapped on the first use and reused after an eviction. All blocks
+ * are kept in one LRU list. The semaphore pcache_sem serializes the
+ * accesses, because a miss waits for the host.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/errno.h>
+#include <hermit/memory.h>
+#include <hermit/vma.h>
+#include <hermit/semaphore.h>
+#include <hermit/syscall.h>
+#include <hermit/logging.h>
+#include <hermit/pcache.h>
+#include <asm/page.h>
+
+#define PCACHE_BLOCK_SIZE	HUGE_PAGE_SIZE
+/// Highest file descriptor, which is tracked by the cache
+#define PCACHE_MAX_FDS		256
+/// Maximum read-ahead in blocks
+#define PCACHE_MAX_RA		4
+
+#ifndef O_ACCMODE
+#define O_ACCMODE		3
+#define O_RDONLY		0
+#endif
+
+#ifndef SEEK_SET
+#define SEEK_SET		0
+#define SEEK_CUR		1
+#define SEEK_END		2
+#endif
+
+struct pcache_block;
+
+typedef struct pcache_file {
+	/// path, which was used to open the file
+	char* name;
+	/// number of tracked file descriptors
+	uint32_t refs;
+	/// cached blocks of the file
+	struct pcache_block* blocks;
+	struct pcache_file* next;
+} pcache_file_t;
+
+typedef struct pcache_block {
+	/// owner of the block, NULL if free
+	pcache_file_t* file;
+	/// file offset of the block
+	off_t offset;
+	/// valid bytes, less than PCACHE_BLOCK_SIZE at the end of the file
+	size_t len;
+	char* data;
+	/// is the block already backed by physical memory?
+	uint8_t mapped;
+	/// next block of the file or next free block
+	struct pcache_block* next;
+	struct pcache_block* lru_prev;
+	struct pcache_block* lru_next;
+} pcache_block_t;
+
+typedef struct pcache_fd {
+	pcache_file_t* file;
+	/// read-only => served by the cache
+	uint8_t cached;
+	/// current position of a cached descriptor
+	off_t pos;
+	/// expected offset of the next sequential read
+	off_t next;
+	/// current read-ahead in blocks
+	uint32_t ra;
+} pcache_fd_t;
+
+static sem_t pcache_sem = SEM_INIT(1);
+static uint8_t pcache_enabled = 0;
+static pcache_block_t* pool = NULL;
+static uint32_t nr_blocks = 0;
+static pcache_block_t* free_blocks = NULL;
+/// most and least recently used blocks
+static pcache_block_t* lru_first = NULL;
+static pcache_block_t* lru_last = NULL;
+static pcache_file_t* files = NULL;
+static pcache_fd_t fds[PCACHE_MAX_FDS];
+static pcache_stats_t stats;
+
+static inline pcache_fd_t* get_fd(int fd)
+{
+	if (!pcache_enabled || (fd < 0) || (fd >= PCACHE_MAX_FDS))
+		return NULL;
+	if (!fds[fd].file)
+		return NULL;
+
+	return fds + fd;
+}
+
+static void lru_remove(pcache_block_t* b)
+{
+	if (b->lru_prev)
+		b->lru_prev->lru_next = b->lru_next;
+	else
+		lru_first = b->lru_next;
+	if (b->lru_next)
+		b->lru_next->lru_prev = b->lru_prev;
+	else
+		lru_last = b->lru_prev;
+
+	b->lru_prev = b->lru_next = NULL;
+}
+
+static void lru_push(pcache_block_t* b)
+{
+	b->lru_prev = NULL;
+	b->lru_next = lru_first;
+	if (lru_first)
+		lru_first->lru_prev = b;
+	else
+		lru_last = b;
+	lru_first = b;
+}
+
+/** @brief Remove a block from its file and the LRU list */
+static void block_release(pcache_block_t* b)
+{
+	pcache_block_t** prev = &b->file->blocks;
+
+	while(*prev != b)
+		prev = &(*prev)->next;
+	*prev = b->next;
+
+	lru_remove(b);
+
+	b->file = NULL;
+	b->next = free_blocks;
+	free_blocks = b;
+}
+
+static void file_invalidate(pcache_file_t* file)
+{
+	while(file->blocks) {
+		block_release(file->blocks);
+		stats.invalidations++;
+	}
+}
+
+static pcache_block_t* block_lookup(pcache_file_t* file, off_t offset)
+{
+	pcache_block_t* b;
+
+	for(b=file->blocks; b; b=b->next) {
+		if (b->offset == offset)
+			return b;
+	}
+
+	return NULL;
+}
+
+static inline size_t block_get_pages(void)
+{
+#ifdef __x86_64__
+	// aligned => mapped by a single page table entry
+	return get_huge_page();
+#else
+	return get_pages(PCACHE_BLOCK_SIZE >> PAGE_BITS);
+#endif
+}
+
+/** @brief Read a block from the host
+ *
+ * @return The new block or NULL, if the host returns an error
+ */
+static pcache_block_t* block_fill(int fd, pcache_file_t* file, off_t offset)
+{
+	pcache_block_t* b = free_blocks;
+	ssize_t ret;
+
+	if (b) {
+		free_blocks = b->next;
+	} else {
+		// replace the least recently used block
+		b = lru_last;
+		block_release(b);
+		free_blocks = b->next;
+		stats.evictions++;
+	}
+
+	if (!b->mapped) {
+		size_t phyaddr = block_get_pages();
+
+		if (BUILTIN_EXPECT(!phyaddr, 0))
+			goto fail;
+
+		if (BUILTIN_EXPECT(page_map((size_t) b->data, phyaddr, PCACHE_BLOCK_SIZE >> PAGE_BITS, PG_GLOBAL|PG_RW), 0)) {
+			put_pages(phyaddr, PCACHE_BLOCK_SIZE >> PAGE_BITS);
+			goto fail;
+		}
+
+		b->mapped = 1;
+		stats.used += PCACHE_BLOCK_SIZE;
+	}
+
+	ret = __sys_pread(fd, b->data, PCACHE_BLOCK_SIZE, offset);
+	if (BUILTIN_EXPECT(ret < 0, 0))
+		goto fail;
+
+	b->file = file;
+	b->offset = offset;
+	b->len = ret;
+	b->next = file->blocks;
+	file->blocks = b;
+	lru_push(b);
+
+	return b;
+
+fail:
+	b->next = free_blocks;
+	free_blocks = b;
+
+	return NULL;
+}
+
+static ssize_t __pcache_pread(int fd, pcache_fd_t* f, char* buf, size_t len, off_t offset)
+{
+	pcache_block_t* b = NULL;
+	off_t boff = 0;
+	size_t done = 0;
+	uint32_t i;
+
+	while(done < len) {
+		size_t in, n;
+
+		boff = (offset + done) & ~((off_t) PCACHE_BLOCK_SIZE - 1);
+		in = offset + done - boff;
+
+		b = block_lookup(f->file, boff);
+		if (b) {
+			lru_remove(b);
+			lru_push(b);
+			stats.hits++;
+		} else {
+			b = block_fill(fd, f->file, boff);
+			if (BUILTIN_EXPECT(!b, 0))
+				return done ? done : -EIO;
+			stats.misses++;
+		}
+
+		// end of file
+		if (in >= b->len)
+			break;
+
+		n = b->len - in;
+		if (n > len - done)
+			n = len - done;
+
+		memcpy(buf + done, b->data + in, n);
+		done += n;
+
+		if (b->len < PCACHE_BLOCK_SIZE)
+			break;
+	}
+
+	// detect sequential reads and increase the read-ahead
+	if (offset == f->next)
+		f->ra = f->ra ? ((2*f->ra > PCACHE_MAX_RA) ? PCACHE_MAX_RA : 2*f->ra) : 1;
+	else
+		f->ra = 0;
+	f->next = offset + done;
+
+	// read the following blocks, if the last block isn't at the end of the file
+	for(i=0; b && (b->len == PCACHE_BLOCK_SIZE) && (i<f->ra) && (i+1<nr_blocks); i++) {
+		boff += PCACHE_BLOCK_SIZE;
+
+		b = block_lookup(f->file, boff);
+		if (b)
+			continue;
+
+		b = block_fill(fd, f->file, boff);
+		if (b)
+			stats.readahead++;
+	}
+
+	return done;
+}
+
+ssize_t pcache_pread(int fd, char* buf, size_t len, off_t offset)
+{
+	pcache_fd_t* f = get_fd(fd);
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(!f || !f->cached, 0))
+		return -EBADF;
+	if (BUILTIN_EXPECT(offset < 0, 0))
+		return -EINVAL;
+
+	sem_wait(&pcache_sem, 0);
+	ret = __pcache_pread(fd, f, buf, len, offset);
+	sem_post(&pcache_sem);
+
+	return ret;
+}
+
+ssize_t pcache_read(int fd, char* buf, size_t len)
+{
+	pcache_fd_t* f = get_fd(fd);
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(!f || !f->cached, 0))
+		return -EBADF;
+
+	sem_wait(&pcache_sem, 0);
+	ret = __pcache_pread(fd, f, buf, len, f->pos);
+	if (ret > 0)
+		f->pos += ret;
+	sem_post(&pcache_sem);
+
+	return ret;
+}
+
+off_t pcache_lseek(int fd, off_t offset, int whence)
+{
+	pcache_fd_t* f = get_fd(fd);
+	off_t pos;
+
+	if (BUILTIN_EXPECT(!f || !f->cached, 0))
+		return -EBADF;
+
+	switch(whence) {
+	case SEEK_SET:
+		pos = offset;
+		break;
+	case SEEK_CUR:
+		pos = f->pos + offset;
+		break;
+	case SEEK_END:
+		// only the host knows the size of the file
+		pos = __sys_lseek(fd, offset, SEEK_END);
+		if (pos < 0)
+			return pos;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (BUILTIN_EXPECT(pos < 0, 0))
+		return -EINVAL;
+
+	f->pos = pos;
+
+	return pos;
+}
+
+int pcache_cached(int fd)
+{
+	pcache_fd_t* f = get_fd(fd);
+
+	return (f && f->cached) ? 1 : 0;
+}
+
+void pcache_write(int fd)
+{
+	pcache_fd_t* f = get_fd(fd);
+
+	if (!f || !f->file->blocks)
+		return;
+
+	sem_wait(&pcache_sem, 0);
+	file_invalidate(f->file);
+	sem_post(&pcache_sem);
+}
+
+/** @brief Is the descriptor a seekable file with a size on the host?
+ *
+ * Pipes, sockets and most special files don't support SEEK_END. The
+ * old offset is restored for the host.
+ */
+static int fd_seekable(int fd)
+{
+	off_t old = __sys_lseek(fd, 0, SEEK_CUR);
+
+	if (old < 0)
+		return 0;
+	if (__sys_lseek(fd, 0, SEEK_END) < 0)
+		return 0;
+
+	return (__sys_lseek(fd, old, SEEK_SET) == old) ? 1 : 0;
+}
+
+void pcache_open(int fd, const char* name, int flags)
+{
+	pcache_file_t* file;
+
+	if (!pcache_enabled || (fd < 0) || (fd >= PCACHE_MAX_FDS) || !name)
+		return;
+
+	// a stream can't be served from cached blocks
+	if (((flags & O_ACCMODE) == O_RDONLY) && !fd_seekable(fd))
+		return;
+
+	sem_wait(&pcache_sem, 0);
+
+	for(file=files; file; file=file->next) {
+		if (!strcmp(file->name, name))
+			break;
+	}
+
+	if (!file) {
+		file = kmalloc(sizeof(pcache_file_t));
+		if (BUILTIN_EXPECT(!file, 0))
+			goto out;
+
+		file->name = kmalloc(strlen(name)+1);
+		if (BUILTIN_EXPECT(!file->name, 0)) {
+			kfree(file);
+			goto out;
+		}
+
+		strcpy(file->name, name);
+		file->refs = 0;
+		file->blocks = NULL;
+		file->next = files;
+		files = file;
+	}
+
+	// the file may change => drop the cached blocks
+	if ((flags & O_ACCMODE) != O_RDONLY)
+		file_invalidate(file);
+
+	file->refs++;
+	fds[fd].file = file;
+	fds[fd].cached = ((flags & O_ACCMODE) == O_RDONLY) ? 1 : 0;
+	fds[fd].pos = 0;
+	fds[fd].next = 0;
+	fds[fd].ra = 0;
+
+out:
+	sem_post(&pcache_sem);
+}
+
+void pcache_close(int fd)
+{
+	pcache_fd_t* f = get_fd(fd);
+	pcache_file_t* file;
+
+	if (!f)
+		return;
+
+	sem_wait(&pcache_sem, 0);
+
+	file = f->file;
+
+	// the host may have changed the file by the writes of this descriptor
+	if (!f->cached)
+		file_invalidate(file);
+
+	f->file = NULL;
+	f->cached = 0;
+
+	// the blocks of read-only files remain in the cache for the next open
+	file->refs--;
+	if (!file->refs && !file->blocks) {
+		pcache_file_t** prev = &files;
+
+		while(*prev != file)
+			prev = &(*prev)->next;
+		*prev = file->next;
+
+		kfree(file->name);
+		kfree(file);
+	}
+
+	sem_post(&pcache_sem);
+}
+
+int sys_pcache_stats(pcache_stats_t* s)
+{
+	if (BUILTIN_EXPECT(!s, 0))
+		return -EINVAL;
+	if (!pcache_enabled)
+		return -ENODEV;
+
+	sem_wait(&pcache_sem, 0);
+	memcpy(s, &stats, sizeof(pcache_stats_t));
+	sem_post(&pcache_sem);
+
+	return 0;
+}
+
+int pcache_init(void)
+{
+	size_t budget, viraddr;
+	char* found;
+	uint32_t i;
+
+	if (!get_cmdline())
+		return 0;
+
+	found = strstr(get_cmdline(), "-pcache");
+	if (!found)
+		return 0;
+
+	budget = (size_t) atoi(found+strlen("-pcache")) << 20;
+	nr_blocks = budget / PCACHE_BLOCK_SIZE;
+	if (!nr_blocks) {
+		LOG_WARNING("pcache: the budget has to be at least %zd KiB\n", PCACHE_BLOCK_SIZE >> 10);
+		return -EINVAL;
+	}
+
+	pool = kmalloc(nr_blocks * sizeof(pcache_block_t));
+	if (BUILTIN_EXPECT(!pool, 0))
+		return -ENOMEM;
+
+	// the blocks are mapped on demand
+	viraddr = vma_alloc((nr_blocks + 1) * PCACHE_BLOCK_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!viraddr, 0)) {
+		kfree(pool);
+		return -ENOMEM;
+	}
+	viraddr = (viraddr + PCACHE_BLOCK_SIZE - 1) & ~(PCACHE_BLOCK_SIZE - 1);
+
+	memset(pool, 0x00, nr_blocks * sizeof(pcache_block_t));
+	for(i=0; i<nr_blocks; i++) {
+		pool[i].data = (char*) (viraddr + i * PCACHE_BLOCK_SIZE);
+		pool[i].next = (i+1 < nr_blocks) ? pool + i + 1 : NULL;
+	}
+	free_blocks = pool;
+
+	memset(fds, 0x00, sizeof(fds));
+	memset(&stats, 0x00, sizeof(stats));
+	stats.budget = nr_blocks * PCACHE_BLOCK_SIZE;
+
+	pcache_enabled = 1;
+
+	LOG_INFO("pcache: %zd MiB for %u blocks of %zd KiB\n", stats.budget >> 20, nr_blocks, PCACHE_BLOCK_SIZE >> 10);
+
+	return 0;
+}
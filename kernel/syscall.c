@@ -32,11 +32,15 @@
 #include <hermit/syscall.h>
 #include <hermit/spinlock.h>
 #include <hermit/semaphore.h>
+#include <hermit/futex.h>
 #include <hermit/time.h>
 #include <hermit/rcce.h>
 #include <hermit/memory.h>
 #include <hermit/signal.h>
 #include <hermit/logging.h>
+#include <hermit/numa.h>
+#include <hermit/pcache.h>
+#include <hermit/fmap.h>
 #include <asm/uhyve.h>
 #include <asm/io.h>
 #include <sys/poll.h>
@@ -51,8 +55,72 @@
  */
 extern const void kernel_start;
 
-//TODO: don't use one big kernel lock to comminicate with all proxies
-static spinlock_irqsave_t lwip_lock = SPINLOCK_IRQSAVE_INIT;
+/*
+ * The proxy handles the requests of the connection libc_sd one after
+ * another. proxy_sem serializes the requests of the threads. Waiting
+ * threads sleep instead of spinning and LwIP sockets of the
+ * application don't use the lock at all. Large transfers are split
+ * into chunks of PROXY_CHUNK_SIZE bytes, which releases the connection
+ * between the chunks. Consequently, a large read or write delays the
+ * requests of other threads (e.g. their output to stdout) only by the
+ * transfer time of one chunk.
+ */
+static sem_t proxy_sem = SEM_INIT(1);
+
+/// Maximum number of bytes, which are transferred by one proxy request
+#define PROXY_CHUNK_SIZE	(64*1024)
+#ifndef SEEK_SET
+#define SEEK_SET	0
+#define SEEK_CUR	1
+#endif
+
+/// Highest descriptor, whose seekability is tracked for chunked reads
+#define PROXY_MAX_FDS		256
+
+/*
+ * Seekable descriptors of the proxy, checked by open. Only their reads
+ * are split into several chunks. A stream (e.g. stdin, a pipe or a FIFO)
+ * would block on the next chunk, although data is already received.
+ */
+static uint8_t proxy_seekable[PROXY_MAX_FDS] = {[0 ... PROXY_MAX_FDS-1] = 0};
+
+static inline int proxy_chunked(int fd)
+{
+	return (fd > 2) && (fd < PROXY_MAX_FDS) && proxy_seekable[fd];
+}
+
+static inline void proxy_lock(void)
+{
+	sem_wait(&proxy_sem, 0);
+}
+
+static inline void proxy_unlock(void)
+{
+	sem_post(&proxy_sem);
+}
+
+/*
+ * Without UHYVE_FEATURE_PIO, pread and pwrite move the offset of the
+ * descriptor temporarily by lseek. pio_sem serializes them with the
+ * read, write and lseek requests of all other threads for the files.
+ */
+static sem_t pio_sem = SEM_INIT(1);
+
+static inline int pio_lock(int fd)
+{
+	if ((fd <= 2) || !is_uhyve() || uhyve_has_pio())
+		return 0;
+
+	sem_wait(&pio_sem, 0);
+
+	return 1;
+}
+
+static inline void pio_unlock(int locked)
+{
+	if (locked)
+		sem_post(&pio_sem);
+}
 
 extern spinlock_irqsave_t stdio_lock;
 extern int32_t isle;
@@ -125,7 +193,7 @@ void NORETURN sys_exit(int arg)
 	} else {
 		sys_exit_t sysargs = {__NR_exit, arg};
 
-		spinlock_irqsave_lock(&lwip_lock);
+		proxy_lock();
 		if (libc_sd >= 0)
 		{
 			int s = libc_sd;
@@ -133,14 +201,14 @@ void NORETURN sys_exit(int arg)
 			socket_send(s, &sysargs, sizeof(sysargs));
 			libc_sd = -1;
 
-			spinlock_irqsave_unlock(&lwip_lock);
+			proxy_unlock();
 
 			// switch to LwIP thread
 			reschedule();
 
 			lwip_close(s);
 		} else {
-			spinlock_irqsave_unlock(&lwip_lock);
+			proxy_unlock();
 		}
 	}
 
@@ -160,59 +228,271 @@ typedef struct {
 	ssize_t ret;
 } __attribute__((packed)) uhyve_read_t;
 
-ssize_t sys_read(int fd, char* buf, size_t len)
+/// Maximum number of segments of readv() and writev()
+#define IOV_MAX		1024
+
+/// physically contiguous segment for uhyve
+typedef struct {
+	size_t base;
+	size_t len;
+} __attribute__((packed)) uhyve_iovec_t;
+
+typedef struct {
+	int fd;
+	const uhyve_iovec_t* iov;
+	int iovcnt;
+	ssize_t ret;
+} __attribute__((packed)) uhyve_iov_t;
+
+/** @brief Total length of an I/O vector
+ *
+ * @return Sum of the segments or -EINVAL for an invalid vector
+ */
+static ssize_t iov_length(const struct iovec* iov, int iovcnt)
 {
-	sys_read_t sysargs = {__NR_read, fd, len};
-	ssize_t j, ret;
+	ssize_t total = 0;
+	int i;
 
-	// do we have an LwIP file descriptor?
-	if (fd & LWIP_FD_BIT) {
-		spinlock_irqsave_lock(&lwip_lock);
-		ret = lwip_read(fd & ~LWIP_FD_BIT, buf, len);
-		spinlock_irqsave_unlock(&lwip_lock);
-		if (ret < 0)
-			return -errno;
+	if (BUILTIN_EXPECT(!iov || (iovcnt <= 0) || (iovcnt > IOV_MAX), 0))
+		return -EINVAL;
 
-		return ret;
+	for(i=0; i<iovcnt; i++) {
+		if (BUILTIN_EXPECT(iov[i].iov_len && !iov[i].iov_base, 0))
+			return -EINVAL;
+		if (BUILTIN_EXPECT((ssize_t) (total + iov[i].iov_len) < total, 0))
+			return -EINVAL;
+		total += iov[i].iov_len;
 	}
 
-	if (is_uhyve()) {
-		uhyve_read_t uhyve_args = {fd, (char*) buf, len, -1};
+	return total;
+}
 
-		uhyve_send(UHYVE_PORT_READ, (unsigned)virt_to_phys((size_t)&uhyve_args));
+/** @brief Translate an I/O vector into physically contiguous segments
+ *
+ * The pages are touched to map pages of the heap, which are not yet
+ * mapped. The caller releases the vector by kfree().
+ */
+static uhyve_iovec_t* uhyve_iov_create(const struct iovec* iov, int iovcnt, int* cnt)
+{
+	uhyve_iovec_t* piov = NULL;
+	size_t last = 0;
+	int i, n = 0, pass;
+
+	// the first pass counts the segments, the second one fills them in
+	for(pass=0; pass<2; pass++) {
+		for(i=0, n=0, last=0; i<iovcnt; i++) {
+			size_t addr = (size_t) iov[i].iov_base;
+			size_t end = addr + iov[i].iov_len;
+
+			while(addr < end) {
+				size_t len = PAGE_FLOOR(addr) + PAGE_SIZE - addr;
+				size_t phyaddr;
+
+				if (len > end - addr)
+					len = end - addr;
+
+				(void) *((volatile char*) addr);
+				phyaddr = virt_to_phys(addr);
+
+				if (n && (phyaddr == last)) {
+					if (pass)
+						piov[n-1].len += len;
+				} else {
+					if (pass) {
+						piov[n].base = phyaddr;
+						piov[n].len = len;
+					}
+					n++;
+				}
+
+				last = phyaddr + len;
+				addr += len;
+			}
+		}
 
-		return uhyve_args.ret;
+		if (!pass) {
+			piov = kmalloc((n ? n : 1) * sizeof(uhyve_iovec_t));
+			if (BUILTIN_EXPECT(!piov, 0))
+				return NULL;
+		}
 	}
 
-	if (libc_sd < 0)
-		return -ENOSYS;
+	*cnt = n;
+
+	return piov;
+}
+
+/** @brief Send a vectored request to uhyve by one exit */
+static ssize_t uhyve_iov_send(unsigned short port, int fd, const struct iovec* iov, int iovcnt)
+{
+	uhyve_iov_t uhyve_args = {fd, NULL, 0, -1};
+	uhyve_iovec_t* piov;
+	int cnt;
+
+	piov = uhyve_iov_create(iov, iovcnt, &cnt);
+	if (BUILTIN_EXPECT(!piov, 0))
+		return -ENOMEM;
+
+	uhyve_args.iovcnt = cnt;
+	uhyve_args.iov = (const uhyve_iovec_t*) virt_to_phys((size_t) piov);
+	uhyve_send(port, (unsigned)virt_to_phys((size_t)&uhyve_args));
 
-	spinlock_irqsave_lock(&lwip_lock);
+	kfree(piov);
+
+	return uhyve_args.ret;
+}
+
+/** @brief Forward one read request to the proxy and scatter the data */
+static ssize_t proxy_readv(int fd, const struct iovec* iov, int iovcnt, size_t len)
+{
+	sys_read_t sysargs = {__NR_read, fd, len};
+	ssize_t j;
+	int k;
+
+	proxy_lock();
+
+	if (libc_sd < 0) {
+		proxy_unlock();
+		return -ENOSYS;
+	}
 
 	int s = libc_sd;
 	socket_send(s, &sysargs, sizeof(sysargs));
 	socket_recv(s, &j, sizeof(j));
 
 	ssize_t i=0;
-	while(i < j)
+	for(k=0; (k<iovcnt) && (i<j); k++)
 	{
-		ret = lwip_read(s, (char*)buf+i, j-i);
-		if (ret < 0) {
-			spinlock_irqsave_unlock(&lwip_lock);
-			return ret;
+		size_t n = (iov[k].iov_len > j-i) ? j-i : iov[k].iov_len;
+
+		if (n && (socket_recv(s, iov[k].iov_base, n) < 0)) {
+			proxy_unlock();
+			return -EIO;
 		}
 
-		i += ret;
+		i += n;
 	}
 
-	spinlock_irqsave_unlock(&lwip_lock);
+	proxy_unlock();
+
+	return j;
+}
+
+static inline ssize_t proxy_read(int fd, char* buf, size_t len)
+{
+	struct iovec iov = {buf, len};
+
+	return proxy_readv(fd, &iov, 1, len);
+}
+
+/** @brief Forward a read request to the host */
+static ssize_t host_read(int fd, char* buf, size_t len)
+{
+	ssize_t j, ret;
+
+	if (is_uhyve()) {
+		uhyve_read_t uhyve_args = {fd, (char*) buf, len, -1};
+
+		uhyve_send(UHYVE_PORT_READ, (unsigned)virt_to_phys((size_t)&uhyve_args));
+
+		return uhyve_args.ret;
+	}
+
+	if (libc_sd < 0)
+		return -ENOSYS;
+
+	// a stream returns, what is available
+	if (!proxy_chunked(fd))
+		return proxy_read(fd, buf, (len > PROXY_CHUNK_SIZE) ? PROXY_CHUNK_SIZE : len);
+
+	// a short read (e.g. at the end of the file) finishes the request
+	for(j=0; j<len; j+=ret)
+	{
+		size_t chunk = (len-j > PROXY_CHUNK_SIZE) ? PROXY_CHUNK_SIZE : len-j;
+
+		ret = proxy_read(fd, buf+j, chunk);
+		if (ret < 0)
+			return j ? j : ret;
+		if ((size_t) ret < chunk)
+			return j + ret;
+	}
 
 	return j;
 }
 
+ssize_t sys_read(int fd, char* buf, size_t len)
+{
+	ssize_t ret;
+	int locked;
+
+	// do we have an LwIP file descriptor?
+	if (fd & LWIP_FD_BIT) {
+		ret = lwip_read(fd & ~LWIP_FD_BIT, buf, len);
+		if (ret < 0)
+			return -errno;
+
+		return ret;
+	}
+
+	if (pcache_cached(fd))
+		return pcache_read(fd, buf, len);
+
+	locked = pio_lock(fd);
+	ret = host_read(fd, buf, len);
+	pio_unlock(locked);
+
+	return ret;
+}
+
 ssize_t readv(int d, const struct iovec *iov, int iovcnt)
 {
-	return -ENOSYS;
+	ssize_t len, i, ret;
+	int k;
+
+	len = iov_length(iov, iovcnt);
+	if (BUILTIN_EXPECT(len < 0, 0))
+		return len;
+
+	// do we have an LwIP file descriptor?
+	if (d & LWIP_FD_BIT) {
+		ret = lwip_readv(d & ~LWIP_FD_BIT, iov, iovcnt);
+		if (ret < 0)
+			return -errno;
+
+		return ret;
+	}
+
+	// the page cache serves the segments one by one
+	if (pcache_cached(d))
+		goto segments;
+
+	if (is_uhyve() && uhyve_has_iov()) {
+		int locked = pio_lock(d);
+
+		ret = uhyve_iov_send(UHYVE_PORT_READV, d, iov, iovcnt);
+		pio_unlock(locked);
+
+		return ret;
+	}
+
+	// one request scatters the data into all segments
+	if (!is_uhyve() && (libc_sd >= 0) && (len <= PROXY_CHUNK_SIZE))
+		return proxy_readv(d, iov, iovcnt, len);
+
+segments:
+	// read segment by segment, a short read finishes the request
+	for(k=0, i=0; k<iovcnt; k++)
+	{
+		ret = sys_read(d, iov[k].iov_base, iov[k].iov_len);
+		if (ret < 0)
+			return i ? i : ret;
+
+		i += ret;
+		if ((size_t) ret < iov[k].iov_len)
+			break;
+	}
+
+	return i;
 }
 
 typedef struct {
@@ -227,31 +507,91 @@ typedef struct {
 	size_t len;
 } __attribute__((packed)) uhyve_write_t;
 
+/** @brief Forward one write request with the gathered segments to the proxy */
+static ssize_t proxy_writev(int fd, const struct iovec* iov, int iovcnt, size_t len)
+{
+	sys_write_t sysargs = {__NR_write, fd, len};
+	ssize_t i, ret;
+	int k;
+
+	proxy_lock();
+
+	if (libc_sd < 0) {
+		proxy_unlock();
+		return -ENOSYS;
+	}
+
+	int s = libc_sd;
+	socket_send(s, &sysargs, sizeof(sysargs));
+
+	for(k=0; k<iovcnt; k++)
+	{
+		if (!iov[k].iov_len)
+			continue;
+
+		ret = socket_send(s, iov[k].iov_base, iov[k].iov_len);
+		if (ret < 0) {
+			proxy_unlock();
+			return ret;
+		}
+	}
+
+	// the proxy confirms only writes to files
+	i = len;
+	if (fd > 2)
+		socket_recv(s, &i, sizeof(i));
+
+	proxy_unlock();
+
+	return i;
+}
+
+static inline ssize_t proxy_write(int fd, const char* buf, size_t len)
+{
+	struct iovec iov = {(void*) buf, len};
+
+	return proxy_writev(fd, &iov, 1, len);
+}
+
+/** @brief Forward a write request to uhyve */
+static ssize_t uhyve_write(int fd, const char* buf, size_t len)
+{
+	// short writes to stdout and stderr don't wait for the monitor
+	if (!uhyve_ring_write_async(fd, buf, len))
+		return len;
+
+	uhyve_write_t uhyve_args = {fd, (const char*) buf, len};
+
+	uhyve_send(UHYVE_PORT_WRITE, (unsigned)virt_to_phys((size_t)&uhyve_args));
+
+	return uhyve_args.len;
+}
+
 ssize_t sys_write(int fd, const char* buf, size_t len)
 {
 	if (BUILTIN_EXPECT(!buf, 0))
 		return -EINVAL;
 
 	ssize_t i, ret;
-	sys_write_t sysargs = {__NR_write, fd, len};
 
 	// do we have an LwIP file descriptor?
 	if (fd & LWIP_FD_BIT) {
-		spinlock_irqsave_lock(&lwip_lock);
 		ret = lwip_write(fd & ~LWIP_FD_BIT, buf, len);
-		spinlock_irqsave_unlock(&lwip_lock);
 		if (ret < 0)
 			return -errno;
 
 		return ret;
 	}
 
+	pcache_write(fd);
+
 	if (is_uhyve()) {
-		uhyve_write_t uhyve_args = {fd, (const char*) buf, len};
+		int locked = pio_lock(fd);
 
-		uhyve_send(UHYVE_PORT_WRITE, (unsigned)virt_to_phys((size_t)&uhyve_args));
+		ret = uhyve_write(fd, buf, len);
+		pio_unlock(locked);
 
-		return uhyve_args.len;
+		return ret;
 	}
 
 	if (libc_sd < 0)
@@ -264,34 +604,69 @@ ssize_t sys_write(int fd, const char* buf, size_t len)
 		return len;
 	}
 
-	spinlock_irqsave_lock(&lwip_lock);
-
-	int s = libc_sd;
-	socket_send(s, &sysargs, sizeof(sysargs));
-
-	i=0;
-	while(i < len)
+	for(i=0; i<len; i+=ret)
 	{
-		ret = lwip_write(s, (char*)buf+i, len-i);
-		if (ret < 0) {
-			spinlock_irqsave_unlock(&lwip_lock);
-			return ret;
-		}
+		size_t chunk = (len-i > PROXY_CHUNK_SIZE) ? PROXY_CHUNK_SIZE : len-i;
 
-		i += ret;
+		ret = proxy_write(fd, buf+i, chunk);
+		if (ret < 0)
+			return i ? i : ret;
+		if ((size_t) ret < chunk)
+			return i + ret;
 	}
 
-	if (fd > 2)
-		i = socket_recv(s, &i, sizeof(i));
-
-	spinlock_irqsave_unlock(&lwip_lock);
-
 	return i;
 }
 
 ssize_t writev(int fildes, const struct iovec *iov, int iovcnt)
 {
-	return -ENOSYS;
+	ssize_t len, i, ret;
+	int k;
+
+	len = iov_length(iov, iovcnt);
+	if (BUILTIN_EXPECT(len < 0, 0))
+		return len;
+
+	// do we have an LwIP file descriptor?
+	if (fildes & LWIP_FD_BIT) {
+		ret = lwip_writev(fildes & ~LWIP_FD_BIT, iov, iovcnt);
+		if (ret < 0)
+			return -errno;
+
+		return ret;
+	}
+
+	pcache_write(fildes);
+
+	if (is_uhyve() && uhyve_has_iov()) {
+		int locked = pio_lock(fildes);
+
+		ret = uhyve_iov_send(UHYVE_PORT_WRITEV, fildes, iov, iovcnt);
+		pio_unlock(locked);
+
+		return ret;
+	}
+
+	// one header and the gathered payload
+	if (!is_uhyve() && (libc_sd >= 0) && (len <= PROXY_CHUNK_SIZE))
+		return proxy_writev(fildes, iov, iovcnt, len);
+
+	// write segment by segment, a short write finishes the request
+	for(k=0, i=0; k<iovcnt; k++)
+	{
+		if (!iov[k].iov_len)
+			continue;
+
+		ret = sys_write(fildes, iov[k].iov_base, iov[k].iov_len);
+		if (ret < 0)
+			return i ? i : ret;
+
+		i += ret;
+		if ((size_t) ret < iov[k].iov_len)
+			break;
+	}
+
+	return i;
 }
 
 ssize_t sys_sbrk(ssize_t incr)
@@ -310,7 +685,8 @@ ssize_t sys_sbrk(ssize_t incr)
 	ret = heap->end;
 
 	// check heapp boundaries
-	if ((heap->end >= HEAP_START) && (heap->end+incr < HEAP_START + HEAP_SIZE)) {
+	if ((heap->end >= HEAP_START) && (heap->end+incr >= heap->start)
+	    && (heap->end+incr < HEAP_START + HEAP_SIZE)) {
 		heap->end += incr;
 
 		// reserve VMA regions
@@ -319,6 +695,13 @@ ssize_t sys_sbrk(ssize_t incr)
 			// property
 			vma_free(PAGE_FLOOR(ret), PAGE_CEIL(heap->end));
 			vma_add(PAGE_FLOOR(ret), PAGE_CEIL(heap->end), VMA_HEAP|VMA_USER);
+		} else if (PAGE_CEIL(heap->end) < PAGE_CEIL(ret)) {
+			// heap shrinks => give the region back to the reservation
+			vma_free(PAGE_CEIL(heap->end), PAGE_CEIL(ret));
+			vma_add(PAGE_CEIL(heap->end), PAGE_CEIL(ret), VMA_NO_ACCESS);
+
+			// return the pages behind the new break
+			page_release(heap->end, HUGE_PAGE_CEIL(ret));
 		}
 	} else ret = -ENOMEM;
 
@@ -330,6 +713,83 @@ ssize_t sys_sbrk(ssize_t incr)
 	return ret;
 }
 
+int sys_madvise(void* addr, size_t len, int advice)
+{
+	vma_t* heap = per_core(current_task)->heap;
+	size_t start = (size_t) addr;
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(start & (PAGE_SIZE-1), 0))
+		return -EINVAL;
+
+	switch(advice) {
+	case MADV_NORMAL:
+	case MADV_RANDOM:
+	case MADV_SEQUENTIAL:
+		// just hints => nothing to do
+		return 0;
+	case MADV_WILLNEED:
+		// read the pages of a mapped file ahead of time
+		if (fmap_contains(start))
+			return fmap_populate(start, start+len);
+
+		// map the heap ahead of time, other regions are always mapped
+		if (!heap || (start < heap->start) || (start+len > HEAP_START+HEAP_SIZE))
+			return 0;
+
+		ret = page_populate(start, start+len);
+
+		return ret < 0 ? ret : 0;
+	case MADV_DONTNEED:
+		// only the heap is mapped on demand
+		if (BUILTIN_EXPECT(!heap || (start < heap->start) || (start+len > heap->end), 0))
+			return -EINVAL;
+
+		// the pagefault handler maps fresh pages on the next access
+		ret = page_release(start, start+len);
+
+		return ret < 0 ? ret : 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+int sys_munmap(void* addr, size_t len)
+{
+	if (fmap_contains((size_t) addr))
+		return fmap_unmap((size_t) addr, len);
+
+	// besides mapped files, the heap is the only region, which is mapped on demand
+	return sys_madvise(addr, len, MADV_DONTNEED);
+}
+
+ssize_t sys_heap_populate(size_t size)
+{
+	vma_t* heap = per_core(current_task)->heap;
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(!heap, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(size > HEAP_SIZE, 0))
+		return -EINVAL;
+
+	ret = page_populate(heap->start, heap->start+size);
+	if (ret < 0)
+		return ret;
+
+	return ret * HUGE_PAGE_SIZE;
+}
+
+int sys_heap_pagesize(size_t size)
+{
+	if (size == PAGE_1G_SIZE)
+		return page_enable_1g(1);
+	if ((size == PAGE_2M_SIZE) || (size == HUGE_PAGE_SIZE))
+		return page_enable_1g(0);
+
+	return -EINVAL;
+}
+
 typedef struct {
 	const char* name;
 	int flags;
@@ -337,7 +797,7 @@ typedef struct {
 	int ret;
 } __attribute__((packed)) uhyve_open_t;
 
-int sys_open(const char* name, int flags, int mode)
+static int host_open(const char* name, int flags, int mode)
 {
 	if (is_uhyve()) {
 		uhyve_open_t uhyve_open = {(const char*)virt_to_phys((size_t)name), flags, mode, -1};
@@ -350,7 +810,7 @@ int sys_open(const char* name, int flags, int mode)
 	int s, i, ret, sysnr = __NR_open;
 	size_t len;
 
-	spinlock_irqsave_lock(&lwip_lock);
+	proxy_lock();
 	if (libc_sd < 0) {
 		ret = -EINVAL;
 		goto out;
@@ -393,7 +853,21 @@ int sys_open(const char* name, int flags, int mode)
 	socket_recv(s, &ret, sizeof(ret));
 
 out:
-	spinlock_irqsave_unlock(&lwip_lock);
+	proxy_unlock();
+
+	return ret;
+}
+
+int sys_open(const char* name, int flags, int mode)
+{
+	int ret = host_open(name, flags, mode);
+
+	// the monitor serves large reads by a single request
+	if ((ret > 2) && (ret < PROXY_MAX_FDS) && !is_uhyve())
+		proxy_seekable[ret] = (__sys_lseek(ret, 0, SEEK_CUR) >= 0) ? 1 : 0;
+
+	if (ret >= 0)
+		pcache_open(ret, name, flags);
 
 	return ret;
 }
@@ -422,6 +896,11 @@ int sys_close(int fd)
 		return 0;
 	}
 
+	pcache_close(fd);
+	fmap_close(fd);
+	if ((fd >= 0) && (fd < PROXY_MAX_FDS))
+		proxy_seekable[fd] = 0;
+
 	if (is_uhyve()) {
 		uhyve_close_t uhyve_close = {fd, -1};
 
@@ -430,7 +909,7 @@ int sys_close(int fd)
 		return uhyve_close.ret;
 	}
 
-	spinlock_irqsave_lock(&lwip_lock);
+	proxy_lock();
 	if (libc_sd < 0) {
 		ret = 0;
 		goto out;
@@ -443,7 +922,7 @@ int sys_close(int fd)
 	socket_recv(s, &ret, sizeof(ret));
 
 out:
-	spinlock_irqsave_unlock(&lwip_lock);
+	proxy_unlock();
 
 	return ret;
 }
@@ -500,10 +979,15 @@ int sys_spinlock_unlock(spinlock_t* lock)
 
 void sys_msleep(unsigned int ms)
 {
+#ifdef TIMER_CLOCK_TSC
+	if (ms > 0)
+		timer_wait_usecs(1000ULL * ms);
+#else
 	if (ms * TIMER_FREQ / 1000 > 0)
 		timer_wait(ms * TIMER_FREQ / 1000);
 	else if (ms > 0)
 		udelay(ms * 1000);
+#endif
 }
 
 int sys_sem_init(sem_t** sem, unsigned int value)
@@ -572,9 +1056,29 @@ int sys_sem_cancelablewait(sem_t* sem, unsigned int ms)
 	return sem_wait(sem, ms);
 }
 
+int sys_futex_wait(int* addr, int val, unsigned int ms)
+{
+	return futex_wait(addr, val, ms);
+}
+
+int sys_futex_wake(int* addr, int n)
+{
+	return futex_wake(addr, n);
+}
+
 int sys_clone(tid_t* id, void* ep, void* argv)
 {
-	return clone_task(id, ep, argv, per_core(current_task)->prio);
+	return clone_task(id, ep, argv, per_core(current_task)->prio, NUMA_NO_NODE);
+}
+
+int sys_clone_node(tid_t* id, void* ep, void* argv, int node)
+{
+	return clone_task(id, ep, argv, per_core(current_task)->prio, node);
+}
+
+int sys_numa_node(void)
+{
+	return numa_cpu_node(CORE_ID);
 }
 
 typedef struct {
@@ -590,12 +1094,12 @@ typedef struct {
 	int whence;
 } __attribute__((packed)) uhyve_lseek_t;
 
-off_t sys_lseek(int fd, off_t offset, int whence)
+off_t __sys_lseek(int fd, off_t offset, int whence)
 {
 	if (is_uhyve()) {
 		uhyve_lseek_t uhyve_lseek = { fd, offset, whence };
 
-		outportl(UHYVE_PORT_LSEEK, (unsigned)virt_to_phys((size_t) &uhyve_lseek));
+		uhyve_send(UHYVE_PORT_LSEEK, (unsigned)virt_to_phys((size_t) &uhyve_lseek));
 
 		return uhyve_lseek.offset;
 	}
@@ -604,10 +1108,10 @@ off_t sys_lseek(int fd, off_t offset, int whence)
 	sys_lseek_t sysargs = {__NR_lseek, fd, offset, whence};
 	int s;
 
-	spinlock_irqsave_lock(&lwip_lock);
+	proxy_lock();
 
 	if (libc_sd < 0) {
-		spinlock_irqsave_unlock(&lwip_lock);
+		proxy_unlock();
 		return -ENOSYS;
 	}
 
@@ -615,11 +1119,268 @@ off_t sys_lseek(int fd, off_t offset, int whence)
 	socket_send(s, &sysargs, sizeof(sysargs));
 	socket_recv(s, &off, sizeof(off));
 
-	spinlock_irqsave_unlock(&lwip_lock);
+	proxy_unlock();
 
 	return off;
 }
 
+off_t sys_lseek(int fd, off_t offset, int whence)
+{
+	// the page cache tracks the position of its descriptors
+	if (pcache_cached(fd))
+		return pcache_lseek(fd, offset, whence);
+
+	int locked = pio_lock(fd);
+	off_t ret = __sys_lseek(fd, offset, whence);
+	pio_unlock(locked);
+
+	return ret;
+}
+
+typedef struct {
+	int fd;
+	char* buf;
+	size_t len;
+	off_t offset;
+	ssize_t ret;
+} __attribute__((packed)) uhyve_pread_t;
+
+typedef struct {
+	int fd;
+	const char* buf;
+	size_t len;
+	off_t offset;
+	ssize_t ret;
+} __attribute__((packed)) uhyve_pwrite_t;
+
+typedef struct {
+	int sysnr;
+	int fd;
+	size_t len;
+	off_t offset;
+} __attribute__((packed)) sys_pio_t;
+
+/// the proxy supports __NR_pread and __NR_pwrite
+#define PROXY_FEATURE_PIO	(1 << 0)
+
+/// features of the proxy, announced by the handshake (PROXY_FEATURE_*)
+uint32_t proxy_features = 0;
+
+/** @brief Positional read or write by a single proxy request
+ *
+ * The proxy answers every request with the result of the transfer.
+ */
+static ssize_t proxy_pio_direct(int sysnr, int fd, char* buf, size_t len, off_t offset)
+{
+	sys_pio_t sysargs = {(sysnr == __NR_read) ? __NR_pread : __NR_pwrite, fd, len, offset};
+	ssize_t ret;
+	int s;
+
+	proxy_lock();
+
+	if (libc_sd < 0) {
+		proxy_unlock();
+		return -ENOSYS;
+	}
+
+	s = libc_sd;
+	socket_send(s, &sysargs, sizeof(sysargs));
+	if (sysnr == __NR_write)
+		socket_send(s, buf, len);
+
+	socket_recv(s, &ret, sizeof(ret));
+	if ((sysnr == __NR_read) && (ret > 0))
+		socket_recv(s, buf, ret);
+
+	proxy_unlock();
+
+	return ret;
+}
+
+/** @brief Positional read or write by the lseek requests of the proxy
+ *
+ * Fallback for proxies without PROXY_FEATURE_PIO. The first round trip
+ * queries the offset and sets the new one. Only a seekable descriptor
+ * gets the transfer, which is pipelined with the restore of the offset.
+ * Holding the proxy connection, no other request of the guest sees the
+ * temporary offset.
+ */
+static ssize_t proxy_pio_lseek(int sysnr, int fd, char* buf, size_t len, off_t offset)
+{
+	sys_lseek_t cur = {__NR_lseek, fd, 0, SEEK_CUR};
+	sys_lseek_t set = {__NR_lseek, fd, offset, SEEK_SET};
+	sys_read_t io = {sysnr, fd, len};
+	off_t old, off;
+	ssize_t ret;
+	int s;
+
+	proxy_lock();
+
+	if (libc_sd < 0) {
+		proxy_unlock();
+		return -ENOSYS;
+	}
+
+	s = libc_sd;
+	socket_send(s, &cur, sizeof(cur));
+	socket_send(s, &set, sizeof(set));
+	socket_recv(s, &old, sizeof(old));
+	socket_recv(s, &off, sizeof(off));
+
+	// a stream would consume the data at its current position
+	if (BUILTIN_EXPECT((old < 0) || (off != offset), 0)) {
+		if ((old >= 0) && (off >= 0)) {
+			set.offset = old;
+			socket_send(s, &set, sizeof(set));
+			socket_recv(s, &set.offset, sizeof(set.offset));
+		}
+
+		proxy_unlock();
+
+		return (old < 0) ? -ESPIPE : -EINVAL;
+	}
+
+	socket_send(s, &io, sizeof(io));
+	if (sysnr == __NR_write)
+		socket_send(s, buf, len);
+
+	// restore the offset
+	set.offset = old;
+	socket_send(s, &set, sizeof(set));
+
+	// the proxy confirms only writes to files, fd > 2 is already checked
+	socket_recv(s, &ret, sizeof(ret));
+	if ((sysnr == __NR_read) && (ret > 0))
+		socket_recv(s, buf, ret);
+	socket_recv(s, &set.offset, sizeof(set.offset));
+
+	proxy_unlock();
+
+	return ret;
+}
+
+static inline ssize_t proxy_pio(int sysnr, int fd, char* buf, size_t len, off_t offset)
+{
+	if (proxy_features & PROXY_FEATURE_PIO)
+		return proxy_pio_direct(sysnr, fd, buf, len, offset);
+
+	return proxy_pio_lseek(sysnr, fd, buf, len, offset);
+}
+
+/** @brief Positional read or write by lseek for monitors without positional requests */
+static ssize_t lseek_pio(int sysnr, int fd, char* buf, size_t len, off_t offset)
+{
+	off_t old;
+	ssize_t ret;
+
+	sem_wait(&pio_sem, 0);
+
+	old = __sys_lseek(fd, 0, SEEK_CUR);
+	if (BUILTIN_EXPECT(old < 0, 0)) {
+		sem_post(&pio_sem);
+		return -ESPIPE;
+	}
+
+	if (BUILTIN_EXPECT(__sys_lseek(fd, offset, SEEK_SET) != offset, 0)) {
+		__sys_lseek(fd, old, SEEK_SET);
+		sem_post(&pio_sem);
+		return -EINVAL;
+	}
+
+	if (sysnr == __NR_read)
+		ret = host_read(fd, buf, len);
+	else
+		ret = uhyve_write(fd, buf, len);
+
+	__sys_lseek(fd, old, SEEK_SET);
+
+	sem_post(&pio_sem);
+
+	return ret;
+}
+
+static ssize_t do_pio(int sysnr, int fd, char* buf, size_t len, off_t offset)
+{
+	ssize_t i, ret;
+
+	if (BUILTIN_EXPECT(!buf, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(offset < 0, 0))
+		return -EINVAL;
+	// sockets and the standard streams are not seekable
+	if ((fd & LWIP_FD_BIT) || (fd <= 2))
+		return -ESPIPE;
+
+	if (is_uhyve()) {
+		if (!uhyve_has_pio())
+			return lseek_pio(sysnr, fd, buf, len, offset);
+
+		if (sysnr == __NR_read) {
+			uhyve_pread_t uhyve_args = {fd, buf, len, offset, -1};
+
+			uhyve_send(UHYVE_PORT_PREAD, (unsigned)virt_to_phys((size_t)&uhyve_args));
+
+			return uhyve_args.ret;
+		} else {
+			uhyve_pwrite_t uhyve_args = {fd, buf, len, offset, -1};
+
+			uhyve_send(UHYVE_PORT_PWRITE, (unsigned)virt_to_phys((size_t)&uhyve_args));
+
+			return uhyve_args.ret;
+		}
+	}
+
+	if (libc_sd < 0)
+		return -ENOSYS;
+
+	// a short transfer (e.g. at the end of the file) finishes the request
+	for(i=0; i<len; i+=ret)
+	{
+		size_t chunk = (len-i > PROXY_CHUNK_SIZE) ? PROXY_CHUNK_SIZE : len-i;
+
+		ret = proxy_pio(sysnr, fd, buf+i, chunk, offset+i);
+		if (ret < 0)
+			return i ? i : ret;
+		if ((size_t) ret < chunk)
+			return i + ret;
+	}
+
+	return i;
+}
+
+ssize_t __sys_pread(int fd, char* buf, size_t len, off_t offset)
+{
+	return do_pio(__NR_read, fd, buf, len, offset);
+}
+
+ssize_t __sys_pread_direct(int fd, char* buf, size_t len, off_t offset)
+{
+	uhyve_pread_t uhyve_args = {fd, buf, len, offset, -1};
+
+	if (BUILTIN_EXPECT(!is_uhyve() || !uhyve_has_pio(), 0))
+		return -ENOSYS;
+
+	// the ring may reschedule => bypass it
+	uhyve_send_direct(UHYVE_PORT_PREAD, (unsigned)virt_to_phys((size_t)&uhyve_args));
+
+	return uhyve_args.ret;
+}
+
+ssize_t sys_pread(int fd, char* buf, size_t len, off_t offset)
+{
+	if (pcache_cached(fd))
+		return pcache_pread(fd, buf, len, offset);
+
+	return do_pio(__NR_read, fd, buf, len, offset);
+}
+
+ssize_t sys_pwrite(int fd, const char* buf, size_t len, off_t offset)
+{
+	pcache_write(fd);
+
+	return do_pio(__NR_write, fd, (char*) buf, len, offset);
+}
+
 int sys_rcce_init(int session_id)
 {
 	int i, err = 0;
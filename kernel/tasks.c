@@ -37,6 +37,7 @@
 #include <hermit/syscall.h>
 #include <hermit/memory.h>
 #include <hermit/logging.h>
+#include <hermit/numa.h>
 #include <asm/processor.h>
 
 /*
@@ -52,29 +53,194 @@ volatile uint32_t go_down = 0;
  * A task's id will be its position in this array.
  */
 static task_t task_table[MAX_TASKS] = { \
-        [0]                 = {0, TASK_IDLE, 0, NULL, NULL, NULL, TASK_DEFAULT_FLAGS, 0, 0, 0, 0, NULL, 0, NULL, NULL, 0, 0, 0, NULL, FPU_STATE_INIT}, \
-        [1 ... MAX_TASKS-1] = {0, TASK_INVALID, 0, NULL, NULL, NULL, TASK_DEFAULT_FLAGS, 0, 0, 0, 0, NULL, 0, NULL, NULL, 0, 0, 0, NULL, FPU_STATE_INIT}};
+        [0]                 = {0, TASK_IDLE, 0, NULL, NULL, NULL, TASK_DEFAULT_FLAGS, 0, 0, 1, 0, 0, 0, NULL, 0, NULL, NULL, NULL, NULL, 0, 0, 0, NULL, FPU_STATE_INIT}, \
+        [1 ... MAX_TASKS-1] = {0, TASK_INVALID, 0, NULL, NULL, NULL, TASK_DEFAULT_FLAGS, 0, 0, 0, 0, 0, 0, NULL, 0, NULL, NULL, NULL, NULL, 0, 0, 0, NULL, FPU_STATE_INIT}};
 
 static spinlock_irqsave_t table_lock = SPINLOCK_IRQSAVE_INIT;
 
 #if MAX_CORES > 1
 static readyqueues_t readyqueues[MAX_CORES] = { \
-		[0 ... MAX_CORES-1]   = {NULL, NULL, 0, 0, 0, {[0 ... MAX_PRIO-2] = {NULL, NULL}}, {NULL, NULL}, SPINLOCK_IRQSAVE_INIT}};
+		[0 ... MAX_CORES-1]   = {NULL, NULL, 0, 0, 0, 0, {[0 ... MAX_PRIO-2] = {NULL, NULL}}, NULL, 0, 0, 0, 0, 0, NULL, 0, SPINLOCK_IRQSAVE_INIT}};
 #else
-static readyqueues_t readyqueues[1] = {[0] = {task_table+0, NULL, 0, 0, 0, {[0 ... MAX_PRIO-2] = {NULL, NULL}}, {NULL, NULL}, SPINLOCK_IRQSAVE_INIT}};
+static readyqueues_t readyqueues[1] = {[0] = {task_table+0, NULL, 0, 0, 0, 0, {[0 ... MAX_PRIO-2] = {NULL, NULL}}, NULL, 0, 0, 0, 0, 0, NULL, 0, SPINLOCK_IRQSAVE_INIT}};
 #endif
 
 DEFINE_PER_CORE(task_t*, current_task, task_table+0);
 
+/// cores, which ran other tasks than their idle task
+static cpumask_t task_cpus;
+
+/*
+ * The core may cache translations of the heap and the stacks from now on.
+ * The mask is shared by all cores => avoid needless atomic updates.
+ */
+static inline void task_cpus_add(uint32_t core_id)
+{
+	if (!cpumask_test(&task_cpus, core_id))
+		cpumask_set_atomic(&task_cpus, core_id);
+}
+
 #if MAX_CORES > 1
 DEFINE_PER_CORE(uint32_t, __core_id, 0);
 #endif
 
-static void update_timer(task_t* first)
+#ifndef TASK_SLOT_CACHE
+#define TASK_SLOT_CACHE		8
+#endif
+
+/*
+ * Unused task slots without stacks (linked by next). Finished tasks are
+ * first cached in the readyqueue of the core, which releases them.
+ */
+static task_t* free_tasks = NULL;
+static spinlock_irqsave_t free_lock = SPINLOCK_IRQSAVE_INIT;
+
+static inline void free_tasks_push(task_t* task)
+{
+	spinlock_irqsave_lock(&free_lock);
+	task->next = free_tasks;
+	free_tasks = task;
+	spinlock_irqsave_unlock(&free_lock);
+}
+
+static inline task_t* free_tasks_pop(void)
+{
+	task_t* task;
+
+	spinlock_irqsave_lock(&free_lock);
+	task = free_tasks;
+	if (task)
+		free_tasks = task->next;
+	spinlock_irqsave_unlock(&free_lock);
+
+	return task;
+}
+
+/*
+ * Take a slot from the cache of core_id
+ */
+static task_t* task_slot_cached(uint32_t core_id)
+{
+	task_t* task;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	task = readyqueues[core_id].free_tasks;
+	if (task) {
+		readyqueues[core_id].free_tasks = task->next;
+		readyqueues[core_id].nr_free_tasks--;
+	}
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	return task;
+}
+
+/*
+ * Get an unused task slot. Slots from the caches of the cores still own
+ * their stack and IST. The caches of other cores are the last resort,
+ * because they may hold most of the MAX_TASKS slots.
+ */
+static task_t* task_slot_alloc(void)
+{
+	const uint32_t core_id = CORE_ID;
+	task_t* task;
+
+	task = task_slot_cached(core_id);
+	if (!task)
+		task = free_tasks_pop();
+
+	// we hold only one readyqueue lock at a time => no lock ordering problems
+	for(uint32_t i=0; !task && (i<MAX_CORES); i++) {
+		if ((i == core_id) || !readyqueues[i].nr_free_tasks)
+			continue;
+
+		task = task_slot_cached(i);
+	}
+
+	return task;
+}
+
+/*
+ * Release a task slot, the caller holds the lock of the readyqueue of core_id.
+ */
+static void task_slot_free(uint32_t core_id, task_t* task)
+{
+	task->last_stack_pointer = NULL;
+	task->status = TASK_INVALID;
+	task->sem_queued = 0;
+	task->sem_next = NULL;
+
+	if (task->stack && task->ist_addr && (readyqueues[core_id].nr_free_tasks < TASK_SLOT_CACHE)) {
+		task->next = readyqueues[core_id].free_tasks;
+		readyqueues[core_id].free_tasks = task;
+		readyqueues[core_id].nr_free_tasks++;
+		return;
+	}
+
+	if (task->stack) {
+		destroy_stack(task->stack, DEFAULT_STACK_SIZE);
+		task->stack = NULL;
+	}
+
+	if (task->ist_addr) {
+		destroy_stack(task->ist_addr, KERNEL_STACK_SIZE);
+		task->ist_addr = NULL;
+	}
+
+	free_tasks_push(task);
+}
+
+/*
+ * Create the stacks of the task, if it doesn't own cached stacks
+ */
+static int task_slot_stacks(task_t* task)
 {
+	// the current core writes the initial frame onto the stacks
+	task_cpus_add(CORE_ID);
+
+	if (!task->stack) {
+		task->stack = create_stack(DEFAULT_STACK_SIZE);
+		if (BUILTIN_EXPECT(!task->stack, 0))
+			return -ENOMEM;
+	}
+
+	if (!task->ist_addr) {
+		task->ist_addr = create_stack(KERNEL_STACK_SIZE);
+		if (BUILTIN_EXPECT(!task->ist_addr, 0))
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Give a slot back, which was allocated by task_slot_alloc()
+ */
+static void task_slot_release(task_t* task)
+{
+	readyqueues_t* readyqueue = &readyqueues[CORE_ID];
+
+	spinlock_irqsave_lock(&readyqueue->lock);
+	task_slot_free(readyqueue - readyqueues, task);
+	spinlock_irqsave_unlock(&readyqueue->lock);
+}
+
+/*
+ * Program the oneshot timer of core_id for the deadline of first.
+ * Only the local APIC timer can be programmed => ignore remote cores,
+ * their timer interrupt calls check_timers() and updates the deadline.
+ */
+static void update_timer(uint32_t core_id, task_t* first)
+{
+	if (core_id != CORE_ID)
+		return;
+
+	readyqueues[core_id].nr_timer_reprograms++;
+
 	if (first) {
-		if(first->timeout > get_clock_tick()) {
-			timer_deadline((uint32_t) (first->timeout - get_clock_tick()));
+		const uint64_t now = get_timer_clock();
+
+		if(first->timeout > now) {
+			timer_deadline(first->timeout - now);
 		} else {
 			// workaround: start timer so new head will be serviced
 			timer_deadline(1);
@@ -86,72 +252,117 @@ static void update_timer(task_t* first)
 }
 
 
-static void timer_queue_remove(uint32_t core_id, task_t* task)
+/*
+ * The timer queue is a pairing heap, which links the tasks by
+ * child (first child), next (next sibling) and prev (previous sibling
+ * or parent for the first child). All roots have no siblings.
+ */
+static task_t* timer_heap_meld(task_t* a, task_t* b)
 {
-	if(BUILTIN_EXPECT(!task, 0)) {
-		return;
-	}
+	task_t* tmp;
 
-	task_list_t* timer_queue = &readyqueues[core_id].timers;
+	if (!a)
+		return b;
+	if (!b)
+		return a;
 
-#ifdef DYNAMIC_TICKS
-	// if task is first in timer queue, we need to update the oneshot
-	// timer for the next task
-	if(timer_queue->first == task) {
-		update_timer(task->next);
+	if (b->timeout < a->timeout) {
+		tmp = a;
+		a = b;
+		b = tmp;
 	}
-#endif
 
-	task_list_remove_task(timer_queue, task);
+	// b becomes the first child of a
+	b->prev = a;
+	b->next = a->child;
+	if (a->child)
+		a->child->prev = b;
+	a->child = b;
+
+	return a;
 }
 
 
-static void timer_queue_push(uint32_t core_id, task_t* task)
+static task_t* timer_heap_merge_pairs(task_t* first)
 {
-	task_list_t* timer_queue = &readyqueues[core_id].timers;
+	task_t* pairs = NULL;
+	task_t* root = NULL;
+	task_t *a, *b;
+
+	// first pass: meld pairs from left to right
+	while(first) {
+		a = first;
+		b = a->next;
+		first = b ? b->next : NULL;
+
+		a->next = a->prev = NULL;
+		if (b)
+			b->next = b->prev = NULL;
+
+		a = timer_heap_meld(a, b);
+		a->next = pairs;
+		pairs = a;
+	}
 
-	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	// second pass: meld the results from right to left
+	while(pairs) {
+		a = pairs;
+		pairs = a->next;
+		a->next = NULL;
+		root = timer_heap_meld(root, a);
+	}
 
-	task_t* first = timer_queue->first;
+	return root;
+}
 
-	if(!first) {
-		timer_queue->first = timer_queue->last = task;
-		task->next = task->prev = NULL;
+
+static void timer_queue_remove(uint32_t core_id, task_t* task)
+{
+	if(BUILTIN_EXPECT(!task, 0)) {
+		return;
+	}
+
+	task_t** root = &readyqueues[core_id].timers;
+
+	if (*root == task) {
+		*root = timer_heap_merge_pairs(task->child);
 
 #ifdef DYNAMIC_TICKS
-		update_timer(task);
+		// task was the first one in the timer queue, we need to
+		// update the oneshot timer for the next task
+		update_timer(core_id, *root);
 #endif
 	} else {
-		// lookup position where to insert task
-		task_t* tmp = first;
-		while(tmp && (task->timeout >= tmp->timeout))
-			tmp = tmp->next;
-
-		if(!tmp) {
-			// insert at the end of queue
-			task->next = NULL;
-			task->prev = timer_queue->last;
-
-			// there has to be a last element because there is also a first one
-			timer_queue->last->next = task;
-			timer_queue->last = task;
-		} else {
-			task->next = tmp;
-			task->prev = tmp->prev;
-			tmp->prev = task;
+		// unlink the subtree of task
+		if (task->prev->child == task)
+			task->prev->child = task->next;
+		else
+			task->prev->next = task->next;
+		if (task->next)
+			task->next->prev = task->prev;
+
+		*root = timer_heap_meld(*root, timer_heap_merge_pairs(task->child));
+	}
+
+	task->child = task->next = task->prev = NULL;
+}
 
-			if(task->prev)
-				task->prev->next = task;
 
-			if(timer_queue->first == tmp) {
-				timer_queue->first = task;
+static void timer_queue_push(uint32_t core_id, task_t* task)
+{
+	task_t** root = &readyqueues[core_id].timers;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+	task->child = task->next = task->prev = NULL;
+	*root = timer_heap_meld(*root, task);
+	readyqueues[core_id].nr_timer_inserts++;
 
 #ifdef DYNAMIC_TICKS
-				update_timer(task);
+	// new first task => reprogram the oneshot timer
+	if (*root == task)
+		update_timer(core_id, task);
 #endif
-			}
-		}
-	}
 
 	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
 }
@@ -217,6 +428,145 @@ int is_task_available(void)
 	return readyqueues[core_id].nr_tasks > 0 ? 1 : 0;
 }
 
+#ifdef WORK_STEALING
+
+#ifndef STEAL_THRESHOLD
+#define STEAL_THRESHOLD		2
+#endif
+
+#ifndef MIGRATION_COST
+#define MIGRATION_COST		0
+#endif
+
+/*
+ * Ask an idle core to steal work from core busy_core. The caller holds
+ * the lock of busy_core's readyqueue.
+ *
+ * An idle core sleeps (mwait) on the first cache line of its readyqueue.
+ * Setting kick is enough to wake it up, otherwise wakeup_core() sends an IPI.
+ */
+static void kick_idle_core(uint32_t busy_core)
+{
+	uint32_t i;
+
+	if (readyqueues[busy_core].nr_tasks < STEAL_THRESHOLD)
+		return;
+
+	for(i=0; i<MAX_CORES; i++) {
+		if ((i == busy_core) || !readyqueues[i].idle)
+			continue;
+		if (readyqueues[i].nr_tasks || readyqueues[i].kick)
+			continue;
+
+		readyqueues[i].kick = 1;
+		wakeup_core(i);
+		break;
+	}
+}
+
+/*
+ * Is task still cache hot? Such tasks won't be migrated.
+ */
+static inline int task_hot(task_t* task)
+{
+	if (!MIGRATION_COST || !task->last_tsc)
+		return 0;
+
+	return (get_rdtsc() - task->last_tsc) < (uint64_t) MIGRATION_COST * (uint64_t) get_cpu_frequency();
+}
+
+int steal_task(void)
+{
+	const uint32_t core_id = CORE_ID;
+	uint32_t i, victim = MAX_CORES;
+	uint32_t max_tasks = STEAL_THRESHOLD - 1;
+	task_t* task = NULL;
+	uint32_t prio;
+
+	readyqueues[core_id].kick = 0;
+
+	// search busiest core without holding any lock
+	for(i=0; i<MAX_CORES; i++) {
+		if ((i == core_id) || !readyqueues[i].idle)
+			continue;
+		if (readyqueues[i].nr_tasks > max_tasks) {
+			max_tasks = readyqueues[i].nr_tasks;
+			victim = i;
+		}
+	}
+
+	if (victim >= MAX_CORES)
+		return 0;
+
+	// we hold only one readyqueue lock at a time => no lock ordering problems
+	spinlock_irqsave_lock(&readyqueues[victim].lock);
+
+	prio = msb(readyqueues[victim].prio_bitmap);
+	if ((readyqueues[victim].nr_tasks >= STEAL_THRESHOLD) && (prio <= MAX_PRIO)) {
+		// the tail of the queue is the task, which waits the shortest time
+		// => probably not the next one which gets the core
+		for(task=readyqueues[victim].queue[prio-1].last; task; task=task->prev) {
+			// a blocked task can be woken up, before it left its core
+			if (task->on_cpu)
+				continue;
+			// the FPU registers of the task still live in core victim
+			if (readyqueues[victim].fpu_owner == task->id)
+				continue;
+			if (task_hot(task))
+				continue;
+			break;
+		}
+
+		if (task) {
+			readyqueues_remove(victim, task);
+			readyqueues[victim].nr_tasks--;
+			readyqueues[victim].nr_stolen++;
+		}
+	}
+
+	spinlock_irqsave_unlock(&readyqueues[victim].lock);
+
+	if (!task)
+		return 0;
+
+	LOG_DEBUG("Core %d steals task %d from core %d\n", core_id, task->id, victim);
+
+	task->last_core = core_id;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	readyqueues_push_back(core_id, task);
+	readyqueues[core_id].nr_tasks++;
+	readyqueues[core_id].nr_steals++;
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	return 1;
+}
+
+#else
+
+int steal_task(void)
+{
+	return 0;
+}
+
+#endif
+
+void print_sched_stats(void)
+{
+	uint32_t i;
+
+	for(i=0; i<MAX_CORES; i++) {
+		if (!readyqueues[i].idle)
+			continue;
+
+		LOG_INFO("Core %d: stole %llu tasks, lost %llu tasks\n", i,
+			readyqueues[i].nr_steals, readyqueues[i].nr_stolen);
+		LOG_INFO("Core %d: %llu timer insertions, %llu expirations, %llu reprogramming events\n", i,
+			readyqueues[i].nr_timer_inserts, readyqueues[i].nr_timer_expires,
+			readyqueues[i].nr_timer_reprograms);
+	}
+}
+
 void check_scheduling(void)
 {
 	uint32_t prio = get_highest_priority();
@@ -256,6 +606,11 @@ void* get_readyqueue(void)
 	return &readyqueues[CORE_ID];
 }
 
+const cpumask_t* get_task_cpus(void)
+{
+	return &task_cpus;
+}
+
 
 int multitasking_init(void)
 {
@@ -273,6 +628,12 @@ int multitasking_init(void)
 
 	readyqueues[core_id].idle = task_table+0;
 
+	// all other slots are unused => the lowest ids are taken first
+	for(uint32_t i=MAX_TASKS-1; i>0; i--) {
+		task_table[i].id = i;
+		free_tasks_push(task_table+i);
+	}
+
 	return 0;
 }
 
@@ -291,29 +652,24 @@ int set_boot_stack(tid_t id, size_t stack, size_t ist_addr)
 tid_t set_idle_task(void)
 {
 	uint32_t core_id = CORE_ID;
+	task_t* task;
 	tid_t id = ~0;
 
-	spinlock_irqsave_lock(&table_lock);
-
-	for(uint32_t i=0; i<MAX_TASKS; i++) {
-		if (task_table[i].status == TASK_INVALID) {
-			task_table[i].id = id = i;
-			task_table[i].status = TASK_IDLE;
-			task_table[i].last_core = core_id;
-			task_table[i].last_stack_pointer = NULL;
-			task_table[i].stack = NULL;
-			task_table[i].ist_addr = NULL;
-			task_table[i].prio = IDLE_PRIO;
-			task_table[i].heap = NULL;
-			readyqueues[core_id].idle = task_table+i;
-			set_per_core(current_task, readyqueues[core_id].idle);
-
-			break;
-		}
+	task = free_tasks_pop();
+	if (task) {
+		task->id = id = task - task_table;
+		task->status = TASK_IDLE;
+		task->last_core = core_id;
+		task->last_stack_pointer = NULL;
+		task->stack = NULL;
+		task->ist_addr = NULL;
+		task->prio = IDLE_PRIO;
+		task->heap = NULL;
+		task->on_cpu = 1;
+		readyqueues[core_id].idle = task;
+		set_per_core(current_task, readyqueues[core_id].idle);
 	}
 
-	spinlock_irqsave_unlock(&table_lock);
-
 	return id;
 }
 
@@ -324,34 +680,27 @@ void finish_task_switch(void)
 
 	spinlock_irqsave_lock(&readyqueues[core_id].lock);
 
+	// the context of the previous task is saved => other cores may run it
+	if (readyqueues[core_id].prev_task) {
+		readyqueues[core_id].prev_task->on_cpu = 0;
+		readyqueues[core_id].prev_task = NULL;
+	}
+
 	if ((old = readyqueues[core_id].old_task) != NULL) {
 		readyqueues[core_id].old_task = NULL;
 
 		if (old->status == TASK_FINISHED) {
 			/* cleanup task */
-			if (old->stack) {
-				//LOG_INFO("Release stack at 0x%zx\n", old->stack);
-				destroy_stack(old->stack, DEFAULT_STACK_SIZE);
-				old->stack = NULL;
-			}
-
 			if (!old->parent && old->heap) {
 				kfree(old->heap);
 				old->heap = NULL;
 			}
 
-			if (old->ist_addr) {
-				destroy_stack(old->ist_addr, KERNEL_STACK_SIZE);
-				old->ist_addr = NULL;
-			}
-
-			old->last_stack_pointer = NULL;
-
 			if (readyqueues[core_id].fpu_owner == old->id)
 				readyqueues[core_id].fpu_owner = 0;
 
 			/* signalizes that this task could be reused */
-			old->status = TASK_INVALID;
+			task_slot_free(core_id, old);
 		} else {
 			// re-enqueue old task
 			readyqueues_push_back(core_id, old);
@@ -405,7 +754,12 @@ void NORETURN do_abort(void) {
 }
 
 
-static uint32_t get_next_core_id(void)
+/** @brief Select the core of a new thread
+ *
+ * @param mask Preferred cores or NULL. If none of them is available,
+ * any other core is used.
+ */
+static uint32_t get_next_core_id(const cpumask_t* mask)
 {
 	uint32_t i;
 	static uint32_t core_id = MAX_CORES;
@@ -415,11 +769,16 @@ static uint32_t get_next_core_id(void)
 
 	// we assume OpenMP applications
 	// => number of threads is (normaly) equal to the number of cores
-	// => search next available core
+	// => search next available core, the preferred cores first
+	for(i=0, core_id=(core_id+1)%MAX_CORES; mask && (i<MAX_CORES); i++, core_id=(core_id+1)%MAX_CORES)
+		if (readyqueues[core_id].idle && cpumask_test(mask, core_id))
+			goto out;
+
 	for(i=0, core_id=(core_id+1)%MAX_CORES; i<2*MAX_CORES; i++, core_id=(core_id+1)%MAX_CORES)
 		if (readyqueues[core_id].idle)
 			break;
 
+out:
 	if (BUILTIN_EXPECT(!readyqueues[core_id].idle, 0)) {
 		LOG_ERROR("BUG: no core available!\n");
 		return MAX_CORES;
@@ -429,14 +788,13 @@ static uint32_t get_next_core_id(void)
 }
 
 
-int clone_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio)
+int clone_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio, int32_t node)
 {
 	int ret = -EINVAL;
-	uint32_t i;
-	void* stack = NULL;
-	void* ist = NULL;
+	task_t* task;
 	task_t* curr_task;
 	uint32_t core_id;
+	cpumask_t mask;
 
 	if (BUILTIN_EXPECT(!ep, 0))
 		return -EINVAL;
@@ -444,87 +802,73 @@ int clone_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio)
 		return -EINVAL;
 	if (BUILTIN_EXPECT(prio > MAX_PRIO, 0))
 		return -EINVAL;
+	if (BUILTIN_EXPECT((node != NUMA_NO_NODE) && ((node < 0) || ((uint32_t) node >= numa_nodes())), 0))
+		return -EINVAL;
+	if (node != NUMA_NO_NODE)
+		numa_node_cpus(node, &mask);
 
 	curr_task = per_core(current_task);
 
-	stack = create_stack(DEFAULT_STACK_SIZE);
-	if (BUILTIN_EXPECT(!stack, 0))
+	task = task_slot_alloc();
+	if (BUILTIN_EXPECT(!task, 0))
 		return -ENOMEM;
 
-	ist =  create_stack(KERNEL_STACK_SIZE);
-	if (BUILTIN_EXPECT(!ist, 0)) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		return -ENOMEM;
-	}
+	ret = task_slot_stacks(task);
+	if (BUILTIN_EXPECT(ret, 0))
+		goto out;
 
 	spinlock_irqsave_lock(&table_lock);
+	core_id = get_next_core_id((node != NUMA_NO_NODE) ? &mask : NULL);
+	spinlock_irqsave_unlock(&table_lock);
 
-	core_id = get_next_core_id();
-	if (BUILTIN_EXPECT(core_id >= MAX_CORES, 0))
-	{
-		spinlock_irqsave_unlock(&table_lock);
+	if (BUILTIN_EXPECT(core_id >= MAX_CORES, 0)) {
 		ret = -EINVAL;
 		goto out;
 	}
 
-	for(i=0; i<MAX_TASKS; i++) {
-		if (task_table[i].status == TASK_INVALID) {
-			task_table[i].id = i;
-			task_table[i].status = TASK_READY;
-			task_table[i].last_core = core_id;
-			task_table[i].last_stack_pointer = NULL;
-			task_table[i].stack = stack;
-			task_table[i].prio = prio;
-			task_table[i].heap = curr_task->heap;
-			task_table[i].start_tick = get_clock_tick();
-			task_table[i].last_tsc = 0;
-			task_table[i].parent = curr_task->id;
-			task_table[i].tls_addr = curr_task->tls_addr;
-			task_table[i].tls_size = curr_task->tls_size;
-			task_table[i].ist_addr = ist;
-			task_table[i].lwip_err = 0;
-			task_table[i].signal_handler = NULL;
-
-			if (id)
-				*id = i;
-
-			ret = create_default_frame(task_table+i, ep, arg, core_id);
-			if (ret)
-				goto out;
-
-                        // add task in the readyqueues
-			spinlock_irqsave_lock(&readyqueues[core_id].lock);
-			readyqueues[core_id].prio_bitmap |= (1 << prio);
-			readyqueues[core_id].nr_tasks++;
-			if (!readyqueues[core_id].queue[prio-1].first) {
-				task_table[i].next = task_table[i].prev = NULL;
-				readyqueues[core_id].queue[prio-1].first = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			} else {
-				task_table[i].prev = readyqueues[core_id].queue[prio-1].last;
-				task_table[i].next = NULL;
-				readyqueues[core_id].queue[prio-1].last->next = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			}
-			// should we wakeup the core?
-			if (readyqueues[core_id].nr_tasks == 1)
-				wakeup_core(core_id);
-			spinlock_irqsave_unlock(&readyqueues[core_id].lock);
- 			break;
-		}
-	}
+	task->id = task - task_table;
+	task->last_core = core_id;
+	task->last_stack_pointer = NULL;
+	task->prio = prio;
+	task->heap = curr_task->heap;
+	task->start_tick = get_clock_tick();
+	task->last_tsc = 0;
+	task->parent = curr_task->id;
+	task->tls_addr = curr_task->tls_addr;
+	task->tls_size = curr_task->tls_size;
+	task->lwip_err = 0;
+	task->signal_handler = NULL;
+	task->on_cpu = 0;
+	task->sem_queued = 0;
+	task->sem_next = NULL;
+
+	ret = create_default_frame(task, ep, arg, core_id);
+	if (ret)
+		goto out;
 
-	spinlock_irqsave_unlock(&table_lock);
+	if (id)
+		*id = task->id;
 
-	if (!ret) {
-		LOG_DEBUG("start new thread %d on core %d with stack address %p\n", i, core_id, stack);
-	}
+	task->status = TASK_READY;
+
+	// add task in the readyqueues
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	readyqueues_push_back(core_id, task);
+	readyqueues[core_id].nr_tasks++;
+	// should we wakeup the core?
+	if (readyqueues[core_id].nr_tasks == 1)
+		wakeup_core(core_id);
+#ifdef WORK_STEALING
+	kick_idle_core(core_id);
+#endif
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	LOG_DEBUG("start new thread %d on core %d with stack address %p\n", task->id, core_id, task->stack);
+
+	return 0;
 
 out:
-	if (ret) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		destroy_stack(ist, KERNEL_STACK_SIZE);
-	}
+	task_slot_release(task);
 
 	return ret;
 }
@@ -533,10 +877,7 @@ out:
 int create_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio, uint32_t core_id)
 {
 	int ret = -ENOMEM;
-	uint32_t i;
-	void* stack = NULL;
-	void* ist = NULL;
-	void* counter = NULL;
+	task_t* task;
 
 	if (BUILTIN_EXPECT(!ep, 0))
 		return -EINVAL;
@@ -549,81 +890,51 @@ int create_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio, uint32_t c
 	if (BUILTIN_EXPECT(!readyqueues[core_id].idle, 0))
 		return -EINVAL;
 
-	stack = create_stack(DEFAULT_STACK_SIZE);
-	if (BUILTIN_EXPECT(!stack, 0))
+	task = task_slot_alloc();
+	if (BUILTIN_EXPECT(!task, 0))
 		return -ENOMEM;
 
-	ist = create_stack(KERNEL_STACK_SIZE);
-	if (BUILTIN_EXPECT(!ist, 0)) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		return -ENOMEM;
-	}
+	ret = task_slot_stacks(task);
+	if (BUILTIN_EXPECT(ret, 0))
+		goto out;
 
-	counter = kmalloc(sizeof(atomic_int64_t));
-	if (BUILTIN_EXPECT(!counter, 0)) {
-		destroy_stack(stack, KERNEL_STACK_SIZE);
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		return -ENOMEM;
-	}
-	atomic_int64_set((atomic_int64_t*) counter, 0);
+	task->id = task - task_table;
+	task->last_core = core_id;
+	task->last_stack_pointer = NULL;
+	task->prio = prio;
+	task->heap = NULL;
+	task->start_tick = get_clock_tick();
+	task->last_tsc = 0;
+	task->parent = 0;
+	task->tls_addr = 0;
+	task->tls_size = 0;
+	task->lwip_err = 0;
+	task->signal_handler = NULL;
+	task->on_cpu = 0;
+	task->sem_queued = 0;
+	task->sem_next = NULL;
+
+	ret = create_default_frame(task, ep, arg, core_id);
+	if (ret)
+		goto out;
 
-	spinlock_irqsave_lock(&table_lock);
+	if (id)
+		*id = task->id;
 
-	for(i=0; i<MAX_TASKS; i++) {
-		if (task_table[i].status == TASK_INVALID) {
-			task_table[i].id = i;
-			task_table[i].status = TASK_READY;
-			task_table[i].last_core = core_id;
-			task_table[i].last_stack_pointer = NULL;
-			task_table[i].stack = stack;
-			task_table[i].prio = prio;
-			task_table[i].heap = NULL;
-			task_table[i].start_tick = get_clock_tick();
-			task_table[i].last_tsc = 0;
-			task_table[i].parent = 0;
-			task_table[i].ist_addr = ist;
-			task_table[i].tls_addr = 0;
-			task_table[i].tls_size = 0;
-			task_table[i].lwip_err = 0;
-			task_table[i].signal_handler = NULL;
-
-			if (id)
-				*id = i;
-
-			ret = create_default_frame(task_table+i, ep, arg, core_id);
-			if (ret)
-				goto out;
-
-			// add task in the readyqueues
-			spinlock_irqsave_lock(&readyqueues[core_id].lock);
-			readyqueues[core_id].prio_bitmap |= (1 << prio);
-			readyqueues[core_id].nr_tasks++;
-			if (!readyqueues[core_id].queue[prio-1].first) {
-				task_table[i].next = task_table[i].prev = NULL;
-				readyqueues[core_id].queue[prio-1].first = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			} else {
-				task_table[i].prev = readyqueues[core_id].queue[prio-1].last;
-				task_table[i].next = NULL;
-				readyqueues[core_id].queue[prio-1].last->next = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			}
-			spinlock_irqsave_unlock(&readyqueues[core_id].lock);
-			break;
-		}
-	}
+	task->status = TASK_READY;
 
-	if (!ret)
-		LOG_INFO("start new task %d on core %d with stack address %p\n", i, core_id, stack);
+	// add task in the readyqueues
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	readyqueues_push_back(core_id, task);
+	readyqueues[core_id].nr_tasks++;
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
 
-out:
-	spinlock_irqsave_unlock(&table_lock);
+	LOG_INFO("start new task %d on core %d with stack address %p\n", task->id, core_id, task->stack);
 
-	if (ret) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		destroy_stack(ist, KERNEL_STACK_SIZE);
-		kfree(counter);
-	}
+	return 0;
+
+out:
+	task_slot_release(task);
 
 	return ret;
 }
@@ -683,6 +994,9 @@ int wakeup_task(tid_t id)
 		// should we wakeup the core?
 		if (readyqueues[core_id].nr_tasks == 1)
 			wakeup_core(core_id);
+#ifdef WORK_STEALING
+		kick_idle_core(core_id);
+#endif
 
 		LOG_DEBUG("update nr_tasks on core %d to %d\n", core_id, readyqueues[core_id].nr_tasks);
 
@@ -775,21 +1089,21 @@ void check_timers(void)
 	readyqueues_t* readyqueue = &readyqueues[CORE_ID];
 	spinlock_irqsave_lock(&readyqueue->lock);
 
-	// since IRQs are disabled, get_clock_tick() won't increase here
-	const uint64_t current_tick = get_clock_tick();
+	const uint64_t now = get_timer_clock();
 
 	// wakeup tasks whose deadline has expired
 	task_t* task;
-	while ((task = readyqueue->timers.first) && (task->timeout <= current_tick))
+	while ((task = readyqueue->timers) && (task->timeout <= now))
 	{
 		// pops task from timer queue, so next iteration has new first element
 		wakeup_task(task->id);
+		readyqueue->nr_timer_expires++;
 	}
 
 #ifdef DYNAMIC_TICKS
-	task = readyqueue->timers.first;
+	task = readyqueue->timers;
 	if (task) {
-		update_timer(task);
+		update_timer(CORE_ID, task);
 	}
 #endif
 
@@ -862,6 +1176,8 @@ size_t** scheduler(void)
 			readyqueues[core_id].prio_bitmap &= ~(1 << prio);
 		}
 
+		task_cpus_add(core_id);
+
 		// finally make it the new current task
 		curr_task->status = TASK_RUNNING;
 #ifdef DYNAMIC_TICKS
@@ -871,6 +1187,11 @@ size_t** scheduler(void)
 	}
 
 get_task_out:
+	if (curr_task != orig_task) {
+		curr_task->on_cpu = 1;
+		readyqueues[core_id].prev_task = orig_task;
+	}
+
 	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
 
 	if (curr_task != orig_task) {
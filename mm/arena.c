@@ -0,0 +1,720 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Scalable allocator for the application heap.
+ *
+ * Every core owns an arena of 64 KiB spans, which are carved out of the
+ * heap VMA by sys_sbrk(). A span is aligned to its size and holds objects
+ * of a single size class. The owner allocates and frees without any lock,
+ * objects freed by other cores are pushed onto a lock-free list of the
+ * span and are collected by the owner, when its local list runs dry.
+ *
+ * Spans are taken from whole regions of ARENA_REFILL bytes, which are
+ * marked in span_regions. Requests larger than ARENA_MAX_SIZE get their
+ * own page-granular range of the heap. Freed ranges are merged in an
+ * address-ordered list and stay mapped for the next large objects. If
+ * more than ARENA_TRIM bytes were freed without being reused, the huge
+ * pages of all free ranges are returned by sys_madvise(MADV_DONTNEED).
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/syscall.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <hermit/spinlock.h>
+#include <asm/atomic.h>
+#include <asm/irqflags.h>
+#include <asm/processor.h>
+#include <asm/page.h>
+
+extern const void kernel_start;
+
+#define ARENA_SPAN_BITS		16
+#define ARENA_SPAN_SIZE		(1UL << ARENA_SPAN_BITS)
+#define ARENA_SPAN_MASK		(~(ARENA_SPAN_SIZE - 1))
+/// Size of the heap extension, which is split into spans (a huge page)
+#define ARENA_REFILL		(32 * ARENA_SPAN_SIZE)
+#define ARENA_REGIONS		(HEAP_SIZE / ARENA_REFILL)
+/// Minimal alignment of all objects
+#define ARENA_ALIGN		16
+/// Largest object, which is served from a span
+#define ARENA_MAX_SIZE		(8UL << 10)
+/// Number of size classes (see arena_class())
+#define ARENA_CLASSES		32
+#define ARENA_MAGIC		0xA4E7A000UL
+/// Freed bytes of large objects, which stay mapped until the free ranges are trimmed
+#define ARENA_TRIM		(32UL << 20)
+
+/// Span got its size class and is linked in the list of the owner
+#define SPAN_LISTED		0
+/// Span has no free objects and is unlinked
+#define SPAN_FULL		1
+/// Span got objects from another core and waits on the reclaim list
+#define SPAN_RECLAIM		2
+
+typedef struct arena_span {
+	/// next span of the same size class (or next unused span)
+	struct arena_span* next;
+	/// next span on the reclaim list of the owner
+	struct arena_span* reclaim;
+	/// objects freed by the owner
+	void* free;
+	/// objects freed by other cores (lock-free stack)
+	atomic_int64_t remote;
+	/// SPAN_LISTED, SPAN_FULL or SPAN_RECLAIM
+	atomic_int64_t state;
+	/// first object, which was never handed out
+	size_t bump;
+	/// size of the objects
+	uint32_t size;
+	/// size class
+	uint16_t class;
+	/// core, which owns the span
+	uint16_t owner;
+	/// ARENA_MAGIC
+	size_t magic;
+} __attribute__ ((aligned (CACHE_LINE))) arena_span_t;
+
+typedef struct arena {
+	/// spans with free objects per size class
+	arena_span_t* spans[ARENA_CLASSES];
+	/// spans, which got objects back from other cores
+	atomic_int64_t reclaim;
+	/// unused spans
+	arena_span_t* empty;
+	/// statistics
+	uint64_t allocs, frees, remote_frees, nr_spans;
+} arena_t;
+
+/// Header in front of a large object
+typedef struct arena_large {
+	/// page-aligned range, which holds the object
+	size_t start;
+	size_t end;
+	/// size requested by the application
+	size_t size;
+} arena_large_t;
+
+/// Free range of the heap for large objects
+typedef struct arena_range {
+	size_t start;
+	size_t end;
+	struct arena_range* next;
+} arena_range_t;
+
+static arena_t* arenas[MAX_CORES] = {[0 ... MAX_CORES-1] = NULL};
+/// regions of the heap, which are split into spans (set under large_lock)
+static uint8_t span_regions[ARENA_REGIONS / 8] = {[0 ... ARENA_REGIONS/8-1] = 0};
+/// free ranges for large objects, sorted by their address
+static arena_range_t* large_free = NULL;
+static spinlock_t large_lock = SPINLOCK_INIT;
+/// bytes of large objects, which were freed and not reused since the last trim (large_lock)
+static size_t large_retained = 0;
+
+/** @brief Size class of an object
+ *
+ * Sizes up to 128 byte are rounded to multiples of 16, larger ones use
+ * four classes per power of two.
+ */
+static inline uint32_t arena_class(size_t size)
+{
+	size_t exp;
+
+	if (size <= 128)
+		return size ? (size - 1) / 16 : 0;
+
+	exp = msb(size - 1);
+
+	return 8 + (exp - 7) * 4 + ((size - 1 - (1UL << exp)) >> (exp - 2));
+}
+
+/** @brief Object size of a size class */
+static inline uint32_t arena_class_size(uint32_t class)
+{
+	uint32_t exp;
+
+	if (class < 8)
+		return (class + 1) * 16;
+
+	exp = 7 + (class - 8) / 4;
+
+	return (1UL << exp) + ((class - 8) % 4 + 1) * (1UL << (exp - 2));
+}
+
+/** @brief Is ptr an object of a span? */
+static inline arena_span_t* arena_span(void* ptr)
+{
+	size_t addr = (size_t) ptr;
+	size_t region;
+	arena_span_t* span;
+
+	if ((addr < HEAP_START) || (addr >= HEAP_START + HEAP_SIZE))
+		return NULL;
+
+	// large objects never share a region with spans
+	region = (addr - HEAP_START) / ARENA_REFILL;
+	if (!(span_regions[region / 8] & (1 << (region % 8))))
+		return NULL;
+
+	span = (arena_span_t*) (addr & ARENA_SPAN_MASK);
+	if (BUILTIN_EXPECT(span->magic != ARENA_MAGIC, 0))
+		return NULL;
+
+	return span;
+}
+
+/** @brief Get the arena of the current core (irqs have to be disabled) */
+static arena_t* arena_get(void)
+{
+	arena_t* arena = arenas[CORE_ID];
+
+	if (BUILTIN_EXPECT(!arena, 0)) {
+		arena = (arena_t*) kmalloc(sizeof(arena_t));
+		if (BUILTIN_EXPECT(!arena, 0))
+			return NULL;
+		memset(arena, 0x00, sizeof(arena_t));
+		arenas[CORE_ID] = arena;
+	}
+
+	return arena;
+}
+
+/** @brief Link spans, which were refilled by other cores, into their size class */
+static void arena_reclaim(arena_t* arena)
+{
+	arena_span_t* span = (arena_span_t*) atomic_int64_test_and_set(&arena->reclaim, 0);
+	arena_span_t* next;
+
+	while(span) {
+		next = span->reclaim;
+
+		atomic_int64_set(&span->state, SPAN_LISTED);
+		span->next = arena->spans[span->class];
+		arena->spans[span->class] = span;
+
+		span = next;
+	}
+}
+
+/** @brief Take an object from a span of the current core */
+static inline void* arena_span_pop(arena_span_t* span)
+{
+	void* obj = span->free;
+
+	if (!obj && atomic_int64_read(&span->remote))
+		obj = (void*) atomic_int64_test_and_set(&span->remote, 0);
+
+	if (obj) {
+		span->free = *((void**) obj);
+		return obj;
+	}
+
+	if (span->bump + span->size <= (size_t) span + ARENA_SPAN_SIZE) {
+		obj = (void*) span->bump;
+		span->bump += span->size;
+	}
+
+	return obj;
+}
+
+/** @brief Allocate an object of the given class from the arena (irqs have to be disabled) */
+static void* arena_alloc(arena_t* arena, uint32_t class)
+{
+	arena_span_t* span;
+	void* obj;
+
+	if (atomic_int64_read(&arena->reclaim))
+		arena_reclaim(arena);
+
+	while((span = arena->spans[class]) != NULL) {
+		obj = arena_span_pop(span);
+		if (obj)
+			goto out;
+
+		// span is exhausted => unlink it until an object returns
+		arena->spans[class] = span->next;
+		atomic_int64_test_and_set(&span->state, SPAN_FULL);
+		mb();
+
+		// a remote free could have missed the state change
+		if (atomic_int64_read(&span->remote)
+		    && (atomic_int64_cmpxchg(&span->state, SPAN_FULL, SPAN_LISTED) == SPAN_FULL)) {
+			span->next = arena->spans[class];
+			arena->spans[class] = span;
+		}
+	}
+
+	// initialize an unused span
+	span = arena->empty;
+	if (!span)
+		return NULL;
+
+	arena->empty = span->next;
+	span->next = NULL;
+	span->reclaim = NULL;
+	span->free = NULL;
+	atomic_int64_set(&span->remote, 0);
+	atomic_int64_set(&span->state, SPAN_LISTED);
+	span->bump = (size_t) span + sizeof(arena_span_t);
+	span->size = arena_class_size(class);
+	span->class = class;
+	span->owner = CORE_ID;
+	span->magic = ARENA_MAGIC;
+	arena->spans[class] = span;
+	arena->nr_spans++;
+
+	obj = arena_span_pop(span);
+
+out:
+	arena->allocs++;
+
+	return obj;
+}
+
+/** @brief Return a range for large objects to the free list (large_lock held)
+ *
+ * The range is merged with its neighbours and all huge pages, which are
+ * completely free afterwards, are returned to the system.
+ */
+static void arena_range_put(size_t start, size_t end)
+{
+	arena_range_t* prev = NULL;
+	arena_range_t* next = large_free;
+	arena_range_t* range;
+
+	if (BUILTIN_EXPECT(start >= end, 0))
+		return;
+
+	while(next && (next->start < start)) {
+		prev = next;
+		next = next->next;
+	}
+
+	if (prev && (prev->end == start)) {
+		range = prev;
+		range->end = end;
+	} else {
+		range = (arena_range_t*) kmalloc(sizeof(arena_range_t));
+		if (BUILTIN_EXPECT(!range, 0)) {
+			// the range is lost, but its pages are still returned
+			LOG_WARNING("arena: unable to track the free range 0x%zx - 0x%zx\n", start, end);
+			sys_madvise((void*) start, end - start, MADV_DONTNEED);
+			return;
+		}
+
+		range->start = start;
+		range->end = end;
+		range->next = next;
+		if (prev)
+			prev->next = range;
+		else
+			large_free = range;
+	}
+
+	if (next && (range->end == next->start)) {
+		range->end = next->end;
+		range->next = next->next;
+		kfree(next);
+	}
+}
+
+/** @brief Return the huge pages of all free ranges to the system (large_lock held)
+ *
+ * The pages are mapped again on the next touch. Their content is undefined.
+ */
+static void arena_trim(void)
+{
+	arena_range_t* r;
+
+	for(r=large_free; r; r=r->next) {
+		if (HUGE_PAGE_FLOOR(r->end) > HUGE_PAGE_CEIL(r->start))
+			sys_madvise((void*) HUGE_PAGE_CEIL(r->start),
+				HUGE_PAGE_FLOOR(r->end) - HUGE_PAGE_CEIL(r->start), MADV_DONTNEED);
+	}
+
+	large_retained = 0;
+}
+
+/** @brief Take [start, end) out of the free range r (large_lock held) */
+static void arena_range_take(arena_range_t* r, arena_range_t* prev, size_t start, size_t end)
+{
+	arena_range_t* tail;
+
+	if (end < r->end) {
+		if (start == r->start) {
+			r->start = end;
+			return;
+		}
+
+		tail = (arena_range_t*) kmalloc(sizeof(arena_range_t));
+		if (BUILTIN_EXPECT(!tail, 0)) {
+			// keep the front part, the tail is lost
+			LOG_WARNING("arena: unable to track the free range 0x%zx - 0x%zx\n", end, r->end);
+			r->end = start;
+			return;
+		}
+
+		tail->start = end;
+		tail->end = r->end;
+		tail->next = r->next;
+		r->next = tail;
+	}
+
+	if (start > r->start) {
+		r->end = start;
+		return;
+	}
+
+	if (prev)
+		prev->next = r->next;
+	else
+		large_free = r->next;
+	kfree(r);
+}
+
+/** @brief Place a large object into the range [start, end)
+ *
+ * @return Address of the object or 0, if the range is too small
+ */
+static inline size_t arena_large_fit(size_t start, size_t end, size_t size, size_t align)
+{
+	size_t addr = (start + sizeof(arena_large_t) + align - 1) & ~(align - 1);
+
+	if ((addr < start) || (addr + size < addr) || (PAGE_CEIL(addr + size) > end))
+		return 0;
+
+	return addr;
+}
+
+/** @brief Extend the heap and add the new spans to the arena of the current core */
+static int arena_refill(void)
+{
+	ssize_t cur, start, end, incr, region;
+	arena_t* arena;
+	arena_span_t* span;
+	uint8_t flags;
+
+	// spans get a whole, aligned region
+	while(1) {
+		cur = sys_sbrk(0);
+		if (BUILTIN_EXPECT(cur < 0, 0))
+			return -ENOMEM;
+
+		incr = ((ARENA_REFILL - (cur & (ARENA_REFILL-1))) & (ARENA_REFILL-1)) + ARENA_REFILL;
+		start = sys_sbrk(incr);
+		if (BUILTIN_EXPECT(start < 0, 0))
+			return -ENOMEM;
+		end = start + incr;
+
+		spinlock_lock(&large_lock);
+
+		if (start == cur) {
+			// the alignment gap serves large objects
+			start = end - ARENA_REFILL;
+			arena_range_put(PAGE_CEIL(cur), start);
+
+			region = (start - HEAP_START) / ARENA_REFILL;
+			span_regions[region / 8] |= (1 << (region % 8));
+
+			spinlock_unlock(&large_lock);
+			break;
+		}
+
+		// another core extended the heap in the meantime => try again
+		arena_range_put(PAGE_CEIL(start), PAGE_FLOOR(end));
+		spinlock_unlock(&large_lock);
+	}
+
+	flags = irq_nested_disable();
+
+	arena = arena_get();
+	if (BUILTIN_EXPECT(!arena, 0)) {
+		irq_nested_enable(flags);
+		return -ENOMEM;
+	}
+
+	for(; start < end; start += ARENA_SPAN_SIZE) {
+		span = (arena_span_t*) start;
+		span->magic = 0;
+		span->next = arena->empty;
+		arena->empty = span;
+	}
+
+	irq_nested_enable(flags);
+
+	return 0;
+}
+
+static void* arena_large_alloc(size_t size, size_t align)
+{
+	arena_range_t* prev = NULL;
+	arena_range_t* r;
+	arena_large_t* large;
+	ssize_t start, end, incr;
+	size_t addr = 0;
+
+	if (BUILTIN_EXPECT(size > (HEAP_SIZE >> 1), 0))
+		return NULL;
+	if (align < ARENA_ALIGN)
+		align = ARENA_ALIGN;
+
+	spinlock_lock(&large_lock);
+
+	// first fit
+	for(r=large_free; r; prev=r, r=r->next) {
+		addr = arena_large_fit(r->start, r->end, size, align);
+		if (addr)
+			break;
+	}
+
+	if (r) {
+		start = PAGE_FLOOR(addr - sizeof(arena_large_t));
+		end = PAGE_CEIL(addr + size);
+		arena_range_take(r, prev, start, end);
+
+		// the object reuses freed pages
+		large_retained -= (large_retained > end - start) ? end - start : large_retained;
+	} else {
+		// extend the heap, the pages are mapped on the first touch
+		incr = PAGE_CEIL(sizeof(arena_large_t) + size + align) + PAGE_SIZE;
+		start = sys_sbrk(incr);
+		if (BUILTIN_EXPECT(start < 0, 0)) {
+			spinlock_unlock(&large_lock);
+			return NULL;
+		}
+		end = start + incr;
+
+		// the extension includes the space for the alignment
+		addr = arena_large_fit(PAGE_CEIL(start), end, size, align);
+
+		// the rest of the extension serves further large objects
+		arena_range_put(PAGE_CEIL(start), PAGE_FLOOR(addr - sizeof(arena_large_t)));
+		arena_range_put(PAGE_CEIL(addr + size), PAGE_FLOOR(end));
+
+		start = PAGE_FLOOR(addr - sizeof(arena_large_t));
+		end = PAGE_CEIL(addr + size);
+	}
+
+	spinlock_unlock(&large_lock);
+
+	large = (arena_large_t*) addr - 1;
+	large->start = start;
+	large->end = end;
+	large->size = size;
+
+	return (void*) addr;
+}
+
+static void arena_large_free(void* ptr)
+{
+	arena_large_t* large = (arena_large_t*) ptr - 1;
+	const size_t start = large->start;
+	const size_t end = large->end;
+
+	spinlock_lock(&large_lock);
+
+	arena_range_put(start, end);
+
+	// malloc/free loops keep their pages
+	large_retained += end - start;
+	if (large_retained > ARENA_TRIM)
+		arena_trim();
+
+	spinlock_unlock(&large_lock);
+}
+
+void* sys_malloc(size_t size)
+{
+	arena_t* arena;
+	void* obj;
+	uint8_t flags;
+
+	if (size > ARENA_MAX_SIZE)
+		return arena_large_alloc(size, ARENA_ALIGN);
+
+	while(1) {
+		flags = irq_nested_disable();
+		arena = arena_get();
+		obj = arena ? arena_alloc(arena, arena_class(size)) : NULL;
+		irq_nested_enable(flags);
+
+		if (obj || !arena)
+			break;
+
+		// sys_sbrk takes the heap lock => refill with enabled interrupts
+		if (arena_refill() < 0)
+			break;
+	}
+
+	return obj;
+}
+
+void sys_free(void* ptr)
+{
+	arena_span_t* span;
+	arena_t* arena;
+	int64_t head;
+	uint8_t flags;
+
+	if (BUILTIN_EXPECT(!ptr, 0))
+		return;
+
+	span = arena_span(ptr);
+	if (!span) {
+		arena_large_free(ptr);
+		return;
+	}
+
+	flags = irq_nested_disable();
+
+	arena = arenas[CORE_ID];
+	if (span->owner == CORE_ID) {
+		*((void**) ptr) = span->free;
+		span->free = ptr;
+		arena->frees++;
+
+		if ((atomic_int64_read(&span->state) == SPAN_FULL)
+		    && (atomic_int64_cmpxchg(&span->state, SPAN_FULL, SPAN_LISTED) == SPAN_FULL)) {
+			span->next = arena->spans[span->class];
+			arena->spans[span->class] = span;
+		}
+	} else {
+		do {
+			head = atomic_int64_read(&span->remote);
+			*((int64_t*) ptr) = head;
+		} while(atomic_int64_cmpxchg(&span->remote, head, (int64_t) ptr) != head);
+
+		// hand a full span back to its owner
+		if (atomic_int64_cmpxchg(&span->state, SPAN_FULL, SPAN_RECLAIM) == SPAN_FULL) {
+			arena_t* owner = arenas[span->owner];
+
+			do {
+				head = atomic_int64_read(&owner->reclaim);
+				span->reclaim = (arena_span_t*) head;
+			} while(atomic_int64_cmpxchg(&owner->reclaim, head, (int64_t) span) != head);
+		}
+
+		if (arena)
+			arena->remote_frees++;
+	}
+
+	irq_nested_enable(flags);
+}
+
+size_t sys_malloc_usable_size(void* ptr)
+{
+	arena_span_t* span;
+
+	if (BUILTIN_EXPECT(!ptr, 0))
+		return 0;
+
+	span = arena_span(ptr);
+	if (span)
+		return span->size;
+
+	return ((arena_large_t*) ptr - 1)->size;
+}
+
+void* sys_calloc(size_t nmemb, size_t size)
+{
+	void* ptr;
+
+	if (BUILTIN_EXPECT(size && (nmemb > ((size_t) -1) / size), 0))
+		return NULL;
+
+	ptr = sys_malloc(nmemb * size);
+	if (ptr)
+		memset(ptr, 0x00, nmemb * size);
+
+	return ptr;
+}
+
+void* sys_realloc(void* ptr, size_t size)
+{
+	size_t old;
+	void* new;
+
+	if (!ptr)
+		return sys_malloc(size);
+
+	if (!size) {
+		sys_free(ptr);
+		return NULL;
+	}
+
+	old = sys_malloc_usable_size(ptr);
+	if ((size <= old) && ((size > ARENA_MAX_SIZE) || (arena_class_size(arena_class(size)) == old)))
+		return ptr;
+
+	new = sys_malloc(size);
+	if (BUILTIN_EXPECT(!new, 0))
+		return NULL;
+
+	memcpy(new, ptr, old < size ? old : size);
+	sys_free(ptr);
+
+	return new;
+}
+
+void* sys_memalign(size_t align, size_t size)
+{
+	if (BUILTIN_EXPECT(!align || (align & (align - 1)), 0))
+		return NULL;
+
+	if (align <= ARENA_ALIGN)
+		return sys_malloc(size);
+
+	return arena_large_alloc(size, align);
+}
+
+void sys_malloc_stats(void)
+{
+	uint64_t allocs = 0, frees = 0, remote_frees = 0, nr_spans = 0;
+	uint32_t i;
+
+	for(i=0; i<MAX_CORES; i++) {
+		arena_t* arena = arenas[i];
+
+		if (!arena)
+			continue;
+
+		LOG_INFO("arena %u: %llu allocs, %llu frees, %llu remote frees, %llu spans\n",
+			i, arena->allocs, arena->frees, arena->remote_frees, arena->nr_spans);
+
+		allocs += arena->allocs;
+		frees += arena->frees;
+		remote_frees += arena->remote_frees;
+		nr_spans += arena->nr_spans;
+	}
+
+	LOG_INFO("arenas: %llu allocs, %llu frees, %llu remote frees, %llu KiB in spans\n",
+		allocs, frees, remote_frees, (nr_spans * ARENA_SPAN_SIZE) >> 10);
+}
@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Memory mapped files
+ *
+ * Each mapping owns a virtual window, which is reserved by vma_alloc()
+ * with VMA_FILE and is aligned to FMAP_PAGE_SIZE. The page fault
+ * handler runs with disabled interrupts on its own stack and isn't
+ * allowed to wait for the proxy. Therefore, lazy filling requires
+ * positional I/O of uhyve, which is a single port access. A fault
+ * fills the page in the staging window under fmap_lock and maps it
+ * afterwards, other cores never see a partially read page. Without
+ * this support, sys_mmap() reads the whole file ahead of time.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/errno.h>
+#include <hermit/memory.h>
+#include <hermit/vma.h>
+#include <hermit/spinlock.h>
+#include <hermit/syscall.h>
+#include <hermit/logging.h>
+#include <hermit/fmap.h>
+#include <asm/page.h>
+#include <asm/processor.h>
+#include <asm/uhyve.h>
+
+#define FMAP_PAGE_SIZE		HUGE_PAGE_SIZE
+#define FMAP_PAGES		(FMAP_PAGE_SIZE >> PAGE_BITS)
+#define FMAP_PAGE_FLOOR(addr)	((addr) & ~(FMAP_PAGE_SIZE-1))
+#define FMAP_PAGE_CEIL(addr)	FMAP_PAGE_FLOOR((addr) + FMAP_PAGE_SIZE - 1)
+/// Maximum read-ahead of the page fault handler in pages
+#define FMAP_MAX_RA		4
+
+typedef struct fmap {
+	/// first address of the mapping
+	size_t start;
+	/// end of the mapping, aligned to FMAP_PAGE_SIZE
+	size_t end;
+	/// reserved window, including the alignment
+	size_t vma_start;
+	size_t vma_end;
+	/// host descriptor, -1 if all pages are read
+	int fd;
+	/// file offset of the first page
+	off_t offset;
+	/// mapped bytes of the file
+	size_t len;
+	/// page table bits of the mapping
+	size_t bits;
+	/// expected address of the next sequential fault
+	size_t next_fault;
+	/// current read-ahead in pages
+	uint32_t ra;
+	struct fmap* next;
+} fmap_t;
+
+static spinlock_irqsave_t fmap_lock = SPINLOCK_IRQSAVE_INIT;
+static fmap_t* maps = NULL;
+/// window of the page fault handler to fill a page (fmap_lock held)
+static size_t staging = 0;
+
+/** @brief Can the page fault handler read from the host? */
+static inline int fmap_lazy(void)
+{
+	return is_uhyve() && uhyve_has_pio();
+}
+
+static inline size_t fmap_get_page(void)
+{
+#ifdef __x86_64__
+	// aligned => mapped by a single page table entry
+	return get_huge_page();
+#else
+	return get_pages(FMAP_PAGES);
+#endif
+}
+
+/** @brief Map a page into a private window of the current core */
+static inline int fmap_map_local(size_t viraddr, size_t phyaddr)
+{
+#ifdef __x86_64__
+	// the window is only used under fmap_lock => no shootdown
+	return __page_map(viraddr, phyaddr, FMAP_PAGES, PG_GLOBAL|PG_RW, 0);
+#else
+	return page_map(viraddr, phyaddr, FMAP_PAGES, PG_GLOBAL|PG_RW);
+#endif
+}
+
+/** @brief Find the mapping of viraddr (fmap_lock held) */
+static fmap_t* fmap_lookup(size_t viraddr)
+{
+	fmap_t* m;
+
+	for(m=maps; m; m=m->next) {
+		if ((viraddr >= m->start) && (viraddr < m->end))
+			return m;
+	}
+
+	return NULL;
+}
+
+/** @brief Number of file bytes of the page at viraddr */
+static inline size_t fmap_page_len(fmap_t* m, size_t viraddr)
+{
+	size_t pos = viraddr - m->start;
+
+	if (pos >= m->len)
+		return 0;
+
+	return (m->len - pos > FMAP_PAGE_SIZE) ? FMAP_PAGE_SIZE : m->len - pos;
+}
+
+/** @brief Read a page from the host, the rest of the page is zeroed */
+static int fmap_read(char* buf, int fd, off_t offset, size_t len, int direct)
+{
+	size_t i;
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(len && (fd < 0), 0))
+		return -EBADF;
+
+	for(i=0; i<len; i+=ret) {
+		if (direct)
+			ret = __sys_pread_direct(fd, buf+i, len-i, offset+i);
+		else
+			ret = __sys_pread(fd, buf+i, len-i, offset+i);
+		if (ret < 0)
+			return ret;
+		// end of the file
+		if (!ret)
+			break;
+	}
+
+	memset(buf+i, 0x00, FMAP_PAGE_SIZE-i);
+
+	return 0;
+}
+
+/** @brief Fill and map the page at viraddr in the page fault handler (fmap_lock held) */
+static int fmap_fill(fmap_t* m, size_t viraddr)
+{
+	size_t phyaddr;
+	int ret;
+
+	if (BUILTIN_EXPECT(!staging || (m->fd < 0), 0))
+		return -EFAULT;
+
+	phyaddr = fmap_get_page();
+	if (BUILTIN_EXPECT(!phyaddr, 0))
+		return -ENOMEM;
+
+	if (BUILTIN_EXPECT(fmap_map_local(staging, phyaddr), 0)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = fmap_read((char*) staging, m->fd, m->offset + (viraddr - m->start), fmap_page_len(m, viraddr), 1);
+	if (BUILTIN_EXPECT(ret, 0)) {
+		LOG_ERROR("fmap: unable to read the page at %#lx: %d\n", viraddr, ret);
+		ret = -EFAULT;
+		goto out;
+	}
+
+	ret = page_map(viraddr, phyaddr, FMAP_PAGES, m->bits);
+	if (BUILTIN_EXPECT(ret, 0))
+		goto out;
+
+	return 0;
+
+out:
+	put_pages(phyaddr, FMAP_PAGES);
+
+	return ret;
+}
+
+int fmap_contains(size_t viraddr)
+{
+	int ret;
+
+	if (!maps)
+		return 0;
+
+	spinlock_irqsave_lock(&fmap_lock);
+	ret = fmap_lookup(viraddr) ? 1 : 0;
+	spinlock_irqsave_unlock(&fmap_lock);
+
+	return ret;
+}
+
+int fmap_fault(size_t viraddr)
+{
+	fmap_t* m;
+	size_t page;
+	uint32_t i;
+	int ret = 0;
+
+	spinlock_irqsave_lock(&fmap_lock);
+
+	m = fmap_lookup(viraddr);
+	if (BUILTIN_EXPECT(!m, 0)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	page = FMAP_PAGE_FLOOR(viraddr);
+
+	// filled by another core in the meantime?
+	if (virt_to_phys(page))
+		goto out;
+
+	// sequential faults double the read-ahead
+	if (page == m->next_fault)
+		m->ra = (m->ra * 2 > FMAP_MAX_RA) ? FMAP_MAX_RA : m->ra * 2;
+	else
+		m->ra = 1;
+
+	ret = fmap_fill(m, page);
+	if (BUILTIN_EXPECT(ret, 0))
+		goto out;
+
+	// read-ahead is best effort
+	for(i=1; (i<m->ra) && (page+i*FMAP_PAGE_SIZE < m->end); i++) {
+		if (virt_to_phys(page+i*FMAP_PAGE_SIZE))
+			continue;
+		if (fmap_fill(m, page+i*FMAP_PAGE_SIZE))
+			break;
+	}
+
+	m->next_fault = page + m->ra * FMAP_PAGE_SIZE;
+
+out:
+	spinlock_irqsave_unlock(&fmap_lock);
+
+	return ret;
+}
+
+int fmap_populate(size_t start, size_t end)
+{
+	size_t viraddr, window, buf, phyaddr, len, bits;
+	off_t offset;
+	fmap_t* m;
+	int fd, ret = 0;
+
+	// a private window, because the host may block
+	window = vma_alloc(2*FMAP_PAGE_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!window, 0))
+		return -ENOMEM;
+	buf = FMAP_PAGE_CEIL(window);
+
+	for(viraddr=FMAP_PAGE_FLOOR(start); viraddr<end; viraddr+=FMAP_PAGE_SIZE) {
+		spinlock_irqsave_lock(&fmap_lock);
+
+		m = fmap_lookup(viraddr);
+		if (BUILTIN_EXPECT(!m, 0)) {
+			spinlock_irqsave_unlock(&fmap_lock);
+			ret = -EINVAL;
+			break;
+		}
+
+		if (virt_to_phys(viraddr)) {
+			spinlock_irqsave_unlock(&fmap_lock);
+			continue;
+		}
+
+		fd = m->fd;
+		offset = m->offset + (viraddr - m->start);
+		len = fmap_page_len(m, viraddr);
+		bits = m->bits;
+
+		spinlock_irqsave_unlock(&fmap_lock);
+
+		phyaddr = fmap_get_page();
+		if (BUILTIN_EXPECT(!phyaddr, 0)) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		ret = page_map(buf, phyaddr, FMAP_PAGES, PG_GLOBAL|PG_RW);
+		if (!ret)
+			ret = fmap_read((char*) buf, fd, offset, len, 0);
+		if (BUILTIN_EXPECT(ret, 0)) {
+			put_pages(phyaddr, FMAP_PAGES);
+			break;
+		}
+
+		// the mapping may be removed or filled in the meantime
+		spinlock_irqsave_lock(&fmap_lock);
+		if (fmap_lookup(viraddr) && !virt_to_phys(viraddr))
+			ret = page_map(viraddr, phyaddr, FMAP_PAGES, bits);
+		else
+			ret = -EEXIST;
+		spinlock_irqsave_unlock(&fmap_lock);
+
+		if (ret) {
+			put_pages(phyaddr, FMAP_PAGES);
+			if (ret != -EEXIST)
+				break;
+			ret = 0;
+		}
+	}
+
+	page_unmap(buf, FMAP_PAGES);
+	vma_free(window, window + 2*FMAP_PAGE_SIZE);
+
+	return ret;
+}
+
+int fmap_unmap(size_t addr, size_t len)
+{
+	fmap_t* m;
+	fmap_t** prev;
+	size_t viraddr, phyaddr;
+
+	spinlock_irqsave_lock(&fmap_lock);
+
+	for(prev=&maps, m=maps; m; prev=&m->next, m=m->next) {
+		if (m->start == addr)
+			break;
+	}
+
+	// partial unmaps aren't supported
+	if (BUILTIN_EXPECT(!m || (len < m->len), 0)) {
+		spinlock_irqsave_unlock(&fmap_lock);
+		return -EINVAL;
+	}
+
+	*prev = m->next;
+
+	spinlock_irqsave_unlock(&fmap_lock);
+
+	for(viraddr=m->start; viraddr<m->end; viraddr+=FMAP_PAGE_SIZE) {
+		phyaddr = virt_to_phys(viraddr);
+		if (!phyaddr)
+			continue;
+
+		page_unmap(viraddr, FMAP_PAGES);
+		put_pages(phyaddr, FMAP_PAGES);
+	}
+
+	vma_free(m->vma_start, m->vma_end);
+	kfree(m);
+
+	return 0;
+}
+
+void fmap_close(int fd)
+{
+	size_t start, end;
+	fmap_t* m;
+
+	while(maps) {
+		spinlock_irqsave_lock(&fmap_lock);
+		for(m=maps; m && (m->fd != fd); m=m->next)
+			;
+		if (!m) {
+			spinlock_irqsave_unlock(&fmap_lock);
+			return;
+		}
+		start = m->start;
+		end = m->end;
+		spinlock_irqsave_unlock(&fmap_lock);
+
+		// the missing pages can't be read after the close
+		if (fmap_populate(start, end))
+			LOG_WARNING("fmap: unable to read the mapping at %#lx of fd %d\n", start, fd);
+
+		spinlock_irqsave_lock(&fmap_lock);
+		m = fmap_lookup(start);
+		if (m && (m->fd == fd))
+			m->fd = -1;
+		spinlock_irqsave_unlock(&fmap_lock);
+	}
+}
+
+int sys_mmap(void** addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+	size_t viraddr, size;
+	uint32_t vma_flags = VMA_READ|VMA_USER|VMA_CACHEABLE|VMA_FILE;
+	fmap_t* m;
+	int ret;
+
+	if (BUILTIN_EXPECT(!addr || !len, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT((offset < 0) || (offset & (PAGE_SIZE-1)), 0))
+		return -EINVAL;
+	// only file mappings at an address of the kernel's choice
+	if (BUILTIN_EXPECT(flags & (MAP_FIXED|MAP_ANONYMOUS), 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(!(flags & (MAP_SHARED|MAP_PRIVATE)), 0))
+		return -EINVAL;
+	// the pages are copies => writes never reach the file
+	if (BUILTIN_EXPECT((flags & MAP_SHARED) && (prot & PROT_WRITE), 0))
+		return -EOPNOTSUPP;
+	if (BUILTIN_EXPECT(fd < 0, 0))
+		return -EBADF;
+
+	if (fmap_lazy() && !staging) {
+		viraddr = vma_alloc(2*FMAP_PAGE_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+		if (BUILTIN_EXPECT(!viraddr, 0))
+			return -ENOMEM;
+
+		spinlock_irqsave_lock(&fmap_lock);
+		if (!staging) {
+			staging = FMAP_PAGE_CEIL(viraddr);
+			viraddr = 0;
+		}
+		spinlock_irqsave_unlock(&fmap_lock);
+
+		if (viraddr)
+			vma_free(viraddr, viraddr + 2*FMAP_PAGE_SIZE);
+	}
+
+	m = kmalloc(sizeof(fmap_t));
+	if (BUILTIN_EXPECT(!m, 0))
+		return -ENOMEM;
+
+	if (prot & PROT_WRITE)
+		vma_flags |= VMA_WRITE;
+	if (prot & PROT_EXEC)
+		vma_flags |= VMA_EXECUTE;
+
+	// one additional page for the alignment
+	size = FMAP_PAGE_CEIL(len);
+	viraddr = vma_alloc(size + FMAP_PAGE_SIZE, vma_flags);
+	if (BUILTIN_EXPECT(!viraddr, 0)) {
+		kfree(m);
+		return -ENOMEM;
+	}
+
+	memset(m, 0x00, sizeof(fmap_t));
+	m->vma_start = viraddr;
+	m->vma_end = viraddr + size + FMAP_PAGE_SIZE;
+	m->start = FMAP_PAGE_CEIL(viraddr);
+	m->end = m->start + size;
+	m->fd = fd;
+	m->offset = offset;
+	m->len = len;
+	m->ra = 1;
+	// the first page is read by sys_mmap()
+	m->next_fault = m->start + FMAP_PAGE_SIZE;
+	m->bits = PG_USER;
+	if (prot & PROT_WRITE)
+		m->bits |= PG_RW;
+#ifdef PG_XD
+	if (!(prot & PROT_EXEC) && has_nx())
+		m->bits |= PG_XD;
+#endif
+
+	spinlock_irqsave_lock(&fmap_lock);
+	m->next = maps;
+	maps = m;
+	spinlock_irqsave_unlock(&fmap_lock);
+
+	// the first page checks the descriptor, the rest follows on demand
+	if (fmap_lazy())
+		ret = fmap_populate(m->start, m->start + FMAP_PAGE_SIZE);
+	else
+		ret = fmap_populate(m->start, m->end);
+
+	if (BUILTIN_EXPECT(ret, 0)) {
+		fmap_unmap(m->start, len);
+		return ret;
+	}
+
+	*addr = (void*) m->start;
+
+	return 0;
+}
@@ -30,14 +30,73 @@
  */
 
 #include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/processor.h>
 #include <hermit/malloc.h>
 #include <hermit/spinlock.h>
 #include <hermit/memory.h>
 #include <hermit/logging.h>
+#include <hermit/tasks.h>
 #include <asm/page.h>
+#include <asm/irqflags.h>
 
 /// A linked list for each binary size exponent
-static buddy_t* buddy_lists[BUDDY_LISTS] = { [0 ... BUDDY_LISTS-1] = NULL };
+static buddy_free_t* buddy_lists[BUDDY_LISTS] = { [0 ... BUDDY_LISTS-1] = NULL };
+
+/// Statistics of the buddy system (protected by hermit_mm_lock)
+static struct {
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t splits;
+	uint64_t merges;
+	uint64_t chunks;
+} buddy_stats = {0, 0, 0, 0, 0};
+
+/** @brief Per-core cache of free blocks for the small size classes
+ *
+ * Only the owning core accesses its magazines with disabled interrupts
+ * => no lock required
+ */
+typedef struct buddy_mag {
+	/// number of cached blocks per size class
+	uint32_t count[BUDDY_MAG_CLASSES];
+	/// cached blocks per size class
+	buddy_t* blocks[BUDDY_MAG_CLASSES][BUDDY_MAG_SIZE];
+	/// allocations served by the magazines
+	uint64_t hits;
+	/// allocations, which required a refill of the magazine
+	uint64_t misses;
+} buddy_mag_t;
+
+static buddy_mag_t* buddy_mags[MAX_CORES] = { [0 ... MAX_CORES-1] = NULL };
+
+#ifndef STACK_CACHE
+#define STACK_CACHE		16
+#endif
+
+/// Size classes of the stack cache
+#define STACK_USER		0
+#define STACK_KERNEL		1
+#define STACK_CLASSES		2
+
+/** @brief Per-core cache of mapped stacks
+ *
+ * The cached stacks are linked by a pointer at their lowest address.
+ * Only the owning core accesses its cache with disabled interrupts
+ * => no lock required
+ */
+typedef struct stack_cache {
+	/// first cached stack per size class
+	void* head[STACK_CLASSES];
+	/// number of cached stacks per size class
+	uint32_t count[STACK_CLASSES];
+	/// stacks served by the cache
+	uint64_t hits;
+	/// stacks, which had to be created
+	uint64_t misses;
+} stack_cache_t;
+
+static stack_cache_t stack_caches[MAX_CORES];
 
 extern spinlock_irqsave_t hermit_mm_lock;
 
@@ -53,82 +112,282 @@ static inline int buddy_large_avail(uint8_t exp)
 /** @brief Calculate the required buddy size */
 static inline int buddy_exp(size_t sz)
 {
-	int exp;
-	for (exp=0; sz>(1<<exp); exp++);
+	int exp = (sz > 1) ? msb(sz-1)+1 : 0;
 
+	// oversize requests have to be rejected
 	if (exp > BUDDY_MAX)
-		exp = 0;
+		return 0;
 	if (exp < BUDDY_MIN)
 		exp = BUDDY_MIN;
 
 	return exp;
 }
 
+static inline void buddy_list_push(buddy_free_t* buddy, int exp)
+{
+	buddy_free_t** list = &buddy_lists[exp-BUDDY_MIN];
+
+	buddy->hdr.prefix.exponent = exp;
+	buddy->hdr.prefix.magic = BUDDY_FREE;
+	buddy->prev = NULL;
+	buddy->next = *list;
+	if (*list)
+		(*list)->prev = buddy;
+	*list = buddy;
+}
+
+static inline void buddy_list_remove(buddy_free_t* buddy)
+{
+	buddy_free_t** list = &buddy_lists[buddy->hdr.prefix.exponent-BUDDY_MIN];
+
+	if (buddy->prev)
+		buddy->prev->next = buddy->next;
+	else
+		*list = buddy->next;
+	if (buddy->next)
+		buddy->next->prev = buddy->prev;
+
+	buddy->hdr.prefix.magic = 0;
+}
+
+/** @brief Allocate a chunk, which is aligned to its size */
+static buddy_t* buddy_chunk(int exp)
+{
+	size_t phyaddr, viraddr, start;
+	size_t sz = 1UL << exp;
+	uint32_t npages = sz >> PAGE_BITS;
+
+	// reserve twice the size to find an aligned region
+	start = vma_alloc(2*sz, VMA_HEAP);
+	if (BUILTIN_EXPECT(!start, 0))
+		return NULL;
+
+	viraddr = (start + sz - 1) & ~(sz - 1);
+	if (viraddr > start)
+		vma_free(start, viraddr);
+	if (viraddr + sz < start + 2*sz)
+		vma_free(viraddr + sz, start + 2*sz);
+
+	phyaddr = get_pages(npages);
+	if (BUILTIN_EXPECT(!phyaddr, 0)) {
+		vma_free(viraddr, viraddr+sz);
+		return NULL;
+	}
+
+	if (BUILTIN_EXPECT(page_map(viraddr, phyaddr, npages, PG_RW|PG_GLOBAL|PG_NX), 0)) {
+		vma_free(viraddr, viraddr+sz);
+		put_pages(phyaddr, npages);
+		return NULL;
+	}
+
+	buddy_stats.chunks++;
+
+	return (buddy_t*) viraddr;
+}
+
 /** @brief Get a free buddy by potentially splitting a larger one */
-static buddy_t* buddy_get(int exp)
+static buddy_t* __buddy_get(int exp)
 {
 	spinlock_irqsave_lock(&hermit_mm_lock);
-	buddy_t** list = &buddy_lists[exp-BUDDY_MIN];
-	buddy_t* buddy = *list;
-	buddy_t* split;
+	buddy_free_t* buddy = buddy_lists[exp-BUDDY_MIN];
+	buddy_free_t* split;
 
-	if (buddy)
+	if (buddy) {
 		// there is already a free buddy =>
 		// we remove it from the list
-		*list = buddy->next;
-	else if ((exp >= BUDDY_ALLOC) && !buddy_large_avail(exp))
+		buddy_list_remove(buddy);
+	} else if ((exp >= BUDDY_ALLOC) && !buddy_large_avail(exp)) {
 		// theres no free buddy larger than exp =>
 		// we can allocate new memory
-		buddy = (buddy_t*) palloc(1<<exp, VMA_HEAP|VMA_CACHEABLE);
-	else {
+		buddy = (buddy_free_t*) buddy_chunk(exp);
+		if (BUILTIN_EXPECT(!buddy, 0))
+			goto out;
+		buddy->hdr.prefix.chunk = exp;
+	} else {
 		// we recursivly request a larger buddy...
-		buddy = buddy_get(exp+1);
+		buddy = (buddy_free_t*) __buddy_get(exp+1);
 		if (BUILTIN_EXPECT(!buddy, 0))
 			goto out;
 
 		// ... and split it, by putting the second half back to the list
-		split = (buddy_t*) ((size_t) buddy + (1<<exp));
-		split->next = *list;
-		*list = split;
+		split = (buddy_free_t*) ((size_t) buddy + (1UL<<exp));
+		split->hdr.prefix.chunk = buddy->hdr.prefix.chunk;
+		buddy_list_push(split, exp);
+		buddy_stats.splits++;
 	}
 
+	buddy->hdr.prefix.exponent = exp;
+
 out:
 	spinlock_irqsave_unlock(&hermit_mm_lock);
 
+	return (buddy_t*) buddy;
+}
+
+static buddy_t* buddy_get(int exp)
+{
+	buddy_t* buddy;
+
+	spinlock_irqsave_lock(&hermit_mm_lock);
+	buddy = __buddy_get(exp);
+	if (buddy)
+		buddy_stats.allocs++;
+	spinlock_irqsave_unlock(&hermit_mm_lock);
+
 	return buddy;
 }
 
-/** @brief Put a buddy back to its free list
- *
- * TODO: merge adjacent buddies (memory compaction)
- */
-static void buddy_put(buddy_t* buddy)
+/** @brief Put a buddy back to its free list and merge it with its free buddies */
+static void buddy_put(buddy_t* block)
 {
+	buddy_free_t* buddy = (buddy_free_t*) block;
+	buddy_free_t* other;
+
 	spinlock_irqsave_lock(&hermit_mm_lock);
-	buddy_t** list = &buddy_lists[buddy->prefix.exponent-BUDDY_MIN];
-	buddy->next = *list;
-	*list = buddy;
+
+	int exp = buddy->hdr.prefix.exponent;
+	const int chunk = buddy->hdr.prefix.chunk;
+
+	buddy_stats.frees++;
+
+	// the buddy of a block lies always in the same chunk
+	while (exp < chunk) {
+		other = (buddy_free_t*) ((size_t) buddy ^ (1UL << exp));
+		if ((other->hdr.prefix.magic != BUDDY_FREE) || (other->hdr.prefix.exponent != exp))
+			break;
+
+		buddy_list_remove(other);
+		if (other < buddy)
+			buddy = other;
+		exp++;
+		buddy_stats.merges++;
+	}
+
+	buddy->hdr.prefix.chunk = chunk;
+	buddy_list_push(buddy, exp);
+
 	spinlock_irqsave_unlock(&hermit_mm_lock);
 }
 
+/** @brief Get a block of a small size class from the magazine of the current core */
+static buddy_t* buddy_mag_get(int exp)
+{
+	const int class = exp - BUDDY_MIN;
+	buddy_t* buddy = NULL;
+	buddy_mag_t* mag;
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+
+	mag = buddy_mags[CORE_ID];
+	if (BUILTIN_EXPECT(!mag, 0)) {
+		mag = (buddy_mag_t*) buddy_get(buddy_exp(sizeof(buddy_mag_t)));
+		if (BUILTIN_EXPECT(!mag, 0))
+			goto out;
+		memset(mag, 0x00, sizeof(buddy_mag_t));
+		buddy_mags[CORE_ID] = mag;
+	}
+
+	if (!mag->count[class]) {
+		// refill the half magazine
+		mag->misses++;
+		while(mag->count[class] < BUDDY_MAG_SIZE / 2) {
+			buddy = buddy_get(exp);
+			if (BUILTIN_EXPECT(!buddy, 0))
+				break;
+			buddy->prefix.magic = BUDDY_CACHED;
+			mag->blocks[class][mag->count[class]++] = buddy;
+		}
+
+		if (!mag->count[class]) {
+			buddy = NULL;
+			goto out;
+		}
+	} else mag->hits++;
+
+	buddy = mag->blocks[class][--mag->count[class]];
+	buddy->prefix.magic = BUDDY_MAGIC;
+
+out:
+	irq_nested_enable(flags);
+
+	return buddy;
+}
+
+/** @brief Put a block of a small size class into the magazine of the current core */
+static void buddy_mag_put(buddy_t* buddy)
+{
+	const int class = buddy->prefix.exponent - BUDDY_MIN;
+	buddy_mag_t* mag;
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+
+	mag = buddy_mags[CORE_ID];
+	if (BUILTIN_EXPECT(!mag, 0)) {
+		irq_nested_enable(flags);
+		buddy_put(buddy);
+		return;
+	}
+
+	if (mag->count[class] >= BUDDY_MAG_SIZE) {
+		// flush the half magazine to the buddy system
+		while(mag->count[class] > BUDDY_MAG_SIZE / 2)
+			buddy_put(mag->blocks[class][--mag->count[class]]);
+	}
+
+	// a second kfree() of the block fails the magic check
+	buddy->prefix.magic = BUDDY_CACHED;
+	mag->blocks[class][mag->count[class]++] = buddy;
+
+	irq_nested_enable(flags);
+}
+
 void buddy_dump(void)
 {
 	size_t free = 0;
-	int i;
+	size_t cached = 0;
+	uint64_t hits = 0, misses = 0;
+	int i, j;
 
 	for (i=0; i<BUDDY_LISTS; i++) {
-		buddy_t* buddy;
+		buddy_free_t* buddy;
 		int exp = i+BUDDY_MIN;
 
 		if (buddy_lists[i])
-			LOG_INFO("buddy_list[%u] (exp=%u, size=%lu bytes):\n", i, exp, 1<<exp);
+			LOG_INFO("buddy_list[%u] (exp=%u, size=%lu bytes):\n", i, exp, 1UL<<exp);
 
 		for (buddy=buddy_lists[i]; buddy; buddy=buddy->next) {
 			LOG_INFO("  %p -> %p \n", buddy, buddy->next);
-			free += 1<<exp;
+			free += 1UL<<exp;
 		}
 	}
+
+	for (i=0; i<MAX_CORES; i++) {
+		if (!buddy_mags[i])
+			continue;
+
+		for (j=0; j<BUDDY_MAG_CLASSES; j++)
+			cached += (size_t) buddy_mags[i]->count[j] << (j+BUDDY_MIN);
+		hits += buddy_mags[i]->hits;
+		misses += buddy_mags[i]->misses;
+	}
+
 	LOG_INFO("free buddies: %lu bytes\n", free);
+	LOG_INFO("cached in magazines: %lu bytes, %llu hits, %llu misses\n", cached, hits, misses);
+	LOG_INFO("buddy system: %llu allocs, %llu frees, %llu splits, %llu merges, %llu chunks\n",
+		buddy_stats.allocs, buddy_stats.frees, buddy_stats.splits,
+		buddy_stats.merges, buddy_stats.chunks);
+
+	cached = hits = misses = 0;
+	for (i=0; i<MAX_CORES; i++) {
+		for (j=0; j<STACK_CLASSES; j++)
+			cached += stack_caches[i].count[j];
+		hits += stack_caches[i].hits;
+		misses += stack_caches[i].misses;
+	}
+
+	LOG_INFO("stack cache: %lu stacks, %llu hits, %llu misses\n", cached, hits, misses);
 }
 
 void* palloc(size_t sz, uint32_t flags)
@@ -165,10 +424,70 @@ void* palloc(size_t sz, uint32_t flags)
 	return (void*) viraddr;
 }
 
+/** @brief Determine the size class of a stack (-1 => not cacheable) */
+static inline int stack_class(size_t sz)
+{
+	if (PAGE_CEIL(sz) == PAGE_CEIL(DEFAULT_STACK_SIZE))
+		return STACK_USER;
+	if (PAGE_CEIL(sz) == PAGE_CEIL(KERNEL_STACK_SIZE))
+		return STACK_KERNEL;
+
+	return -1;
+}
+
+/** @brief Take a stack from the cache of the current core */
+static void* stack_cache_get(int class)
+{
+	stack_cache_t* cache;
+	void* stack;
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+
+	cache = stack_caches + CORE_ID;
+	stack = cache->head[class];
+	if (stack) {
+		cache->head[class] = *((void**) stack);
+		cache->count[class]--;
+		cache->hits++;
+	} else cache->misses++;
+
+	irq_nested_enable(flags);
+
+	return stack;
+}
+
+/** @brief Put a stack into the cache of the current core
+ *
+ * @return 1, if the stack is cached. 0, if the cache is full.
+ */
+static int stack_cache_put(int class, void* stack)
+{
+	stack_cache_t* cache;
+	int ret = 0;
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+
+	cache = stack_caches + CORE_ID;
+	if (cache->count[class] < STACK_CACHE) {
+		*((void**) stack) = cache->head[class];
+		cache->head[class] = stack;
+		cache->count[class]++;
+		ret = 1;
+	}
+
+	irq_nested_enable(flags);
+
+	return ret;
+}
+
 void* create_stack(size_t sz)
 {
 	size_t phyaddr, viraddr, bits;
 	uint32_t npages = PAGE_CEIL(sz) >> PAGE_BITS;
+	int class = stack_class(sz);
+	void* stack;
 	int err;
 
 	LOG_DEBUG("create_stack(0x%zx) (%u pages)\n", DEFAULT_STACK_SIZE, npages);
@@ -176,6 +495,13 @@ void* create_stack(size_t sz)
 	if (BUILTIN_EXPECT(!sz, 0))
 		return NULL;
 
+	// reuse a mapped stack => no changes of the page tables
+	if (class >= 0) {
+		stack = stack_cache_get(class);
+		if (stack)
+			return stack;
+	}
+
 	// get free virtual address space
 	viraddr = vma_alloc((npages+2)*PAGE_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
 	if (BUILTIN_EXPECT(!viraddr, 0))
@@ -213,13 +539,18 @@ int destroy_stack(void* viraddr, size_t sz)
 	if (BUILTIN_EXPECT(!sz, 0))
 		return -EINVAL;
 
+	// keep the stack mapped => no TLB shootdown
+	if ((stack_class(sz) >= 0) && stack_cache_put(stack_class(sz), viraddr))
+		return 0;
+
 	phyaddr = virt_to_phys((size_t)viraddr);
 	if (BUILTIN_EXPECT(!phyaddr, 0))
 		return -ENOMEM;
 
 	// unmap and destroy stack
 	vma_free((size_t)viraddr-PAGE_SIZE, (size_t)viraddr+(npages+1)*PAGE_SIZE);
-	page_unmap((size_t)viraddr, npages);
+	// only the cores, which ran a task, may cache the stack
+	__page_unmap((size_t)viraddr, npages, get_task_cpus());
 	put_pages(phyaddr, npages);
 
 	return 0;
@@ -227,6 +558,8 @@ int destroy_stack(void* viraddr, size_t sz)
 
 void* kmalloc(size_t sz)
 {
+	buddy_t* buddy;
+
 	if (BUILTIN_EXPECT(!sz, 0))
 		return NULL;
 
@@ -237,7 +570,10 @@ void* kmalloc(size_t sz)
 	if (BUILTIN_EXPECT(!exp, 0))
 		return NULL;
 
-	buddy_t* buddy = buddy_get(exp);
+	if (exp <= BUDDY_MAG_MAX)
+		buddy = buddy_mag_get(exp);
+	else
+		buddy = buddy_get(exp);
 	if (BUILTIN_EXPECT(!buddy, 0))
 		return NULL;
 
@@ -264,5 +600,8 @@ void kfree(void *addr)
 	if (BUILTIN_EXPECT(buddy->prefix.magic != BUDDY_MAGIC, 0))
 		return;
 
-	buddy_put(buddy);
+	if (buddy->prefix.exponent <= BUDDY_MAG_MAX)
+		buddy_mag_put(buddy);
+	else
+		buddy_put(buddy);
 }
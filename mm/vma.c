@@ -39,16 +39,351 @@
  */
 extern const void kernel_start;
 
+#define VMA_RED		0
+#define VMA_BLACK	1
+
 /*
  * Kernel space VMA list and lock
  *
  * For bootstrapping we initialize the VMA list with one empty VMA
  * (start == end) and expand this VMA by calls to vma_alloc()
  */
-static vma_t vma_boot = { VMA_MIN, VMA_MIN, VMA_HEAP };
+static vma_t vma_boot = { VMA_MIN, VMA_MIN, VMA_HEAP, NULL, NULL, NULL, NULL, NULL, 0, VMA_BLACK };
 static vma_t* vma_list = &vma_boot;
+static vma_t* vma_root = &vma_boot;
+/// Incremented on each change of the VMAs (protected by hermit_mm_lock)
+static uint32_t vma_seq = 0;
 spinlock_irqsave_t hermit_mm_lock = SPINLOCK_IRQSAVE_INIT;
 
+/** @brief Size of the hole in front of a VMA, which is usable by vma_alloc() */
+static inline size_t vma_gap(vma_t* vma)
+{
+	size_t lower = (vma->prev && (vma->prev->end > VMA_MIN)) ? vma->prev->end : VMA_MIN;
+
+	return (vma->start > lower) ? vma->start - lower : 0;
+}
+
+static inline size_t vma_max_gap(vma_t* vma)
+{
+	return vma ? vma->max_gap : 0;
+}
+
+/** @brief Recalculate the largest hole of a subtree */
+static inline void vma_augment(vma_t* vma)
+{
+	size_t max = vma_gap(vma);
+
+	if (vma_max_gap(vma->left) > max)
+		max = vma_max_gap(vma->left);
+	if (vma_max_gap(vma->right) > max)
+		max = vma_max_gap(vma->right);
+
+	vma->max_gap = max;
+}
+
+/** @brief Recalculate the largest holes from a node up to the root */
+static void vma_augment_path(vma_t* vma)
+{
+	while (vma) {
+		vma_augment(vma);
+		vma = vma->parent;
+	}
+}
+
+static void vma_rotate_left(vma_t* x)
+{
+	vma_t* y = x->right;
+
+	x->right = y->left;
+	if (y->left)
+		y->left->parent = x;
+	y->parent = x->parent;
+	if (!x->parent)
+		vma_root = y;
+	else if (x == x->parent->left)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+	y->left = x;
+	x->parent = y;
+
+	vma_augment(x);
+	vma_augment(y);
+}
+
+static void vma_rotate_right(vma_t* x)
+{
+	vma_t* y = x->left;
+
+	x->left = y->right;
+	if (y->right)
+		y->right->parent = x;
+	y->parent = x->parent;
+	if (!x->parent)
+		vma_root = y;
+	else if (x == x->parent->right)
+		x->parent->right = y;
+	else
+		x->parent->left = y;
+	y->right = x;
+	x->parent = y;
+
+	vma_augment(x);
+	vma_augment(y);
+}
+
+/** @brief Insert a VMA behind pred (NULL => at the beginning) */
+static void vma_insert(vma_t* vma, vma_t* pred)
+{
+	vma_t* succ = pred ? pred->next : vma_list;
+
+	// link list
+	vma->prev = pred;
+	vma->next = succ;
+	if (succ)
+		succ->prev = vma;
+	if (pred)
+		pred->next = vma;
+	else
+		vma_list = vma;
+
+	// link tree, the successor doesn't have a left child, if pred has a right one
+	vma->left = vma->right = NULL;
+	vma->color = VMA_RED;
+	if (!vma_root) {
+		vma->parent = NULL;
+		vma_root = vma;
+	} else if (pred && !pred->right) {
+		pred->right = vma;
+		vma->parent = pred;
+	} else {
+		succ->left = vma;
+		vma->parent = succ;
+	}
+
+	vma_augment_path(vma);
+	if (succ)
+		vma_augment_path(succ);
+
+	// rebalance tree
+	while (vma->parent && (vma->parent->color == VMA_RED)) {
+		vma_t* gp = vma->parent->parent;
+
+		if (vma->parent == gp->left) {
+			vma_t* uncle = gp->right;
+
+			if (uncle && (uncle->color == VMA_RED)) {
+				vma->parent->color = VMA_BLACK;
+				uncle->color = VMA_BLACK;
+				gp->color = VMA_RED;
+				vma = gp;
+			} else {
+				if (vma == vma->parent->right) {
+					vma = vma->parent;
+					vma_rotate_left(vma);
+				}
+				vma->parent->color = VMA_BLACK;
+				gp->color = VMA_RED;
+				vma_rotate_right(gp);
+			}
+		} else {
+			vma_t* uncle = gp->left;
+
+			if (uncle && (uncle->color == VMA_RED)) {
+				vma->parent->color = VMA_BLACK;
+				uncle->color = VMA_BLACK;
+				gp->color = VMA_RED;
+				vma = gp;
+			} else {
+				if (vma == vma->parent->left) {
+					vma = vma->parent;
+					vma_rotate_right(vma);
+				}
+				vma->parent->color = VMA_BLACK;
+				gp->color = VMA_RED;
+				vma_rotate_left(gp);
+			}
+		}
+	}
+
+	vma_root->color = VMA_BLACK;
+	vma_seq++;
+}
+
+static void vma_transplant(vma_t* u, vma_t* v)
+{
+	if (!u->parent)
+		vma_root = v;
+	else if (u == u->parent->left)
+		u->parent->left = v;
+	else
+		u->parent->right = v;
+	if (v)
+		v->parent = u->parent;
+}
+
+/** @brief Remove a VMA from the list and the tree */
+static void vma_remove(vma_t* z)
+{
+	vma_t* succ = z->next;
+	vma_t *x, *x_parent, *y = z;
+	uint8_t color = z->color;
+
+	// unlink list
+	if (z->prev)
+		z->prev->next = z->next;
+	else
+		vma_list = z->next;
+	if (z->next)
+		z->next->prev = z->prev;
+
+	// unlink tree
+	if (!z->left) {
+		x = z->right;
+		x_parent = z->parent;
+		vma_transplant(z, z->right);
+	} else if (!z->right) {
+		x = z->left;
+		x_parent = z->parent;
+		vma_transplant(z, z->left);
+	} else {
+		// replace z by its successor
+		y = succ;
+		color = y->color;
+		x = y->right;
+		if (y->parent == z) {
+			x_parent = y;
+		} else {
+			x_parent = y->parent;
+			vma_transplant(y, y->right);
+			y->right = z->right;
+			y->right->parent = y;
+		}
+		vma_transplant(z, y);
+		y->left = z->left;
+		y->left->parent = y;
+		y->color = z->color;
+	}
+
+	vma_augment_path(x_parent);
+	if (succ)
+		vma_augment_path(succ);
+
+	// rebalance tree
+	if (color == VMA_BLACK) {
+		while ((x != vma_root) && (!x || (x->color == VMA_BLACK))) {
+			if (x == x_parent->left) {
+				vma_t* w = x_parent->right;
+
+				if (w->color == VMA_RED) {
+					w->color = VMA_BLACK;
+					x_parent->color = VMA_RED;
+					vma_rotate_left(x_parent);
+					w = x_parent->right;
+				}
+
+				if ((!w->left || (w->left->color == VMA_BLACK)) && (!w->right || (w->right->color == VMA_BLACK))) {
+					w->color = VMA_RED;
+					x = x_parent;
+					x_parent = x->parent;
+				} else {
+					if (!w->right || (w->right->color == VMA_BLACK)) {
+						w->left->color = VMA_BLACK;
+						w->color = VMA_RED;
+						vma_rotate_right(w);
+						w = x_parent->right;
+					}
+					w->color = x_parent->color;
+					x_parent->color = VMA_BLACK;
+					if (w->right)
+						w->right->color = VMA_BLACK;
+					vma_rotate_left(x_parent);
+					x = vma_root;
+					x_parent = NULL;
+				}
+			} else {
+				vma_t* w = x_parent->left;
+
+				if (w->color == VMA_RED) {
+					w->color = VMA_BLACK;
+					x_parent->color = VMA_RED;
+					vma_rotate_right(x_parent);
+					w = x_parent->left;
+				}
+
+				if ((!w->right || (w->right->color == VMA_BLACK)) && (!w->left || (w->left->color == VMA_BLACK))) {
+					w->color = VMA_RED;
+					x = x_parent;
+					x_parent = x->parent;
+				} else {
+					if (!w->left || (w->left->color == VMA_BLACK)) {
+						w->right->color = VMA_BLACK;
+						w->color = VMA_RED;
+						vma_rotate_left(w);
+						w = x_parent->left;
+					}
+					w->color = x_parent->color;
+					x_parent->color = VMA_BLACK;
+					if (w->left)
+						w->left->color = VMA_BLACK;
+					vma_rotate_right(x_parent);
+					x = vma_root;
+					x_parent = NULL;
+				}
+			}
+		}
+
+		if (x)
+			x->color = VMA_BLACK;
+	}
+
+	vma_seq++;
+}
+
+/** @brief Find the last VMA, which starts at or below addr */
+static vma_t* vma_floor(size_t addr)
+{
+	vma_t* vma = vma_root;
+	vma_t* ret = NULL;
+
+	while (vma) {
+		if (vma->start <= addr) {
+			ret = vma;
+			vma = vma->right;
+		} else vma = vma->left;
+	}
+
+	return ret;
+}
+
+/** @brief Find the first VMA with a hole larger than size in front of it */
+static vma_t* vma_find_gap(size_t size)
+{
+	vma_t* vma = vma_root;
+
+	if (!vma || (vma->max_gap <= size))
+		return NULL;
+
+	while (1) {
+		if (vma_max_gap(vma->left) > size)
+			vma = vma->left;
+		else if (vma_gap(vma) > size)
+			return vma;
+		else
+			vma = vma->right;
+	}
+}
+
+static inline vma_t* vma_last(void)
+{
+	vma_t* vma = vma_root;
+
+	while (vma && vma->right)
+		vma = vma->right;
+
+	return vma;
+}
+
 int vma_init(void)
 {
 	int ret;
@@ -81,12 +416,12 @@ out:
 size_t vma_alloc(size_t size, uint32_t flags)
 {
 	spinlock_irqsave_t* lock = &hermit_mm_lock;
-	vma_t** list = &vma_list;
+	vma_t* new = NULL;
 
 	LOG_DEBUG("vma_alloc: size = %#lx, flags = %#x\n", size, flags);
 
 	// boundaries of free gaps
-	size_t start, end;
+	size_t start;
 
 	// boundaries for search
 	size_t base = VMA_MIN;
@@ -96,60 +431,64 @@ size_t vma_alloc(size_t size, uint32_t flags)
 
 	spinlock_irqsave_lock(lock);
 
+retry:
+	;
 	// first fit search for free memory area
-	vma_t* pred = NULL;  // vma before current gap
-	vma_t* succ = *list; // vma after current gap
-	do {
-		start = (pred) ? pred->end : base;
-		end = (succ) ? succ->start : limit;
+	vma_t* succ = vma_find_gap(size); // vma after the gap
+	vma_t* pred = succ ? succ->prev : vma_last(); // vma before the gap
 
-		if (start + size < end && start >= base && start + size < limit)
-			goto found; // we found a gap which is large enough and in the bounds
+	start = (pred && (pred->end > base)) ? pred->end : base;
+	if (BUILTIN_EXPECT(!succ && (start + size >= limit), 0))
+		goto fail; // we were unlucky to find a free gap
 
-		pred = succ;
-		succ = (pred) ? pred->next : NULL;
-	} while (pred || succ);
-
-fail:
-	spinlock_irqsave_unlock(lock);	// we were unlucky to find a free gap
-
-	return 0;
-
-found:
-	if (pred && pred->flags == flags) {
+	if (pred && (pred->end == start) && (pred->flags == flags)) {
 		pred->end += size; // resize VMA
+		if (succ)
+			vma_augment_path(succ);
+		vma_seq++;
 		LOG_DEBUG("vma_alloc: resize vma, start 0x%zx, pred->start 0x%zx, pred->end 0x%zx\n", start, pred->start, pred->end);
+
+		if (new)
+			kfree(new);
 	} else {
-		// insert new VMA
-		vma_t* new = kmalloc(sizeof(vma_t));
-		if (BUILTIN_EXPECT(!new, 0))
-			goto fail;
+		if (!new) {
+			uint32_t seq = vma_seq;
+
+			new = kmalloc(sizeof(vma_t));
+			if (BUILTIN_EXPECT(!new, 0))
+				goto fail;
+
+			// kmalloc may allocate VMAs by itself => search again
+			if (seq != vma_seq)
+				goto retry;
+		}
 
+		// insert new VMA
 		new->start = start;
 		new->end = start + size;
 		new->flags = flags;
-		new->next = succ;
-		new->prev = pred;
+		vma_insert(new, pred);
 		LOG_DEBUG("vma_alloc: create new vma, new->start 0x%zx, new->end 0x%zx\n", new->start, new->end);
-
-		if (succ)
-			succ->prev = new;
-		if (pred)
-			pred->next = new;
-		else
-			*list = new;
 	}
 
 	spinlock_irqsave_unlock(lock);
 
 	return start;
+
+fail:
+	spinlock_irqsave_unlock(lock);
+
+	if (new)
+		kfree(new);
+
+	return 0;
 }
 
 int vma_free(size_t start, size_t end)
 {
 	spinlock_irqsave_t* lock = &hermit_mm_lock;
+	vma_t* new = NULL;
 	vma_t* vma;
-	vma_t** list = &vma_list;
 
 	LOG_DEBUG("vma_free: start = %#lx, end = %#lx\n", start, end);
 
@@ -158,59 +497,67 @@ int vma_free(size_t start, size_t end)
 
 	spinlock_irqsave_lock(lock);
 
+retry:
 	// search vma
-	vma = *list;
-	while (vma) {
-		if (start >= vma->start && end <= vma->end) break;
-		vma = vma->next;
-	}
-
-	if (BUILTIN_EXPECT(!vma, 0)) {
+	vma = vma_floor(start);
+	if (BUILTIN_EXPECT(!vma || (end > vma->end), 0)) {
 		spinlock_irqsave_unlock(lock);
+		if (new)
+			kfree(new);
 		return -EINVAL;
 	}
 
 	// free/resize vma
-	if (start == vma->start && end == vma->end) {
-		if (vma == *list)
-			*list = vma->next; // update list head
-		if (vma->prev)
-			vma->prev->next = vma->next;
-		if (vma->next)
-			vma->next->prev = vma->prev;
+	if (start == vma->start && end == vma->end && vma != &vma_boot) {
+		vma_remove(vma);
 		kfree(vma);
-	}
-	else if (start == vma->start)
+	} else if (start == vma->start && end == vma->end) {
+		// the boot VMA isn't dynamically allocated => keep it as empty VMA
+		vma->end = start;
+		if (vma->next)
+			vma_augment_path(vma->next);
+		vma_seq++;
+	} else if (start == vma->start) {
 		vma->start = end;
-	else if (end == vma->end)
+		vma_augment_path(vma);
+		vma_seq++;
+	} else if (end == vma->end) {
 		vma->end = start;
-	else {
-		vma_t* new = kmalloc(sizeof(vma_t));
-		if (BUILTIN_EXPECT(!new, 0)) {
-			spinlock_irqsave_unlock(lock);
-			return -ENOMEM;
+		if (vma->next)
+			vma_augment_path(vma->next);
+		vma_seq++;
+	} else {
+		if (!new) {
+			new = kmalloc(sizeof(vma_t));
+			if (BUILTIN_EXPECT(!new, 0)) {
+				spinlock_irqsave_unlock(lock);
+				return -ENOMEM;
+			}
+
+			// kmalloc may change the VMAs => search again
+			goto retry;
 		}
 
 		new->flags = vma->flags;
-
+		new->start = end;
 		new->end = vma->end;
 		vma->end = start;
-		new->start = end;
-
-		new->next = vma->next;
-		vma->next = new;
-		new->prev = vma;
+		vma_insert(new, vma);
+		new = NULL;
 	}
 
 	spinlock_irqsave_unlock(lock);
 
+	if (new)
+		kfree(new);
+
 	return 0;
 }
 
 int vma_add(size_t start, size_t end, uint32_t flags)
 {
 	spinlock_irqsave_t* lock = &hermit_mm_lock;
-	vma_t** list = &vma_list;
+	vma_t* new = NULL;
 	int ret = 0;
 
 	if (BUILTIN_EXPECT(start >= end, 0))
@@ -220,54 +567,53 @@ int vma_add(size_t start, size_t end, uint32_t flags)
 
 	spinlock_irqsave_lock(lock);
 
+retry:
+	;
 	// search gap
-	vma_t* pred = NULL;
-	vma_t* succ = *list;
+	vma_t* pred = vma_floor(start);
+	vma_t* succ = (pred) ? pred->next : vma_list;
 
-	while (pred || succ) {
-		if ((!pred || pred->end <= start) &&
-		    (!succ || succ->start >= end))
-			break;
-
-		pred = succ;
-		succ = (succ) ? succ->next : NULL;
-	}
-
-	if (BUILTIN_EXPECT(*list && !pred && !succ, 0)) {
+	if (BUILTIN_EXPECT((pred && (pred->end > start)) || (succ && (succ->start < end)), 0)) {
 		ret = -EINVAL;
-		goto fail;
+		goto out;
 	}
 
 	if (pred && (pred->end == start) && (pred->flags == flags)) {
 		pred->end = end; // resize VMA
+		if (succ)
+			vma_augment_path(succ);
+		vma_seq++;
 		LOG_DEBUG("vma_add: resize vma, start 0x%zx, pred->start 0x%zx, pred->end 0x%zx\n", start, pred->start, pred->end);
 	} else {
-		// insert new VMA
-		vma_t* new = kmalloc(sizeof(vma_t));
-		if (BUILTIN_EXPECT(!new, 0)) {
-			ret = -ENOMEM;
-			goto fail;
+		if (!new) {
+			uint32_t seq = vma_seq;
+
+			new = kmalloc(sizeof(vma_t));
+			if (BUILTIN_EXPECT(!new, 0)) {
+				ret = -ENOMEM;
+				goto out;
+			}
+
+			// kmalloc may allocate VMAs by itself => search again
+			if (seq != vma_seq)
+				goto retry;
 		}
 
+		// insert new VMA
 		new->start = start;
 		new->end = end;
 		new->flags = flags;
-		new->next = succ;
-		new->prev = pred;
-		LOG_DEBUG("vma_add: create new vma, new->start 0x%zx, new->end 0x%zx\n", new->start, new->end);
-
-		if (succ)
-			succ->prev = new;
-
-		if (pred)
-			pred->next = new;
-		else
-			*list = new;
+		vma_insert(new, pred);
+		new = NULL;
+		LOG_DEBUG("vma_add: create new vma, start 0x%zx, end 0x%zx\n", start, end);
 	}
 
-fail:
+out:
 	spinlock_irqsave_unlock(lock);
 
+	if (new)
+		kfree(new);
+
 	return ret;
 }
 
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Multi-threaded file I/O benchmark. Every worker writes its own file
+ * in large blocks and reads it back. Meanwhile, the main thread writes
+ * short lines to stdout and measures their latency, which shows how
+ * much the concurrent transfers of the workers delay other requests
+ * to the proxy.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#define MAX_THREADS	64
+#define FILE_SIZE	(64*1024*1024)
+#define BLOCK_SIZE	(4*1024*1024)
+#define NUM_TICKS	100
+
+static pthread_barrier_t barrier;
+static int num_threads = 4;
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+static void* worker(void* arg)
+{
+	int id = (int) (size_t) arg;
+	char fname[64];
+	char* buf;
+	size_t i;
+	int fd;
+
+	buf = malloc(BLOCK_SIZE);
+	if (!buf) {
+		fprintf(stderr, "worker %d: out of memory\n", id);
+		exit(1);
+	}
+	memset(buf, id, BLOCK_SIZE);
+
+	snprintf(fname, sizeof(fname), "/tmp/hermit-fileio-%d", id);
+
+	pthread_barrier_wait(&barrier);
+
+	fd = open(fname, O_CREAT|O_TRUNC|O_RDWR, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "worker %d: unable to open %s\n", id, fname);
+		exit(1);
+	}
+
+	for(i=0; i<FILE_SIZE; i+=BLOCK_SIZE) {
+		if (write(fd, buf, BLOCK_SIZE) != BLOCK_SIZE) {
+			fprintf(stderr, "worker %d: write failed\n", id);
+			exit(1);
+		}
+	}
+
+	lseek(fd, 0, SEEK_SET);
+
+	for(i=0; i<FILE_SIZE; i+=BLOCK_SIZE) {
+		if (read(fd, buf, BLOCK_SIZE) != BLOCK_SIZE) {
+			fprintf(stderr, "worker %d: read failed\n", id);
+			exit(1);
+		}
+	}
+
+	close(fd);
+	unlink(fname);
+	free(buf);
+
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	pthread_t threads[MAX_THREADS];
+	unsigned long long start, end, t, sum = 0, max = 0;
+	char line[] = "tick\n";
+	int i, ticks = 0;
+
+	if (argc > 1)
+		num_threads = atoi(argv[1]);
+	if ((num_threads <= 0) || (num_threads > MAX_THREADS))
+		num_threads = 4;
+
+	pthread_barrier_init(&barrier, NULL, num_threads+1);
+
+	for(i=0; i<num_threads; i++)
+		pthread_create(threads+i, NULL, worker, (void*) (size_t) i);
+
+	pthread_barrier_wait(&barrier);
+	start = rdtsc();
+
+	// latency of short writes to stdout during the transfers
+	for(i=0; i<NUM_TICKS; i++) {
+		t = rdtsc();
+		write(STDOUT_FILENO, line, sizeof(line)-1);
+		t = rdtsc() - t;
+
+		sum += t;
+		if (t > max)
+			max = t;
+		ticks++;
+		usleep(10000);
+	}
+
+	for(i=0; i<num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	end = rdtsc();
+
+	printf("%d threads: %llu cycles for %d MiB\n", num_threads, end - start,
+		num_threads * 2 * (FILE_SIZE >> 20));
+	printf("stdout latency: avg %llu cycles, max %llu cycles\n", sum / ticks, max);
+
+	return 0;
+}
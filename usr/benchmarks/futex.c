@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Compares a futex based mutex and condition variable with the
+ * kernel semaphores (sys_sem_*):
+ * - uncontended lock/unlock
+ * - ping-pong between two threads
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define N	100000
+
+struct sem;
+
+int sys_futex_wait(int* addr, int val, unsigned int ms);
+int sys_futex_wake(int* addr, int n);
+int sys_sem_init(struct sem** sem, unsigned int value);
+int sys_sem_destroy(struct sem* sem);
+int sys_sem_wait(struct sem* sem);
+int sys_sem_post(struct sem* sem);
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+/*
+ * mutex states: 0 = unlocked, 1 = locked, 2 = locked with waiters
+ * (see U. Drepper, "Futexes Are Tricky")
+ */
+static void mutex_lock(int* m)
+{
+	int c = __sync_val_compare_and_swap(m, 0, 1);
+
+	if (!c)
+		return;
+
+	if (c != 2)
+		c = __sync_lock_test_and_set(m, 2);
+	while (c) {
+		sys_futex_wait(m, 2, 0);
+		c = __sync_lock_test_and_set(m, 2);
+	}
+}
+
+static void mutex_unlock(int* m)
+{
+	if (__sync_fetch_and_sub(m, 1) != 1) {
+		*m = 0;
+		__sync_synchronize();
+		sys_futex_wake(m, 1);
+	}
+}
+
+static void cond_wait(int* c, int* m)
+{
+	int seq = *c;
+
+	mutex_unlock(m);
+	sys_futex_wait(c, seq, 0);
+	mutex_lock(m);
+}
+
+static void cond_signal(int* c)
+{
+	__sync_fetch_and_add(c, 1);
+	sys_futex_wake(c, 1);
+}
+
+static int mutex = 0;
+static int cond = 0;
+static volatile int turn = 0;
+
+static struct sem* ping;
+static struct sem* pong;
+
+static void* futex_partner(void* arg)
+{
+	int i;
+
+	for(i=0; i<N; i++) {
+		mutex_lock(&mutex);
+		while (turn != 1)
+			cond_wait(&cond, &mutex);
+		turn = 0;
+		cond_signal(&cond);
+		mutex_unlock(&mutex);
+	}
+
+	return NULL;
+}
+
+static void* sem_partner(void* arg)
+{
+	int i;
+
+	for(i=0; i<N; i++) {
+		sys_sem_wait(ping);
+		sys_sem_post(pong);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long long start, end;
+	struct sem* lock;
+	pthread_t thread;
+	int i;
+
+	printf("Futex versus semaphore\n");
+	printf("======================\n");
+
+	// uncontended lock/unlock
+	mutex_lock(&mutex);
+	mutex_unlock(&mutex);
+
+	start = rdtsc();
+	for(i=0; i<N; i++) {
+		mutex_lock(&mutex);
+		mutex_unlock(&mutex);
+	}
+	end = rdtsc();
+
+	printf("Uncontended futex mutex: %llu cycles\n", (end - start) / N);
+
+	sys_sem_init(&lock, 1);
+	sys_sem_wait(lock);
+	sys_sem_post(lock);
+
+	start = rdtsc();
+	for(i=0; i<N; i++) {
+		sys_sem_wait(lock);
+		sys_sem_post(lock);
+	}
+	end = rdtsc();
+
+	printf("Uncontended semaphore: %llu cycles\n", (end - start) / N);
+	sys_sem_destroy(lock);
+
+	// ping-pong via mutex and condition variable
+	if (pthread_create(&thread, NULL, futex_partner, NULL)) {
+		fprintf(stderr, "Unable to create thread\n");
+		return 1;
+	}
+
+	start = rdtsc();
+	for(i=0; i<N; i++) {
+		mutex_lock(&mutex);
+		while (turn != 0)
+			cond_wait(&cond, &mutex);
+		turn = 1;
+		cond_signal(&cond);
+		mutex_unlock(&mutex);
+	}
+	pthread_join(thread, NULL);
+	end = rdtsc();
+
+	printf("Futex ping-pong: %llu cycles per round trip\n", (end - start) / N);
+
+	// ping-pong via semaphores
+	sys_sem_init(&ping, 0);
+	sys_sem_init(&pong, 0);
+
+	if (pthread_create(&thread, NULL, sem_partner, NULL)) {
+		fprintf(stderr, "Unable to create thread\n");
+		return 1;
+	}
+
+	start = rdtsc();
+	for(i=0; i<N; i++) {
+		sys_sem_post(ping);
+		sys_sem_wait(pong);
+	}
+	pthread_join(thread, NULL);
+	end = rdtsc();
+
+	printf("Semaphore ping-pong: %llu cycles per round trip\n", (end - start) / N);
+
+	sys_sem_destroy(ping);
+	sys_sem_destroy(pong);
+
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Creates an unbalanced load: threads are distributed round robin over
+ * the cores and every thread placed on the first half of the cores computes
+ * LONG_WORK iterations, while all other threads compute SHORT_WORK
+ * iterations. Without load balancing, the first half of the cores computes
+ * two long threads back to back, while the other cores become idle.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define LONG_WORK	(400ULL*1000ULL*1000ULL)
+#define SHORT_WORK	(LONG_WORK / 100ULL)
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+static void* worker(void* arg)
+{
+	unsigned long long n = (unsigned long long) arg;
+	volatile unsigned long long sum = 0;
+	unsigned long long i;
+
+	for(i=0; i<n; i++)
+		sum += i;
+
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long long start, end, work = 0;
+	pthread_t* threads;
+	int i, ncores = 2, nthreads;
+
+	if (argc > 1)
+		ncores = atoi(argv[1]);
+	if (ncores < 2)
+		ncores = 2;
+	nthreads = 2 * ncores;
+
+	threads = (pthread_t*) malloc(sizeof(pthread_t) * nthreads);
+	if (!threads) {
+		fprintf(stderr, "Unable to allocate thread handles\n");
+		return 1;
+	}
+
+	printf("Unbalanced load: %d threads on %d cores\n", nthreads, ncores);
+	printf("========================================\n");
+
+	start = rdtsc();
+	for(i=0; i<nthreads; i++) {
+		unsigned long long n = (i % ncores) < ncores / 2 ? LONG_WORK : SHORT_WORK;
+
+		work += n;
+		if (pthread_create(threads+i, NULL, worker, (void*) n)) {
+			fprintf(stderr, "Unable to create thread %d\n", i);
+			return 1;
+		}
+	}
+
+	for(i=0; i<nthreads; i++)
+		pthread_join(threads[i], NULL);
+	end = rdtsc();
+
+	printf("Elapsed time: %llu cycles\n", end - start);
+	printf("Throughput: %.3f iterations per cycle\n", (double) work / (double) (end - start));
+	printf("Work per core with perfect balance: %llu iterations\n", work / ncores);
+
+	free(threads);
+
+	return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Multi-threaded malloc benchmark. Every thread performs the
+ * allocation pattern of usr/tests/test-malloc-mt.c on its own and
+ * afterwards frees a batch of objects, which were allocated by its
+ * neighbour (remote frees). The benchmark is built twice: "malloc-mt"
+ * uses newlib's allocator (a single global lock), "malloc-mt-hmalloc"
+ * is linked with the per-core arenas of libhmalloc.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+
+#define MAX_THREADS	64
+#define NUM_ITER	10000
+#define SIZE		16
+#define BATCH		1024
+
+static void* objs[MAX_THREADS][BATCH];
+static pthread_barrier_t barrier;
+static int num_threads = 4;
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+static void* worker(void* arg)
+{
+	int id = (int) (size_t) arg;
+	int i;
+	void* buf;
+
+	// local pattern of test-malloc-mt
+	for(i=0; i<NUM_ITER; i++) {
+		buf = malloc(SIZE * (i % 512));
+		free(buf);
+	}
+
+	// producer / consumer pattern
+	for(i=0; i<BATCH; i++) {
+		objs[id][i] = malloc(SIZE + (i % 64) * SIZE);
+		memset(objs[id][i], id, SIZE);
+	}
+
+	pthread_barrier_wait(&barrier);
+
+	for(i=0; i<BATCH; i++)
+		free(objs[(id + 1) % num_threads][i]);
+
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	pthread_t threads[MAX_THREADS];
+	unsigned long long start, end;
+	int i;
+
+	if (argc > 1)
+		num_threads = atoi(argv[1]);
+	if ((num_threads <= 0) || (num_threads > MAX_THREADS))
+		num_threads = 4;
+
+	pthread_barrier_init(&barrier, NULL, num_threads);
+
+	start = rdtsc();
+
+	for(i=0; i<num_threads; i++)
+		pthread_create(threads+i, NULL, worker, (void*) (size_t) i);
+	for(i=0; i<num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	end = rdtsc();
+
+	printf("%d threads: %llu cycles, %llu cycles per malloc/free pair\n",
+		num_threads, end - start,
+		(end - start) / ((unsigned long long) num_threads * (NUM_ITER + BATCH)));
+
+	malloc_stats();
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Compares two ways to load a read-only data file: read() into a
+ * malloc'd buffer and a file mapping. Both sum up all bytes of the
+ * file. With uhyve's positional I/O, the mapping is filled on demand
+ * by the page fault handler.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define FILE_SIZE	(64*1024*1024)
+#define BLOCK_SIZE	(1024*1024)
+
+#define PROT_READ	0x1
+#define MAP_PRIVATE	0x02
+
+extern int sys_mmap(void** addr, size_t len, int prot, int flags, int fd, off_t offset);
+extern int sys_munmap(void* addr, size_t len);
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+static unsigned long long sum(const unsigned char* buf, size_t len)
+{
+	unsigned long long s = 0;
+	size_t i;
+
+	for(i=0; i<len; i++)
+		s += buf[i];
+
+	return s;
+}
+
+int main(int argc, char** argv)
+{
+	const char* fname = "/tmp/hermit-mmap";
+	unsigned long long t, s;
+	char* buf;
+	void* addr;
+	size_t i;
+	int fd, ret;
+
+	buf = malloc(FILE_SIZE);
+	if (!buf) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for(i=0; i<FILE_SIZE; i++)
+		buf[i] = (char) i;
+
+	fd = open(fname, O_CREAT|O_TRUNC|O_WRONLY, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "unable to create %s\n", fname);
+		return 1;
+	}
+
+	for(i=0; i<FILE_SIZE; i+=BLOCK_SIZE) {
+		if (write(fd, buf+i, BLOCK_SIZE) != BLOCK_SIZE) {
+			fprintf(stderr, "write failed\n");
+			return 1;
+		}
+	}
+	close(fd);
+	memset(buf, 0x00, FILE_SIZE);
+
+	// read the whole file into the buffer
+	t = rdtsc();
+	fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "unable to open %s\n", fname);
+		return 1;
+	}
+	for(i=0; i<FILE_SIZE; i+=BLOCK_SIZE) {
+		if (read(fd, buf+i, BLOCK_SIZE) != BLOCK_SIZE) {
+			fprintf(stderr, "read failed\n");
+			return 1;
+		}
+	}
+	close(fd);
+	s = sum((unsigned char*) buf, FILE_SIZE);
+	t = rdtsc() - t;
+	printf("read: %llu cycles (sum %llu)\n", t, s);
+
+	free(buf);
+
+	// map the file, the pages are read on the first access
+	t = rdtsc();
+	fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "unable to open %s\n", fname);
+		return 1;
+	}
+	ret = sys_mmap(&addr, FILE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (ret) {
+		fprintf(stderr, "mmap failed: %d\n", ret);
+		return 1;
+	}
+	s = sum((unsigned char*) addr, FILE_SIZE);
+	t = rdtsc() - t;
+	printf("mmap: %llu cycles (sum %llu)\n", t, s);
+
+	sys_munmap(addr, FILE_SIZE);
+	close(fd);
+	unlink(fname);
+
+	return 0;
+}
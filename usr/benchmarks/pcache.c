@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Page cache benchmark. The same file is opened, read and closed
+ * several times. With -pcache, only the first pass is served by the
+ * host, while all further passes are hits in the guest.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define FILE_SIZE	(32*1024*1024)
+#define BLOCK_SIZE	(64*1024)
+#define NUM_PASSES	8
+
+/* copy of the kernel's pcache_stats_t */
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t readahead;
+	uint64_t evictions;
+	uint64_t invalidations;
+	size_t budget;
+	size_t used;
+} pcache_stats_t;
+
+extern int sys_pcache_stats(pcache_stats_t* stats);
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+int main(int argc, char** argv)
+{
+	const char* fname = "/tmp/hermit-pcache";
+	unsigned long long t;
+	pcache_stats_t stats;
+	char* buf;
+	size_t i;
+	int fd, pass;
+
+	buf = malloc(BLOCK_SIZE);
+	if (!buf) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	memset(buf, 0x42, BLOCK_SIZE);
+
+	fd = open(fname, O_CREAT|O_TRUNC|O_WRONLY, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "unable to create %s\n", fname);
+		return 1;
+	}
+
+	for(i=0; i<FILE_SIZE; i+=BLOCK_SIZE) {
+		if (write(fd, buf, BLOCK_SIZE) != BLOCK_SIZE) {
+			fprintf(stderr, "write failed\n");
+			return 1;
+		}
+	}
+	close(fd);
+
+	for(pass=0; pass<NUM_PASSES; pass++) {
+		t = rdtsc();
+
+		fd = open(fname, O_RDONLY);
+		if (fd < 0) {
+			fprintf(stderr, "unable to open %s\n", fname);
+			return 1;
+		}
+
+		for(i=0; i<FILE_SIZE; i+=BLOCK_SIZE) {
+			if (read(fd, buf, BLOCK_SIZE) != BLOCK_SIZE) {
+				fprintf(stderr, "read failed\n");
+				return 1;
+			}
+		}
+
+		close(fd);
+
+		t = rdtsc() - t;
+		printf("pass %d: %llu cycles for %d MiB\n", pass, t, FILE_SIZE >> 20);
+	}
+
+	unlink(fname);
+	free(buf);
+
+	if (sys_pcache_stats(&stats)) {
+		printf("page cache is disabled (boot with -pcache <MiB>)\n");
+		return 0;
+	}
+
+	printf("hits %llu, misses %llu, read-ahead %llu, evictions %llu, invalidations %llu\n",
+		(unsigned long long) stats.hits, (unsigned long long) stats.misses,
+		(unsigned long long) stats.readahead, (unsigned long long) stats.evictions,
+		(unsigned long long) stats.invalidations);
+	printf("used %zu of %zu KiB\n", stats.used >> 10, stats.budget >> 10);
+
+	return 0;
+}
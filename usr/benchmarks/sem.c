@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Creates and destroys 100k kernel semaphores. The distance between two
+ * semaphores, which are allocated back to back, shows the memory
+ * footprint of a semaphore (including the size class of kmalloc).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define N	100000
+
+struct sem;
+
+int sys_sem_init(struct sem** sem, unsigned int value);
+int sys_sem_destroy(struct sem* sem);
+
+static struct sem* sems[N];
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long long start, end;
+	size_t dist, min_dist = ~0UL;
+	int i;
+
+	printf("Semaphore creation\n");
+	printf("==================\n");
+
+	start = rdtsc();
+	for(i=0; i<N; i++) {
+		if (sys_sem_init(sems+i, 0)) {
+			fprintf(stderr, "Unable to create semaphore %d\n", i);
+			return 1;
+		}
+	}
+	end = rdtsc();
+
+	printf("Average time for sys_sem_init: %llu cycles\n", (end - start) / N);
+
+	for(i=1; i<N; i++) {
+		dist = sems[i] > sems[i-1] ? (size_t) sems[i] - (size_t) sems[i-1] : (size_t) sems[i-1] - (size_t) sems[i];
+		if (dist < min_dist)
+			min_dist = dist;
+	}
+
+	printf("Memory per semaphore: %zu bytes\n", min_dist);
+	printf("Memory for %d semaphores: %zu KiB\n", N, (N * min_dist) >> 10);
+
+	start = rdtsc();
+	for(i=0; i<N; i++)
+		sys_sem_destroy(sems[i]);
+	end = rdtsc();
+
+	printf("Average time for sys_sem_destroy: %llu cycles\n", (end - start) / N);
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Measures the latency of pthread_create + pthread_join for an empty
+ * thread and reports the median and the 99th percentile.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define N	10000
+
+static unsigned long long samples[N];
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+static void* worker(void* arg)
+{
+	return arg;
+}
+
+static int cmp(const void* a, const void* b)
+{
+	unsigned long long x = *(const unsigned long long*) a;
+	unsigned long long y = *(const unsigned long long*) b;
+
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long long start, end;
+	pthread_t thread;
+	int i, n = N;
+
+	if (argc > 1)
+		n = atoi(argv[1]);
+	if ((n <= 0) || (n > N))
+		n = N;
+
+	printf("Thread creation latency\n");
+	printf("=======================\n");
+
+	// warm-up
+	for(i=0; i<10; i++) {
+		pthread_create(&thread, NULL, worker, NULL);
+		pthread_join(thread, NULL);
+	}
+
+	for(i=0; i<n; i++) {
+		start = rdtsc();
+		if (pthread_create(&thread, NULL, worker, NULL)) {
+			fprintf(stderr, "Unable to create thread %d\n", i);
+			return 1;
+		}
+		pthread_join(thread, NULL);
+		end = rdtsc();
+
+		samples[i] = end - start;
+	}
+
+	qsort(samples, n, sizeof(unsigned long long), cmp);
+
+	printf("create/join of %d threads\n", n);
+	printf("min: %llu cycles\n", samples[0]);
+	printf("p50: %llu cycles\n", samples[n / 2]);
+	printf("p99: %llu cycles\n", samples[(n * 99) / 100]);
+	printf("max: %llu cycles\n", samples[n - 1]);
+
+	return 0;
+}
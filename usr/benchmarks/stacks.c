@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Stress test for the management of the virtual address space. Each
+ * thread requires a fresh user and kernel stack, which are allocated
+ * by vma_alloc() and released by vma_free(). The benchmark keeps a
+ * growing number of threads alive and releases every second thread to
+ * fragment the address space. Threads are created in batches, which are
+ * larger than the per-core task slot cache. The reported cost of a
+ * create/join pair should stay flat, while the number of VMAs grows.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define MAX_LIVE	800
+#define STEP		100
+#define BATCH		64
+#define ROUNDS		100
+
+static pthread_t live[MAX_LIVE];
+static pthread_t batch[STEP];
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+static void* blocker(void* arg)
+{
+	// wait until main releases the mutex
+	pthread_mutex_lock(&mutex);
+	pthread_mutex_unlock(&mutex);
+
+	return arg;
+}
+
+static void* worker(void* arg)
+{
+	return arg;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long long start, end;
+	int i, j, n = 0, max_live = MAX_LIVE;
+
+	if (argc > 1)
+		max_live = atoi(argv[1]);
+	if ((max_live <= 0) || (max_live > MAX_LIVE))
+		max_live = MAX_LIVE;
+
+	printf("Stack allocation stress test\n");
+	printf("============================\n");
+	printf("live threads\tcycles per create/join\n");
+
+	pthread_mutex_lock(&mutex);
+
+	while (n + STEP <= max_live) {
+		// add blocked threads, release every second one => holes
+		for(i=0; i<STEP; i++) {
+			if (pthread_create(batch+i, NULL, (i % 2) ? blocker : worker, NULL)) {
+				fprintf(stderr, "Unable to create thread\n");
+				goto out;
+			}
+		}
+		for(i=0; i<STEP; i++) {
+			if (i % 2)
+				live[n++] = batch[i];
+			else
+				pthread_join(batch[i], NULL);
+		}
+
+		start = rdtsc();
+		for(j=0; j<ROUNDS; j++) {
+			for(i=0; i<BATCH; i++) {
+				if (pthread_create(batch+i, NULL, worker, NULL)) {
+					fprintf(stderr, "Unable to create thread\n");
+					goto out;
+				}
+			}
+			for(i=0; i<BATCH; i++)
+				pthread_join(batch[i], NULL);
+		}
+		end = rdtsc();
+
+		printf("%d\t\t%llu\n", n, (end - start) / (ROUNDS * BATCH));
+	}
+
+out:
+	pthread_mutex_unlock(&mutex);
+
+	for(i=0; i<n; i++)
+		pthread_join(live[i], NULL);
+
+	return 0;
+}
@@ -46,6 +46,7 @@
 # include <float.h>
 # include <limits.h>
 # include <sys/time.h>
+# include <stdlib.h>
 
 /*-----------------------------------------------------------------------
  * INSTRUCTIONS:
@@ -176,9 +177,23 @@
 #define STREAM_TYPE double
 #endif
 
+#ifdef STREAM_HBW
+/* HermitCore: place the arrays in the high bandwidth memory */
+# include <hbwmalloc.h>
+static STREAM_TYPE	*a, *b, *c;
+#elif defined(STREAM_HEAP)
+/* HermitCore: place the arrays on the heap, which is mapped by 2 MiB
+ * pages or, with STREAM_HEAP_1G, by 1 GiB pages */
+static STREAM_TYPE	*a, *b, *c;
+
+#ifdef STREAM_HEAP_1G
+extern int sys_heap_pagesize(size_t size);
+#endif
+#else
 static STREAM_TYPE	a[STREAM_ARRAY_SIZE+OFFSET],
 			b[STREAM_ARRAY_SIZE+OFFSET],
 			c[STREAM_ARRAY_SIZE+OFFSET];
+#endif
 
 static double	avgtime[4] = {0}, maxtime[4] = {0},
 		mintime[4] = {FLT_MAX,FLT_MAX,FLT_MAX,FLT_MAX};
@@ -263,8 +278,39 @@ main()
     printf ("Number of Threads counted = %i\n",k);
 #endif
 
+#ifdef STREAM_HBW
+    if (hbw_check_available())
+	printf("High bandwidth memory is not available, use the regular memory\n");
+    else
+	printf("The arrays are placed in the high bandwidth memory\n");
+    a = (STREAM_TYPE*) hbw_malloc(sizeof(STREAM_TYPE) * (STREAM_ARRAY_SIZE+OFFSET));
+    b = (STREAM_TYPE*) hbw_malloc(sizeof(STREAM_TYPE) * (STREAM_ARRAY_SIZE+OFFSET));
+    c = (STREAM_TYPE*) hbw_malloc(sizeof(STREAM_TYPE) * (STREAM_ARRAY_SIZE+OFFSET));
+    if (!a || !b || !c) {
+	printf("Unable to allocate the arrays in the high bandwidth memory\n");
+	exit(1);
+    }
+#elif defined(STREAM_HEAP)
+#ifdef STREAM_HEAP_1G
+    if (sys_heap_pagesize(1UL << 30))
+	printf("1 GiB pages are not supported, fall back to 2 MiB pages\n");
+    else
+	printf("The heap is mapped by 1 GiB pages\n");
+#endif
+    a = (STREAM_TYPE*) malloc(sizeof(STREAM_TYPE) * (STREAM_ARRAY_SIZE+OFFSET));
+    b = (STREAM_TYPE*) malloc(sizeof(STREAM_TYPE) * (STREAM_ARRAY_SIZE+OFFSET));
+    c = (STREAM_TYPE*) malloc(sizeof(STREAM_TYPE) * (STREAM_ARRAY_SIZE+OFFSET));
+    if (!a || !b || !c) {
+	printf("Unable to allocate the arrays on the heap\n");
+	exit(1);
+    }
+#endif
+
     /* Get initial value for system clock. */
+#ifndef STREAM_SERIAL_INIT
+    /* HermitCore: the first touch maps the heap pages on the NUMA node of each thread */
 #pragma omp parallel for
+#endif
     for (j=0; j<STREAM_ARRAY_SIZE; j++) {
 	    a[j] = 1.0;
 	    b[j] = 2.0;
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Syscall throughput of I/O requests, which are forwarded to the host.
+ * Under uhyve, compare the runs with and without the syscall ring
+ * (command line option "-uhyve-ring" for the stand-in consumer). Short
+ * writes to stdout are queued by the ring, lseek and writes to files
+ * wait for their completion.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define FNAME	"/tmp/hermit-syscall-bench"
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long long start, stdout_cycles, lseek_cycles, file_cycles;
+	char buf[64];
+	int i, fd, n = 10000;
+
+	if (argc > 1)
+		n = atoi(argv[1]);
+	if (n <= 0)
+		n = 10000;
+
+	memset(buf, 'x', sizeof(buf));
+
+	fd = open(FNAME, O_CREAT|O_TRUNC|O_RDWR, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open %s\n", FNAME);
+		return 1;
+	}
+
+	// short writes to stdout (bypass the buffer of the libc)
+	start = rdtsc();
+	for(i=0; i<n; i++)
+		write(STDOUT_FILENO, ".", 1);
+	stdout_cycles = rdtsc() - start;
+	write(STDOUT_FILENO, "\n", 1);
+
+	start = rdtsc();
+	for(i=0; i<n; i++)
+		lseek(fd, 0, SEEK_CUR);
+	lseek_cycles = rdtsc() - start;
+
+	start = rdtsc();
+	for(i=0; i<n; i++)
+		write(fd, buf, sizeof(buf));
+	file_cycles = rdtsc() - start;
+
+	close(fd);
+	unlink(FNAME);
+
+	printf("%d calls each\n", n);
+	printf("write(stdout, 1 byte): %llu cycles per call\n", stdout_cycles / n);
+	printf("lseek:                 %llu cycles per call\n", lseek_cycles / n);
+	printf("write(file, %zd bytes): %llu cycles per call\n", sizeof(buf), file_cycles / n);
+
+	return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include "hbwmalloc.h"
+
+void* sys_hbw_malloc(size_t size);
+void* sys_hbw_calloc(size_t nmemb, size_t size);
+void* sys_hbw_realloc(void* ptr, size_t size);
+int sys_hbw_posix_memalign(void** memptr, size_t align, size_t size);
+void sys_hbw_free(void* ptr);
+int sys_hbw_check_available(void);
+int sys_hbw_set_policy(int policy);
+int sys_hbw_get_policy(void);
+
+int hbw_check_available(void)
+{
+	return -sys_hbw_check_available();
+}
+
+void* hbw_malloc(size_t size)
+{
+	void* ptr = sys_hbw_malloc(size);
+
+	if (!ptr)
+		errno = ENOMEM;
+
+	return ptr;
+}
+
+void* hbw_calloc(size_t nmemb, size_t size)
+{
+	void* ptr = sys_hbw_calloc(nmemb, size);
+
+	if (!ptr && nmemb && size)
+		errno = ENOMEM;
+
+	return ptr;
+}
+
+void* hbw_realloc(void* ptr, size_t size)
+{
+	void* new = sys_hbw_realloc(ptr, size);
+
+	if (!new && size)
+		errno = ENOMEM;
+
+	return new;
+}
+
+void hbw_free(void* ptr)
+{
+	sys_hbw_free(ptr);
+}
+
+int hbw_posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+	return -sys_hbw_posix_memalign(memptr, alignment, size);
+}
+
+int hbw_set_policy(hbw_policy_t mode)
+{
+	return -sys_hbw_set_policy(mode);
+}
+
+hbw_policy_t hbw_get_policy(void)
+{
+	return (hbw_policy_t) sys_hbw_get_policy();
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file hbwmalloc.h
+ * @brief Allocation of high bandwidth memory
+ *
+ * Subset of the hbwmalloc interface of memkind. The blocks are taken
+ * from the hbw heap of the kernel, which is mapped by huge pages.
+ * Link with -lhbwmalloc.
+ */
+
+#ifndef __HBWMALLOC_H__
+#define __HBWMALLOC_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	/// use only the high bandwidth memory
+	HBW_POLICY_BIND = 1,
+	/// use the regular memory, if the high bandwidth memory is exhausted (default)
+	HBW_POLICY_PREFERRED = 2,
+	/// alternate huge pages between the high bandwidth and the regular memory
+	HBW_POLICY_INTERLEAVE = 3
+} hbw_policy_t;
+
+/** @brief Check if high bandwidth memory is available
+ *
+ * @return 0 if available, ENODEV otherwise
+ */
+int hbw_check_available(void);
+
+void* hbw_malloc(size_t size);
+void* hbw_calloc(size_t nmemb, size_t size);
+void* hbw_realloc(void* ptr, size_t size);
+void hbw_free(void* ptr);
+
+/** @brief Allocate an aligned block
+ *
+ * @return 0 on success, EINVAL for an invalid alignment, ENOMEM if out of memory
+ */
+int hbw_posix_memalign(void** memptr, size_t alignment, size_t size);
+
+/** @brief Set the policy of the hbw heap
+ *
+ * The policy can be changed only before the first allocation.
+ *
+ * @return 0 on success, EINVAL for an unknown policy, EPERM after the first allocation
+ */
+int hbw_set_policy(hbw_policy_t mode);
+
+/** @brief Current policy of the hbw heap */
+hbw_policy_t hbw_get_policy(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
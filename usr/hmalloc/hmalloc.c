@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2018, Stefan Lankes, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Replaces newlib's allocator, which serializes all threads by
+ * __sys_malloc_lock(), by the per-core arenas of the kernel.
+ * Link with -lhmalloc to select it.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <reent.h>
+
+void* sys_malloc(size_t size);
+void* sys_calloc(size_t nmemb, size_t size);
+void* sys_realloc(void* ptr, size_t size);
+void* sys_memalign(size_t align, size_t size);
+size_t sys_malloc_usable_size(void* ptr);
+void sys_free(void* ptr);
+void sys_malloc_stats(void);
+
+void* _malloc_r(struct _reent* r, size_t size)
+{
+	void* ptr = sys_malloc(size);
+
+	if (!ptr)
+		r->_errno = ENOMEM;
+
+	return ptr;
+}
+
+void _free_r(struct _reent* r, void* ptr)
+{
+	sys_free(ptr);
+}
+
+void* _calloc_r(struct _reent* r, size_t nmemb, size_t size)
+{
+	void* ptr = sys_calloc(nmemb, size);
+
+	if (!ptr && nmemb && size)
+		r->_errno = ENOMEM;
+
+	return ptr;
+}
+
+void* _realloc_r(struct _reent* r, void* ptr, size_t size)
+{
+	void* new = sys_realloc(ptr, size);
+
+	if (!new && size)
+		r->_errno = ENOMEM;
+
+	return new;
+}
+
+void* _memalign_r(struct _reent* r, size_t align, size_t size)
+{
+	void* ptr = sys_memalign(align, size);
+
+	if (!ptr)
+		r->_errno = ENOMEM;
+
+	return ptr;
+}
+
+size_t _malloc_usable_size_r(struct _reent* r, void* ptr)
+{
+	return sys_malloc_usable_size(ptr);
+}
+
+void _malloc_stats_r(struct _reent* r)
+{
+	sys_malloc_stats();
+}
+
+void* malloc(size_t size)
+{
+	return _malloc_r(_REENT, size);
+}
+
+void free(void* ptr)
+{
+	sys_free(ptr);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+	return _calloc_r(_REENT, nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+	return _realloc_r(_REENT, ptr, size);
+}
+
+void* memalign(size_t align, size_t size)
+{
+	return _memalign_r(_REENT, align, size);
+}
+
+int posix_memalign(void** memptr, size_t align, size_t size)
+{
+	void* ptr;
+
+	if (!align || (align & (align - 1)) || (align % sizeof(void*)))
+		return EINVAL;
+
+	ptr = sys_memalign(align, size);
+	if (!ptr)
+		return ENOMEM;
+
+	*memptr = ptr;
+
+	return 0;
+}
+
+size_t malloc_usable_size(void* ptr)
+{
+	return sys_malloc_usable_size(ptr);
+}
+
+void malloc_stats(void)
+{
+	sys_malloc_stats();
+}